@@ -1,207 +1,363 @@
-/* db_compiler.c - a simple basic compiler
- *
- * Copyright (c) 2014 by David Michael Betz.  All rights reserved.
- *
- */
-
-#include <stdio.h>
-#include <stdlib.h>
-#include <stdarg.h>
-#include <setjmp.h>
-#include <string.h>
-#include <ctype.h>
-#include "db_compiler.h"
-#include "db_vmdebug.h"
-#include "db_vm.h"
-
-//#define DEBUG
-
-/* Compile - compile a program */
-VMVALUE Compile(System *sys, ImageHdr *image)
-{
-    VMVALUE mainCode;
-    ParseContext *c;
-    int tkn;
-
-    /* allocate and initialize the parse context */
-    if (!(c = (ParseContext *)AllocateFreeSpace(sys, sizeof(ParseContext))))
-        return 0;
-    memset(c, 0, sizeof(ParseContext));
-    c->sys = sys;
-    c->image = image;
-    
-    /* setup an error target */
-    if (setjmp(c->sys->errorTarget) != 0)
-        return 0;
-
-    /* use the rest of the free space for the compiler heap */
-    c->heapBase = c->heapFree = sys->freeNext;
-    c->heapTop = sys->freeTop;
-
-    /* initialize block nesting table */
-    c->btop = (Block *)((char *)c->blockBuf + sizeof(c->blockBuf));
-    c->bptr = c->blockBuf - 1;
-
-    /* initialize the label table */
-    c->labels = NULL;
-
-    /* start in the main code */
-    c->codeType = CODE_TYPE_MAIN;
-
-    /* enter built-in symbols */
-    EnterBuiltInSymbols(c);
-
-    /* initialize scanner */
-    c->inComment = VMFALSE;
-    
-    /* parse a statement */
-    do {
-        if ((tkn = GetToken(c)) == T_EOF)
-            break;
-        ParseStatement(c, tkn);
-    } while (c->bptr >= c->blockBuf);
-
-    /* end the main code with a halt */
-    putcbyte(c, OP_HALT);
-    
-    /* write the main code */
-    StartCode(c, CODE_TYPE_MAIN);
-    mainCode = StoreCode(c);
-
-#ifdef DEBUG
-    {
-        int size = image->heapTop - image->data;
-        size -= image->heapFree - image->codeFree;
-        DumpSymbols(&c->image->globals, "symbols");
-        VM_printf("size: %d\n", size);
-    }
-#endif
-
-    /* return the main function */
-    return mainCode;
-}
-
-/* StartCode - start a function or method under construction */
-void StartCode(ParseContext *c, CodeType type)
-{
-    ImageHdr *image = c->image;
-    
-    /* all methods must precede the main code */
-    if (type != CODE_TYPE_MAIN && image->codeFree > image->codeBuf)
-        ParseError(c, "subroutines and functions must precede the main code");
-
-    /* don't allow nested functions or subroutines (for now anyway) */
-    if (type != CODE_TYPE_MAIN && c->codeType != CODE_TYPE_MAIN)
-        ParseError(c, "nested subroutines and functions are not supported");
-
-    /* initialize the code object under construction */
-    InitSymbolTable(&c->arguments);
-    InitSymbolTable(&c->locals);
-    c->localOffset = 0;
-    c->codeType = type;
-    
-    /* write the code prolog */
-    if (type != CODE_TYPE_MAIN) {
-        putcbyte(c, OP_FRAME);
-        putcbyte(c, 0);
-    }
-}
-
-/* StoreCode - store the function or method under construction */
-VMVALUE StoreCode(ParseContext *c)
-{
-    ImageHdr *image = c->image;
-    VMVALUE code;
-    size_t size;
-
-    /* check for unterminated blocks */
-    switch (CurrentBlockType(c)) {
-    case BLOCK_DEF:
-        //ParseError(c, "expecting '}'");
-        break;
-    case BLOCK_IF:
-        ParseError(c, "expecting statement after 'if'");
-    case BLOCK_ELSE:
-        ParseError(c, "expecting statement after 'else'");
-    case BLOCK_FOR:
-        ParseError(c, "expecting statement after 'for'");
-    case BLOCK_WHILE:
-        ParseError(c, "expecting statement after 'while'");
-    case BLOCK_DO:
-        ParseError(c, "expecting statement after 'do'");
-    case BLOCK_BLOCK:
-        ParseError(c, "expecting '}'");
-    case BLOCK_NONE:
-        break;
-    }
-
-    /* fixup the RESERVE instruction at the start of the code */
-    if (c->codeType != CODE_TYPE_MAIN) {
-        image->codeBuf[1] = 2 + c->localOffset;
-        putcbyte(c, OP_RETURN);
-    }
-
-    /* make sure all referenced labels were defined */
-    CheckLabels(c);
-    
-    /* get the address of the compiled code */
-    code = (VMVALUE)image->codeBuf;
-    size = image->codeFree - image->codeBuf;
-    image->codeBuf += (size + ALIGN_MASK) & ~ALIGN_MASK;
-    image->codeFree = image->codeBuf;
-
-#ifdef DEBUG
-{
-    VM_printf("%s:\n", c->codeSymbol ? c->codeSymbol->name : "<main>");
-    DecodeFunction((uint8_t *)code, size);
-    DumpSymbols(&c->arguments, "arguments");
-    DumpSymbols(&c->locals, "locals");
-    VM_printf("\n");
-}
-#endif
-
-    /* empty the local heap */
-    c->heapFree = c->heapBase;
-    InitSymbolTable(&c->arguments);
-    InitSymbolTable(&c->locals);
-    c->labels = NULL;
-
-    /* reset to compile the next code */
-    c->codeType = CODE_TYPE_MAIN;
-    
-    /* return the code vector */
-    return code;
-}
-
-/* AddString - add a string to the string table */
-String *AddString(ParseContext *c, char *value)
-{
-    String *str;
-    int size;
-    
-    /* check to see if the string is already in the table */
-    for (str = c->image->strings; str != NULL; str = str->next)
-        if (strcmp(value, str->data) == 0)
-            return str;
-
-    /* allocate the string structure */
-    size = sizeof(String) + strlen(value);
-    str = (String *)AllocateImageSpace(c->image, size);
-    strcpy((char *)str->data, value);
-    str->next = c->image->strings;
-    c->image->strings = str;
-
-    /* return the string table entry */
-    return str;
-}
-
-/* LocalAlloc - allocate memory from the local heap */
-void *LocalAlloc(ParseContext *c, size_t size)
-{
-    void *addr = c->heapFree;
-    size = (size + ALIGN_MASK) & ~ALIGN_MASK;
-    if (c->heapFree + size > c->heapTop)
-        Abort(c->sys, "insufficient memory");
-    c->heapFree += size;
-    return addr;
-}
+/* db_compiler.c - a simple basic compiler
+ *
+ * Copyright (c) 2014 by David Michael Betz.  All rights reserved.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <setjmp.h>
+#include <string.h>
+#include <ctype.h>
+#include "db_compiler.h"
+#include "db_vmdebug.h"
+#include "db_vm.h"
+
+//#define DEBUG
+
+static VMVALUE CompileCode(System *sys, ImageHdr *image, int wholeProgram);
+static void SetAsideMainCode(ParseContext *c);
+static void RestoreMainCode(ParseContext *c);
+
+/* Compile - compile the next top level statement */
+VMVALUE Compile(System *sys, ImageHdr *image)
+{
+    return CompileCode(sys, image, VMFALSE);
+}
+
+/* CompileProgram - compile the rest of the input into a single main code
+
+   The top level statements all go into one main code that is run once
+   and functions are stored as they are defined as usual. */
+VMVALUE CompileProgram(System *sys, ImageHdr *image)
+{
+    return CompileCode(sys, image, VMTRUE);
+}
+
+/* CompileCode - compile one statement or the whole program */
+static VMVALUE CompileCode(System *sys, ImageHdr *image, int wholeProgram)
+{
+    VMVALUE mainCode;
+    ParseContext *c;
+    int tkn;
+
+    /* allocate and initialize the parse context */
+    if (!(c = (ParseContext *)AllocateFreeSpace(sys, sizeof(ParseContext))))
+        return 0;
+    memset(c, 0, sizeof(ParseContext));
+    c->sys = sys;
+    c->image = image;
+    c->wholeProgram = wholeProgram;
+    
+    /* setup an error target */
+    if (setjmp(c->sys->errorTarget) != 0)
+        return 0;
+
+    /* use the rest of the free space for the compiler heap */
+    c->heapBase = c->heapFree = sys->freeNext;
+    c->heapTop = sys->freeTop;
+
+    /* initialize block nesting table */
+    c->btop = (Block *)((char *)c->blockBuf + sizeof(c->blockBuf));
+    c->bptr = c->blockBuf - 1;
+
+    /* initialize the label table */
+    c->labels = NULL;
+
+    /* start in the main code */
+    c->codeType = CODE_TYPE_MAIN;
+
+    /* enter built-in symbols */
+    EnterBuiltInSymbols(c);
+
+    /* initialize scanner */
+    c->inComment = VMFALSE;
+    
+    /* parse a statement */
+    do {
+        if ((tkn = GetToken(c)) == T_EOF) {
+            if (c->bptr >= c->blockBuf)
+                ParseError(c, "unexpected end of file");
+            break;
+        }
+        ParseStatement(c, tkn);
+    } while (c->wholeProgram || c->bptr >= c->blockBuf);
+
+    /* end the main code with a halt */
+    putcbyte(c, OP_HALT);
+    
+    /* write the main code */
+    StartCode(c, CODE_TYPE_MAIN);
+    mainCode = StoreCode(c);
+
+#ifdef DEBUG
+    {
+        int size = image->heapTop - image->data;
+        size -= image->heapFree - image->codeFree;
+        DumpSymbols(&c->image->globals, "symbols");
+        VM_printf("size: %d\n", size);
+    }
+#endif
+
+    /* return the main function */
+    return mainCode;
+}
+
+/* StartCode - start a function or method under construction */
+void StartCode(ParseContext *c, CodeType type)
+{
+    ImageHdr *image = c->image;
+    
+    /* don't allow nested functions or subroutines (for now anyway) */
+    if (type != CODE_TYPE_MAIN && c->codeType != CODE_TYPE_MAIN)
+        ParseError(c, "nested subroutines and functions are not supported");
+
+    /* all methods must precede the main code unless the main code can be
+       set aside until the function is stored */
+    if (type != CODE_TYPE_MAIN) {
+        if (c->wholeProgram)
+            SetAsideMainCode(c);
+        else if (image->codeFree > image->codeBuf)
+            ParseError(c, "subroutines and functions must precede the main code");
+    }
+
+    /* initialize the code object under construction */
+    InitSymbolTable(&c->arguments);
+    InitSymbolTable(&c->locals);
+    c->localOffset = 0;
+    c->codeType = type;
+    
+    /* write the code prolog */
+    if (type != CODE_TYPE_MAIN) {
+        putcbyte(c, OP_FRAME);
+        putcbyte(c, 0);
+#ifdef USE_STACK_DEPTH
+        putcbyte(c, 0);
+#endif
+    }
+}
+
+/* StoreCode - store the function or method under construction */
+VMVALUE StoreCode(ParseContext *c)
+{
+    ImageHdr *image = c->image;
+    uint8_t *start = image->codeBuf;
+    uint8_t *stored;
+    int temps = 0;
+    VMVALUE code;
+    size_t size;
+#ifdef USE_TIERS
+    Profile *profile;
+#endif
+
+    /* check for unterminated blocks */
+    switch (CurrentBlockType(c)) {
+    case BLOCK_DEF:
+        //ParseError(c, "expecting '}'");
+        break;
+    case BLOCK_IF:
+        ParseError(c, "expecting statement after 'if'");
+    case BLOCK_ELSE:
+        ParseError(c, "expecting statement after 'else'");
+    case BLOCK_FOR:
+        ParseError(c, "expecting statement after 'for'");
+    case BLOCK_WHILE:
+        ParseError(c, "expecting statement after 'while'");
+    case BLOCK_DO:
+        ParseError(c, "expecting statement after 'do'");
+    case BLOCK_BLOCK:
+        ParseError(c, "expecting '}'");
+    case BLOCK_NONE:
+        break;
+    }
+
+#ifdef USE_REGISTER_CODE
+    /* place the temporary registers in the frame after the local variables */
+    temps = code_temps(c);
+#endif
+
+    /* fixup the RESERVE instruction at the start of the code */
+    if (c->codeType != CODE_TYPE_MAIN) {
+        image->codeBuf[1] = FRAME_LINKAGE + c->localOffset + temps;
+        putcbyte(c, OP_RETURN);
+    }
+
+    /* make sure all referenced labels were defined */
+    CheckLabels(c);
+
+#ifdef USE_TIERS
+    /* make room for the execution profile in front of the code */
+    size = image->codeFree - image->codeBuf;
+    if (image->codeFree + sizeof(Profile) > image->heapFree)
+        ParseError(c, "insufficient image space");
+    memmove(image->codeBuf + sizeof(Profile), image->codeBuf, size);
+    profile = (Profile *)image->codeBuf;
+    image->codeBuf += sizeof(Profile);
+    image->codeFree += sizeof(Profile);
+#endif
+
+#ifdef USE_STACK_DEPTH
+    /* give the main code a frame so its stack depth is checked too (moving
+       the code by a multiple of the alignment to keep its operands aligned) */
+    if (c->codeType == CODE_TYPE_MAIN) {
+        int shift = (3 + ALIGN_MASK) & ~ALIGN_MASK;
+        size = image->codeFree - image->codeBuf;
+        if (image->codeFree + shift > image->heapFree)
+            ParseError(c, "insufficient image space");
+        memmove(image->codeBuf + shift, image->codeBuf, size);
+        image->codeBuf += shift - 3;
+        image->codeBuf[0] = OP_FRAME;
+        image->codeBuf[1] = FRAME_LINKAGE + temps;
+        image->codeFree += shift;
+    }
+
+    /* store the maximum stack depth in the FRAME instruction */
+    image->codeBuf[2] = code_stackdepth(c);
+#endif
+    
+    /* move the code to the heap (start and the heap are both aligned so the
+       operands stay aligned) */
+    size = image->codeFree - start;
+    if (!(stored = (uint8_t *)AllocateImageSpace(image, size)))
+        ParseError(c, "insufficient image space");
+    memcpy(stored, start, size);
+#ifdef USE_TIERS
+    profile = (Profile *)(stored + ((uint8_t *)profile - start));
+#endif
+
+    /* get the address of the compiled code */
+    code = VMADDR(image, stored + (image->codeBuf - start));
+    size = image->codeFree - image->codeBuf;
+    image->codeBuf = image->codeFree = start;
+
+#ifdef USE_TIERS
+    /* only functions can be promoted since the main code runs just once */
+    profile->calls = 0;
+    profile->loops = 0;
+    profile->tier = c->codeType == CODE_TYPE_MAIN ? TIER_NONE : 0;
+    profile->size = size;
+#endif
+
+#ifdef DEBUG
+{
+    VM_printf("%s:\n", c->codeSymbol ? c->codeSymbol->name : "<main>");
+    DecodeFunction((uint8_t *)VMPTR(image, code), size);
+    DumpSymbols(&c->arguments, "arguments");
+    DumpSymbols(&c->locals, "locals");
+    VM_printf("\n");
+}
+#endif
+
+#ifdef USE_THREADED_CODE
+    /* translate the bytecode to threaded code for the interpreter */
+    if (!(code = ThreadCode(image, (uint8_t *)VMPTR(image, code), size, (int *)LocalAlloc(c, (size + 1) * sizeof(int)))))
+        ParseError(c, "insufficient image space");
+#endif
+
+#if defined(USE_JIT) && !defined(USE_TIERS)
+    /* translate functions to native code (keeping the bytecode since native
+       frames still return to bytecode addresses) */
+    if (c->codeType == CODE_TYPE_FUNCTION) {
+        VMVALUE stub = JitCompile(c->sys, image, (uint8_t *)VMPTR(image, code), size);
+        if (stub)
+            code = stub;
+    }
+#endif
+
+    /* empty the local heap */
+    c->heapFree = c->heapBase;
+    InitSymbolTable(&c->arguments);
+    InitSymbolTable(&c->locals);
+    c->labels = NULL;
+
+    /* reset to compile the next code */
+    c->codeType = CODE_TYPE_MAIN;
+    if (c->mainHeapBase)
+        RestoreMainCode(c);
+    
+    /* return the code vector */
+    return code;
+}
+
+/* SetAsideMainCode - set the main code aside while a function is compiled
+
+   The function is built just after the main code (aligned so its operands
+   stay aligned when it is stored) and everything the main code has in the
+   local heap is kept below the part the function uses.  The main code
+   always starts at the end of the global segment so it moves up along with
+   the function when globals are added. */
+static void SetAsideMainCode(ParseContext *c)
+{
+    ImageHdr *image = c->image;
+    c->mainCodeSize = image->codeFree - image->codeBuf;
+    c->mainHeapBase = c->heapBase;
+    c->mainLabels = c->labels;
+#ifdef USE_REGISTER_CODE
+    c->mainTempRefs = c->tempRefs;
+    c->mainMaxTemps = c->maxTemps;
+    c->tempRefs = NULL;
+    c->tempCount = c->maxTemps = 0;
+#endif
+    c->heapBase = c->heapFree;
+    c->labels = NULL;
+    image->codeBuf = image->codeFree = image->codeBuf + ((c->mainCodeSize + ALIGN_MASK) & ~ALIGN_MASK);
+}
+
+/* RestoreMainCode - carry on with the main code after storing a function */
+static void RestoreMainCode(ParseContext *c)
+{
+    c->heapBase = c->mainHeapBase;
+    c->labels = c->mainLabels;
+#ifdef USE_REGISTER_CODE
+    c->tempRefs = c->mainTempRefs;
+    c->maxTemps = c->mainMaxTemps;
+#endif
+    c->mainHeapBase = NULL;
+    c->image->codeBuf = c->image->globalsFree;
+    c->image->codeFree = c->image->codeBuf + c->mainCodeSize;
+}
+
+/* AddString - add a string to the string table
+
+   Each string is stored just once and its length is stored in front of it
+   so it can be printed without looking for the end. */
+String *AddString(ParseContext *c, char *value)
+{
+    int length = strlen(value);
+    String *str;
+    
+    /* check to see if the string is already in the table */
+    if ((str = FindString(c->image, value)) != NULL)
+        return str;
+
+    /* allocate the string structure */
+    if (!(str = (String *)AllocateImageSpace(c->image, sizeof(String) + length)))
+        ParseError(c, "insufficient image space");
+    str->length = length;
+    memcpy(str->data, value, length + 1);
+
+#ifdef USE_NAME_INDEX
+    /* add it to the index */
+    if (!IndexName(c->image, &c->image->stringIndex, str->data))
+        ParseError(c, "insufficient image space");
+#endif
+
+    /* add it to the string table */
+    str->next = c->image->strings;
+    c->image->strings = str;
+
+    /* return the string table entry */
+    return str;
+}
+
+/* LocalAlloc - allocate memory from the local heap */
+void *LocalAlloc(ParseContext *c, size_t size)
+{
+    void *addr = c->heapFree;
+    size = (size + ALIGN_MASK) & ~ALIGN_MASK;
+    if (c->heapFree + size > c->heapTop)
+        Abort(c->sys, "insufficient memory");
+    c->heapFree += size;
+    return addr;
+}
@@ -1,637 +1,663 @@
-/* db_expr.c - expression parser
- *
- * Copyright (c) 2014 by David Michael Betz.  All rights reserved.
- *
- */
-
-#include <stdlib.h>
-#include "db_compiler.h"
-
-/* local function prototypes */
-static ParseTreeNode *ParseExpr1(ParseContext *c);
-static ParseTreeNode *ParseExpr2(ParseContext *c);
-static ParseTreeNode *ParseExpr3(ParseContext *c);
-static ParseTreeNode *ParseExpr4(ParseContext *c);
-static ParseTreeNode *ParseExpr5(ParseContext *c);
-static ParseTreeNode *ParseExpr6(ParseContext *c);
-static ParseTreeNode *ParseExpr7(ParseContext *c);
-static ParseTreeNode *ParseExpr8(ParseContext *c);
-static ParseTreeNode *ParseExpr9(ParseContext *c);
-static ParseTreeNode *ParseExpr10(ParseContext *c);
-static ParseTreeNode *ParseExpr11(ParseContext *c);
-static ParseTreeNode *ParseSimplePrimary(ParseContext *c);
-static ParseTreeNode *ParseArrayReference(ParseContext *c, ParseTreeNode *arrayNode);
-static ParseTreeNode *ParseCall(ParseContext *c, ParseTreeNode *functionNode);
-static ParseTreeNode *MakeUnaryOpNode(ParseContext *c, int op, ParseTreeNode *expr);
-static ParseTreeNode *MakeBinaryOpNode(ParseContext *c, int op, ParseTreeNode *left, ParseTreeNode *right);
-static ParseTreeNode *MakeAssignmentOpNode(ParseContext *c, int op, ParseTreeNode *left, ParseTreeNode *right);
-static ParseTreeNode *NewParseTreeNode(ParseContext *c, int type);
-
-/* ParseRValue - parse and generate code for an r-value */
-void ParseRValue(ParseContext *c)
-{
-    ParseTreeNode *expr;
-    expr = ParseExpr(c);
-    code_rvalue(c, expr);
-}
-
-/* ParseExpr - handle assignment operators */
-ParseTreeNode *ParseExpr(ParseContext *c)
-{
-    ParseTreeNode *node;
-    int tkn;
-    node = ParseExpr1(c);
-    while ((tkn = GetToken(c)) == '='
-    ||      tkn == T_ADDEQ || tkn == T_SUBEQ
-    ||      tkn == T_MULEQ || tkn == T_DIVEQ || tkn == T_REMEQ
-    ||      tkn == T_ANDEQ || tkn == T_OREQ  || tkn == T_XOREQ
-    ||      tkn == T_SHLEQ || tkn == T_SHREQ) {
-        ParseTreeNode *node2 = ParseExpr(c);
-        int op;
-        switch (tkn) {
-        case '=':
-            op = OP_EQ; // indicator of simple assignment
-            break;
-        case T_ADDEQ:
-            op = OP_ADD;
-            break;
-        case T_SUBEQ:
-            op = OP_SUB;
-            break;
-        case T_MULEQ:
-            op = OP_MUL;
-            break;
-        case T_DIVEQ:
-            op = OP_DIV;
-            break;
-        case T_REMEQ:
-            op = OP_REM;
-            break;
-        case T_ANDEQ:
-            op = OP_BAND;
-            break;
-        case T_OREQ:
-            op = OP_BOR;
-            break;
-        case T_XOREQ:
-            op = OP_BXOR;
-            break;
-        case T_SHLEQ:
-            op = OP_SHL;
-            break;
-        case T_SHREQ:
-            op = OP_SHR;
-            break;
-        default:
-            /* not reached */
-            op = 0;
-            break;
-        }
-        node = MakeAssignmentOpNode(c, op, node, node2);
-    }
-    SaveToken(c, tkn);
-    return node;
-}
-
-/* ParseExpr1 - handle the '||' operator */
-static ParseTreeNode *ParseExpr1(ParseContext *c)
-{
-    ParseTreeNode *node;
-    int tkn;
-    node = ParseExpr2(c);
-    if ((tkn = GetToken(c)) == T_OR) {
-        ParseTreeNode *node2 = NewParseTreeNode(c, NodeTypeDisjunction);
-        ExprListEntry *entry, **pLast;
-        node2->u.exprList.exprs = entry = (ExprListEntry *)LocalAlloc(c, sizeof(ExprListEntry));
-        entry->expr = node;
-        entry->next = NULL;
-        pLast = &entry->next;
-        do {
-            entry = (ExprListEntry *)LocalAlloc(c, sizeof(ExprListEntry));
-            entry->expr = ParseExpr2(c);
-            entry->next = NULL;
-            *pLast = entry;
-            pLast = &entry->next;
-        } while ((tkn = GetToken(c)) == T_OR);
-        node = node2;
-    }
-    SaveToken(c, tkn);
-    return node;
-}
-
-/* ParseExpr2 - handle the '&&' operator */
-static ParseTreeNode *ParseExpr2(ParseContext *c)
-{
-    ParseTreeNode *node;
-    int tkn;
-    node = ParseExpr3(c);
-    if ((tkn = GetToken(c)) == T_AND) {
-        ParseTreeNode *node2 = NewParseTreeNode(c, NodeTypeConjunction);
-        ExprListEntry *entry, **pLast;
-        node2->u.exprList.exprs = entry = (ExprListEntry *)LocalAlloc(c, sizeof(ExprListEntry));
-        entry->expr = node;
-        entry->next = NULL;
-        pLast = &entry->next;
-        do {
-            entry = (ExprListEntry *)LocalAlloc(c, sizeof(ExprListEntry));
-            entry->expr = ParseExpr2(c);
-            entry->next = NULL;
-            *pLast = entry;
-            pLast = &entry->next;
-        } while ((tkn = GetToken(c)) == T_AND);
-        node = node2;
-    }
-    SaveToken(c, tkn);
-    return node;
-}
-
-/* ParseExpr3 - handle the '^' operator */
-static ParseTreeNode *ParseExpr3(ParseContext *c)
-{
-    ParseTreeNode *expr, *expr2;
-    int tkn;
-    expr = ParseExpr4(c);
-    while ((tkn = GetToken(c)) == '^') {
-        expr2 = ParseExpr4(c);
-        if (IsIntegerLit(expr) && IsIntegerLit(expr2))
-            expr->u.integerLit.value = expr->u.integerLit.value ^ expr2->u.integerLit.value;
-        else
-            expr = MakeBinaryOpNode(c, OP_BXOR, expr, expr2);
-    }
-    SaveToken(c,tkn);
-    return expr;
-}
-
-/* ParseExpr4 - handle the '|' operator */
-static ParseTreeNode *ParseExpr4(ParseContext *c)
-{
-    ParseTreeNode *expr, *expr2;
-    int tkn;
-    expr = ParseExpr5(c);
-    while ((tkn = GetToken(c)) == '|') {
-        expr2 = ParseExpr5(c);
-        if (IsIntegerLit(expr) && IsIntegerLit(expr2))
-            expr->u.integerLit.value = expr->u.integerLit.value | expr2->u.integerLit.value;
-        else
-            expr = MakeBinaryOpNode(c, OP_BOR, expr, expr2);
-    }
-    SaveToken(c,tkn);
-    return expr;
-}
-
-/* ParseExpr5 - handle the '&' operator */
-static ParseTreeNode *ParseExpr5(ParseContext *c)
-{
-    ParseTreeNode *expr, *expr2;
-    int tkn;
-    expr = ParseExpr6(c);
-    while ((tkn = GetToken(c)) == '&') {
-        expr2 = ParseExpr6(c);
-        if (IsIntegerLit(expr) && IsIntegerLit(expr2))
-            expr->u.integerLit.value = expr->u.integerLit.value & expr2->u.integerLit.value;
-        else
-            expr = MakeBinaryOpNode(c, OP_BAND, expr, expr2);
-    }
-    SaveToken(c,tkn);
-    return expr;
-}
-
-/* ParseExpr6 - handle the '==' and '!=' operators */
-static ParseTreeNode *ParseExpr6(ParseContext *c)
-{
-    ParseTreeNode *expr, *expr2;
-    int tkn;
-    expr = ParseExpr7(c);
-    while ((tkn = GetToken(c)) == T_EQ || tkn == T_NE) {
-        int op;
-        expr2 = ParseExpr7(c);
-        switch (tkn) {
-        case T_EQ:
-            op = OP_EQ;
-            break;
-        case T_NE:
-            op = OP_NE;
-            break;
-        default:
-            /* not reached */
-            op = 0;
-            break;
-        }
-        expr = MakeBinaryOpNode(c, op, expr, expr2);
-    }
-    SaveToken(c,tkn);
-    return expr;
-}
-
-/* ParseExpr7 - handle the '<', '<=', '>=' and '>' operators */
-static ParseTreeNode *ParseExpr7(ParseContext *c)
-{
-    ParseTreeNode *expr, *expr2;
-    int tkn;
-    expr = ParseExpr8(c);
-    while ((tkn = GetToken(c)) == '<' || tkn == T_LE || tkn == T_GE || tkn == '>') {
-        int op;
-        expr2 = ParseExpr8(c);
-        switch (tkn) {
-        case '<':
-            op = OP_LT;
-            break;
-        case T_LE:
-            op = OP_LE;
-            break;
-        case T_GE:
-            op = OP_GE;
-            break;
-        case '>':
-            op = OP_GT;
-            break;
-        default:
-            /* not reached */
-            op = 0;
-            break;
-        }
-        expr = MakeBinaryOpNode(c, op, expr, expr2);
-    }
-    SaveToken(c,tkn);
-    return expr;
-}
-
-/* ParseExpr8 - handle the '<<' and '>>' operators */
-static ParseTreeNode *ParseExpr8(ParseContext *c)
-{
-    ParseTreeNode *expr, *expr2;
-    int tkn;
-    expr = ParseExpr9(c);
-    while ((tkn = GetToken(c)) == T_SHL || tkn == T_SHR) {
-        expr2 = ParseExpr9(c);
-        if (IsIntegerLit(expr) && IsIntegerLit(expr2)) {
-            switch (tkn) {
-            case T_SHL:
-                expr->u.integerLit.value = expr->u.integerLit.value << expr2->u.integerLit.value;
-                break;
-            case T_SHR:
-                expr->u.integerLit.value = expr->u.integerLit.value >> expr2->u.integerLit.value;
-                break;
-            default:
-                /* not reached */
-                break;
-            }
-        }
-        else {
-            int op;
-            switch (tkn) {
-            case T_SHL:
-                op = OP_SHL;
-                break;
-            case T_SHR:
-                op = OP_SHR;
-                break;
-            default:
-                /* not reached */
-                op = 0;
-                break;
-            }
-            expr = MakeBinaryOpNode(c, op, expr, expr2);
-        }
-    }
-    SaveToken(c,tkn);
-    return expr;
-}
-
-/* ParseExpr9 - handle the '+' and '-' operators */
-static ParseTreeNode *ParseExpr9(ParseContext *c)
-{
-    ParseTreeNode *expr, *expr2;
-    int tkn;
-    expr = ParseExpr10(c);
-    while ((tkn = GetToken(c)) == '+' || tkn == '-') {
-        expr2 = ParseExpr10(c);
-        if (IsIntegerLit(expr) && IsIntegerLit(expr2)) {
-            switch (tkn) {
-            case '+':
-                expr->u.integerLit.value = expr->u.integerLit.value + expr2->u.integerLit.value;
-                break;
-            case '-':
-                expr->u.integerLit.value = expr->u.integerLit.value - expr2->u.integerLit.value;
-                break;
-            default:
-                /* not reached */
-                break;
-            }
-        }
-        else {
-            int op;
-            switch (tkn) {
-            case '+':
-                op = OP_ADD;
-                break;
-            case '-':
-                op = OP_SUB;
-                break;
-            default:
-                /* not reached */
-                op = 0;
-                break;
-            }
-            expr = MakeBinaryOpNode(c, op, expr, expr2);
-        }
-    }
-    SaveToken(c, tkn);
-    return expr;
-}
-
-/* ParseExpr10 - handle the '*', '/' and '%' operators */
-static ParseTreeNode *ParseExpr10(ParseContext *c)
-{
-    ParseTreeNode *node, *node2;
-    int tkn;
-    node = ParseExpr11(c);
-    while ((tkn = GetToken(c)) == '*' || tkn == '/' || tkn == '%') {
-        node2 = ParseExpr11(c);
-        if (IsIntegerLit(node) && IsIntegerLit(node2)) {
-            switch (tkn) {
-            case '*':
-                node->u.integerLit.value = node->u.integerLit.value * node2->u.integerLit.value;
-                break;
-            case '/':
-                if (node2->u.integerLit.value == 0)
-                    ParseError(c, "division by zero in constant expression");
-                node->u.integerLit.value = node->u.integerLit.value / node2->u.integerLit.value;
-                break;
-            case '%':
-                if (node2->u.integerLit.value == 0)
-                    ParseError(c, "division by zero in constant expression");
-                node->u.integerLit.value = node->u.integerLit.value % node2->u.integerLit.value;
-                break;
-            default:
-                /* not reached */
-                break;
-            }
-        }
-        else {
-            int op;
-            switch (tkn) {
-            case '*':
-                op = OP_MUL;
-                break;
-            case '/':
-                op = OP_DIV;
-                break;
-            case '%':
-                op = OP_REM;
-                break;
-            default:
-                /* not reached */
-                op = 0;
-                break;
-            }
-            node = MakeBinaryOpNode(c, op, node, node2);
-        }
-    }
-    SaveToken(c, tkn);
-    return node;
-}
-
-/* ParseExpr11 - handle unary operators */
-static ParseTreeNode *ParseExpr11(ParseContext *c)
-{
-    ParseTreeNode *node;
-    int tkn;
-    switch (tkn = GetToken(c)) {
-    case '+':
-        node = ParsePrimary(c);
-        break;
-    case '-':
-        node = ParsePrimary(c);
-        if (IsIntegerLit(node))
-            node->u.integerLit.value = -node->u.integerLit.value;
-        else
-            node = MakeUnaryOpNode(c, OP_NEG, node);
-        break;
-    case '!':
-        node = ParsePrimary(c);
-        if (IsIntegerLit(node))
-            node->u.integerLit.value = !node->u.integerLit.value;
-        else
-            node = MakeUnaryOpNode(c, OP_NOT, node);
-        break;
-    case '~':
-        node = ParsePrimary(c);
-        if (IsIntegerLit(node))
-            node->u.integerLit.value = ~node->u.integerLit.value;
-        else
-            node = MakeUnaryOpNode(c, OP_BNOT, node);
-        break;
-    case T_INC:
-        node = NewParseTreeNode(c, NodeTypePreincrementOp);
-        node->u.incrementOp.increment = 1;
-        node->u.incrementOp.expr = ParsePrimary(c);
-        break;
-    case T_DEC:
-        node = NewParseTreeNode(c, NodeTypePreincrementOp);
-        node->u.incrementOp.increment = -1;
-        node->u.incrementOp.expr = ParsePrimary(c);
-        break;
-    default:
-        SaveToken(c,tkn);
-        node = ParsePrimary(c);
-        break;
-    }
-    return node;
-}
-
-/* ParsePrimary - parse function calls and array references */
-ParseTreeNode *ParsePrimary(ParseContext *c)
-{
-    ParseTreeNode *node, *node2;
-    int tkn;
-    node = ParseSimplePrimary(c);
-    while ((tkn = GetToken(c)) == '[' || tkn == '(' || tkn == T_INC || tkn == T_DEC) {
-        switch (tkn) {
-        case '[':
-            node = ParseArrayReference(c, node);
-            break;
-        case '(':
-            node = ParseCall(c, node);
-            break;
-        case T_INC:
-            node2 = NewParseTreeNode(c, NodeTypePostincrementOp);
-            node2->u.incrementOp.increment = 1;
-            node2->u.incrementOp.expr = node;
-            node = node2;
-            break;
-        case T_DEC:
-            node2 = NewParseTreeNode(c, NodeTypePostincrementOp);
-            node2->u.incrementOp.increment = -1;
-            node2->u.incrementOp.expr = node;
-            node = node2;
-            break;
-        }
-    }
-    SaveToken(c, tkn);
-    return node;
-}
-
-/* ParseArrayReference - parse an array reference */
-static ParseTreeNode *ParseArrayReference(ParseContext *c, ParseTreeNode *arrayNode)
-{
-    ParseTreeNode *node = NewParseTreeNode(c, NodeTypeArrayRef);
-
-    /* setup the array reference */
-    node->u.arrayRef.array = arrayNode;
-
-    /* get the index expression */
-    node->u.arrayRef.index = ParseExpr(c);
-
-    /* check for the close bracket */
-    FRequire(c, ']');
-    return node;
-}
-
-/* ParseCall - parse a function or subroutine call */
-static ParseTreeNode *ParseCall(ParseContext *c, ParseTreeNode *functionNode)
-{
-    ParseTreeNode *node = NewParseTreeNode(c, NodeTypeFunctionCall);
-    ExprListEntry **pLast;
-    int tkn;
-
-    /* intialize the function call node */
-    node->u.functionCall.fcn = functionNode;
-    pLast = &node->u.functionCall.args;
-
-    /* parse the argument list */
-    if ((tkn = GetToken(c)) != ')') {
-        SaveToken(c, tkn);
-        do {
-            ExprListEntry *actual;
-            actual = (ExprListEntry *)LocalAlloc(c, sizeof(ExprListEntry));
-            actual->expr = ParseExpr(c);
-            actual->next = NULL;
-            *pLast = actual;
-            pLast = &actual->next;
-            ++node->u.functionCall.argc;
-        } while ((tkn = GetToken(c)) == ',');
-        Require(c, tkn, ')');
-    }
-
-    /* return the function call node */
-    return node;
-}
-
-/* ParseSimplePrimary - parse a primary expression */
-static ParseTreeNode *ParseSimplePrimary(ParseContext *c)
-{
-    ParseTreeNode *node;
-    switch (GetToken(c)) {
-    case '(':
-        node = ParseExpr(c);
-        FRequire(c,')');
-        break;
-    case T_NUMBER:
-        node = NewParseTreeNode(c, NodeTypeIntegerLit);
-        node->u.integerLit.value = c->value;
-        break;
-    case T_STRING:
-        node = NewParseTreeNode(c, NodeTypeStringLit);
-        node->u.stringLit.string = AddString(c, c->token);
-        break;
-    case T_IDENTIFIER:
-        node = GetSymbolRef(c, c->token);
-        break;
-    default:
-        ParseError(c, "Expecting a primary expression");
-        node = NULL; /* not reached */
-        break;
-    }
-    return node;
-}
-
-/* GetSymbolRef - setup a symbol reference */
-ParseTreeNode *GetSymbolRef(ParseContext *c, char *name)
-{
-    ParseTreeNode *node = NewParseTreeNode(c, NodeTypeGlobalSymbolRef);
-    Symbol *symbol;
-
-    /* handle local variables within a function or subroutine */
-    if (c->codeType != CODE_TYPE_MAIN && (symbol = FindSymbol(&c->locals, name)) != NULL) {
-        if (IsConstant(symbol)) {
-            node->nodeType = NodeTypeIntegerLit;
-            node->u.integerLit.value = symbol->value;
-        }
-        else {
-            node->nodeType = NodeTypeLocalSymbolRef;
-            node->u.symbolRef.symbol = symbol;
-            node->u.symbolRef.offset = -symbol->value - 1;
-        }
-    }
-
-    /* handle function or subroutine arguments or the return value symbol */
-    else if (c->codeType != CODE_TYPE_MAIN && (symbol = FindSymbol(&c->arguments, name)) != NULL) {
-        node->nodeType = NodeTypeLocalSymbolRef;
-        node->u.symbolRef.offset = c->arguments.count - symbol->value - 1;
-    }
-
-    /* handle global symbols */
-    else if ((symbol = FindSymbol(&c->image->globals, c->token)) != NULL) {
-        if (IsConstant(symbol)) {
-            node->nodeType = NodeTypeIntegerLit;
-            node->u.integerLit.value = symbol->value;
-        }
-        else {
-            node->u.symbolRef.symbol = symbol;
-        }
-    }
-
-    /* handle undefined symbols */
-    else {
-        symbol = AddGlobal(c, name, SC_VARIABLE, 0);
-        node->u.symbolRef.symbol = symbol;
-    }
-
-    /* return the symbol reference node */
-    return node;
-}
-
-/* MakeUnaryOpNode - allocate a unary operation parse tree node */
-static ParseTreeNode *MakeUnaryOpNode(ParseContext *c, int op, ParseTreeNode *expr)
-{
-    ParseTreeNode *node = NewParseTreeNode(c, NodeTypeUnaryOp);
-    node->u.unaryOp.op = op;
-    node->u.unaryOp.expr = expr;
-    return node;
-}
-
-/* MakeBinaryOpNode - allocate a binary operation parse tree node */
-static ParseTreeNode *MakeBinaryOpNode(ParseContext *c, int op, ParseTreeNode *left, ParseTreeNode *right)
-{
-    ParseTreeNode *node = NewParseTreeNode(c, NodeTypeBinaryOp);
-    node->u.binaryOp.op = op;
-    node->u.binaryOp.left = left;
-    node->u.binaryOp.right = right;
-    return node;
-}
-
-/* MakeAssignmentOpNode - allocate an assignment operation parse tree node */
-static ParseTreeNode *MakeAssignmentOpNode(ParseContext *c, int op, ParseTreeNode *left, ParseTreeNode *right)
-{
-    ParseTreeNode *node = NewParseTreeNode(c, NodeTypeAssignmentOp);
-    node->u.binaryOp.op = op;
-    node->u.binaryOp.left = left;
-    node->u.binaryOp.right = right;
-    return node;
-}
-
-/* NewParseTreeNode - allocate a new parse tree node */
-static ParseTreeNode *NewParseTreeNode(ParseContext *c, int type)
-{
-    ParseTreeNode *node = (ParseTreeNode *)LocalAlloc(c, sizeof(ParseTreeNode));
-    memset(node, 0, sizeof(ParseTreeNode));
-    node->nodeType = type;
-    return node;
-}
-
-/* IsIntegerLit - check to see if a node is an integer literal */
-int IsIntegerLit(ParseTreeNode *node)
-{
-    return node->nodeType == NodeTypeIntegerLit;
-}
+/* db_expr.c - expression parser
+ *
+ * Copyright (c) 2014 by David Michael Betz.  All rights reserved.
+ *
+ */
+
+#include <stdlib.h>
+#include "db_compiler.h"
+
+/* local function prototypes */
+static ParseTreeNode *ParseExpr1(ParseContext *c);
+static ParseTreeNode *ParseExpr2(ParseContext *c);
+static ParseTreeNode *ParseExpr3(ParseContext *c);
+static ParseTreeNode *ParseExpr4(ParseContext *c);
+static ParseTreeNode *ParseExpr5(ParseContext *c);
+static ParseTreeNode *ParseExpr6(ParseContext *c);
+static ParseTreeNode *ParseExpr7(ParseContext *c);
+static ParseTreeNode *ParseExpr8(ParseContext *c);
+static ParseTreeNode *ParseExpr9(ParseContext *c);
+static ParseTreeNode *ParseExpr10(ParseContext *c);
+static ParseTreeNode *ParseExpr11(ParseContext *c);
+static ParseTreeNode *ParseSimplePrimary(ParseContext *c);
+static ParseTreeNode *ParseArrayReference(ParseContext *c, ParseTreeNode *arrayNode);
+static ParseTreeNode *ParseCall(ParseContext *c, ParseTreeNode *functionNode);
+static ParseTreeNode *MakeUnaryOpNode(ParseContext *c, int op, ParseTreeNode *expr);
+static ParseTreeNode *MakeBinaryOpNode(ParseContext *c, int op, ParseTreeNode *left, ParseTreeNode *right);
+static ParseTreeNode *MakeAssignmentOpNode(ParseContext *c, int op, ParseTreeNode *left, ParseTreeNode *right);
+static ParseTreeNode *NewParseTreeNode(ParseContext *c, int type);
+
+/* ParseRValue - parse and generate code for an r-value */
+void ParseRValue(ParseContext *c)
+{
+    ParseTreeNode *expr;
+    expr = ParseExpr(c);
+    code_rvalue(c, expr);
+}
+
+/* ParseVoidExpr - parse and generate code for an expression evaluated only for its side effects */
+void ParseVoidExpr(ParseContext *c)
+{
+    ParseTreeNode *expr;
+    expr = ParseExpr(c);
+    code_void(c, expr);
+}
+
+/* ParseBranch - parse a test expression and generate code to branch on it */
+void ParseBranch(ParseContext *c, int op)
+{
+    ParseTreeNode *expr;
+    expr = ParseExpr(c);
+    code_branch(c, expr, op);
+}
+
+/* ParseExpr - handle assignment operators */
+ParseTreeNode *ParseExpr(ParseContext *c)
+{
+    ParseTreeNode *node;
+    int tkn;
+    node = ParseExpr1(c);
+    while ((tkn = GetToken(c)) == '='
+    ||      tkn == T_ADDEQ || tkn == T_SUBEQ
+    ||      tkn == T_MULEQ || tkn == T_DIVEQ || tkn == T_REMEQ
+    ||      tkn == T_ANDEQ || tkn == T_OREQ  || tkn == T_XOREQ
+    ||      tkn == T_SHLEQ || tkn == T_SHREQ) {
+        ParseTreeNode *node2 = ParseExpr(c);
+        int op;
+        switch (tkn) {
+        case '=':
+            op = OP_EQ; // indicator of simple assignment
+            break;
+        case T_ADDEQ:
+            op = OP_ADD;
+            break;
+        case T_SUBEQ:
+            op = OP_SUB;
+            break;
+        case T_MULEQ:
+            op = OP_MUL;
+            break;
+        case T_DIVEQ:
+            op = OP_DIV;
+            break;
+        case T_REMEQ:
+            op = OP_REM;
+            break;
+        case T_ANDEQ:
+            op = OP_BAND;
+            break;
+        case T_OREQ:
+            op = OP_BOR;
+            break;
+        case T_XOREQ:
+            op = OP_BXOR;
+            break;
+        case T_SHLEQ:
+            op = OP_SHL;
+            break;
+        case T_SHREQ:
+            op = OP_SHR;
+            break;
+        default:
+            /* not reached */
+            op = 0;
+            break;
+        }
+        node = MakeAssignmentOpNode(c, op, node, node2);
+    }
+    SaveToken(c, tkn);
+    return node;
+}
+
+/* ParseExpr1 - handle the '||' operator */
+static ParseTreeNode *ParseExpr1(ParseContext *c)
+{
+    ParseTreeNode *node;
+    int tkn;
+    node = ParseExpr2(c);
+    if ((tkn = GetToken(c)) == T_OR) {
+        ParseTreeNode *node2 = NewParseTreeNode(c, NodeTypeDisjunction);
+        ExprListEntry *entry, **pLast;
+        node2->u.exprList.exprs = entry = (ExprListEntry *)LocalAlloc(c, sizeof(ExprListEntry));
+        entry->expr = node;
+        entry->next = NULL;
+        pLast = &entry->next;
+        do {
+            entry = (ExprListEntry *)LocalAlloc(c, sizeof(ExprListEntry));
+            entry->expr = ParseExpr2(c);
+            entry->next = NULL;
+            *pLast = entry;
+            pLast = &entry->next;
+        } while ((tkn = GetToken(c)) == T_OR);
+        node = node2;
+    }
+    SaveToken(c, tkn);
+    return node;
+}
+
+/* ParseExpr2 - handle the '&&' operator */
+static ParseTreeNode *ParseExpr2(ParseContext *c)
+{
+    ParseTreeNode *node;
+    int tkn;
+    node = ParseExpr3(c);
+    if ((tkn = GetToken(c)) == T_AND) {
+        ParseTreeNode *node2 = NewParseTreeNode(c, NodeTypeConjunction);
+        ExprListEntry *entry, **pLast;
+        node2->u.exprList.exprs = entry = (ExprListEntry *)LocalAlloc(c, sizeof(ExprListEntry));
+        entry->expr = node;
+        entry->next = NULL;
+        pLast = &entry->next;
+        do {
+            entry = (ExprListEntry *)LocalAlloc(c, sizeof(ExprListEntry));
+            entry->expr = ParseExpr2(c);
+            entry->next = NULL;
+            *pLast = entry;
+            pLast = &entry->next;
+        } while ((tkn = GetToken(c)) == T_AND);
+        node = node2;
+    }
+    SaveToken(c, tkn);
+    return node;
+}
+
+/* ParseExpr3 - handle the '^' operator */
+static ParseTreeNode *ParseExpr3(ParseContext *c)
+{
+    ParseTreeNode *expr, *expr2;
+    int tkn;
+    expr = ParseExpr4(c);
+    while ((tkn = GetToken(c)) == '^') {
+        expr2 = ParseExpr4(c);
+        if (IsIntegerLit(expr) && IsIntegerLit(expr2))
+            expr->u.integerLit.value = expr->u.integerLit.value ^ expr2->u.integerLit.value;
+        else
+            expr = MakeBinaryOpNode(c, OP_BXOR, expr, expr2);
+    }
+    SaveToken(c,tkn);
+    return expr;
+}
+
+/* ParseExpr4 - handle the '|' operator */
+static ParseTreeNode *ParseExpr4(ParseContext *c)
+{
+    ParseTreeNode *expr, *expr2;
+    int tkn;
+    expr = ParseExpr5(c);
+    while ((tkn = GetToken(c)) == '|') {
+        expr2 = ParseExpr5(c);
+        if (IsIntegerLit(expr) && IsIntegerLit(expr2))
+            expr->u.integerLit.value = expr->u.integerLit.value | expr2->u.integerLit.value;
+        else
+            expr = MakeBinaryOpNode(c, OP_BOR, expr, expr2);
+    }
+    SaveToken(c,tkn);
+    return expr;
+}
+
+/* ParseExpr5 - handle the '&' operator */
+static ParseTreeNode *ParseExpr5(ParseContext *c)
+{
+    ParseTreeNode *expr, *expr2;
+    int tkn;
+    expr = ParseExpr6(c);
+    while ((tkn = GetToken(c)) == '&') {
+        expr2 = ParseExpr6(c);
+        if (IsIntegerLit(expr) && IsIntegerLit(expr2))
+            expr->u.integerLit.value = expr->u.integerLit.value & expr2->u.integerLit.value;
+        else
+            expr = MakeBinaryOpNode(c, OP_BAND, expr, expr2);
+    }
+    SaveToken(c,tkn);
+    return expr;
+}
+
+/* ParseExpr6 - handle the '==' and '!=' operators */
+static ParseTreeNode *ParseExpr6(ParseContext *c)
+{
+    ParseTreeNode *expr, *expr2;
+    int tkn;
+    expr = ParseExpr7(c);
+    while ((tkn = GetToken(c)) == T_EQ || tkn == T_NE) {
+        int op;
+        expr2 = ParseExpr7(c);
+        switch (tkn) {
+        case T_EQ:
+            op = OP_EQ;
+            break;
+        case T_NE:
+            op = OP_NE;
+            break;
+        default:
+            /* not reached */
+            op = 0;
+            break;
+        }
+        expr = MakeBinaryOpNode(c, op, expr, expr2);
+    }
+    SaveToken(c,tkn);
+    return expr;
+}
+
+/* ParseExpr7 - handle the '<', '<=', '>=' and '>' operators */
+static ParseTreeNode *ParseExpr7(ParseContext *c)
+{
+    ParseTreeNode *expr, *expr2;
+    int tkn;
+    expr = ParseExpr8(c);
+    while ((tkn = GetToken(c)) == '<' || tkn == T_LE || tkn == T_GE || tkn == '>') {
+        int op;
+        expr2 = ParseExpr8(c);
+        switch (tkn) {
+        case '<':
+            op = OP_LT;
+            break;
+        case T_LE:
+            op = OP_LE;
+            break;
+        case T_GE:
+            op = OP_GE;
+            break;
+        case '>':
+            op = OP_GT;
+            break;
+        default:
+            /* not reached */
+            op = 0;
+            break;
+        }
+        expr = MakeBinaryOpNode(c, op, expr, expr2);
+    }
+    SaveToken(c,tkn);
+    return expr;
+}
+
+/* ParseExpr8 - handle the '<<' and '>>' operators */
+static ParseTreeNode *ParseExpr8(ParseContext *c)
+{
+    ParseTreeNode *expr, *expr2;
+    int tkn;
+    expr = ParseExpr9(c);
+    while ((tkn = GetToken(c)) == T_SHL || tkn == T_SHR) {
+        expr2 = ParseExpr9(c);
+        if (IsIntegerLit(expr) && IsIntegerLit(expr2)) {
+            switch (tkn) {
+            case T_SHL:
+                expr->u.integerLit.value = expr->u.integerLit.value << expr2->u.integerLit.value;
+                break;
+            case T_SHR:
+                expr->u.integerLit.value = expr->u.integerLit.value >> expr2->u.integerLit.value;
+                break;
+            default:
+                /* not reached */
+                break;
+            }
+        }
+        else {
+            int op;
+            switch (tkn) {
+            case T_SHL:
+                op = OP_SHL;
+                break;
+            case T_SHR:
+                op = OP_SHR;
+                break;
+            default:
+                /* not reached */
+                op = 0;
+                break;
+            }
+            expr = MakeBinaryOpNode(c, op, expr, expr2);
+        }
+    }
+    SaveToken(c,tkn);
+    return expr;
+}
+
+/* ParseExpr9 - handle the '+' and '-' operators */
+static ParseTreeNode *ParseExpr9(ParseContext *c)
+{
+    ParseTreeNode *expr, *expr2;
+    int tkn;
+    expr = ParseExpr10(c);
+    while ((tkn = GetToken(c)) == '+' || tkn == '-') {
+        expr2 = ParseExpr10(c);
+        if (IsIntegerLit(expr) && IsIntegerLit(expr2)) {
+            switch (tkn) {
+            case '+':
+                expr->u.integerLit.value = expr->u.integerLit.value + expr2->u.integerLit.value;
+                break;
+            case '-':
+                expr->u.integerLit.value = expr->u.integerLit.value - expr2->u.integerLit.value;
+                break;
+            default:
+                /* not reached */
+                break;
+            }
+        }
+        else {
+            int op;
+            switch (tkn) {
+            case '+':
+                op = OP_ADD;
+                break;
+            case '-':
+                op = OP_SUB;
+                break;
+            default:
+                /* not reached */
+                op = 0;
+                break;
+            }
+            expr = MakeBinaryOpNode(c, op, expr, expr2);
+        }
+    }
+    SaveToken(c, tkn);
+    return expr;
+}
+
+/* ParseExpr10 - handle the '*', '/' and '%' operators */
+static ParseTreeNode *ParseExpr10(ParseContext *c)
+{
+    ParseTreeNode *node, *node2;
+    int tkn;
+    node = ParseExpr11(c);
+    while ((tkn = GetToken(c)) == '*' || tkn == '/' || tkn == '%') {
+        node2 = ParseExpr11(c);
+        if (IsIntegerLit(node) && IsIntegerLit(node2)) {
+            switch (tkn) {
+            case '*':
+                node->u.integerLit.value = node->u.integerLit.value * node2->u.integerLit.value;
+                break;
+            case '/':
+                if (node2->u.integerLit.value == 0)
+                    ParseError(c, "division by zero in constant expression");
+                node->u.integerLit.value = node->u.integerLit.value / node2->u.integerLit.value;
+                break;
+            case '%':
+                if (node2->u.integerLit.value == 0)
+                    ParseError(c, "division by zero in constant expression");
+                node->u.integerLit.value = node->u.integerLit.value % node2->u.integerLit.value;
+                break;
+            default:
+                /* not reached */
+                break;
+            }
+        }
+        else {
+            int op;
+            switch (tkn) {
+            case '*':
+                op = OP_MUL;
+                break;
+            case '/':
+                op = OP_DIV;
+                break;
+            case '%':
+                op = OP_REM;
+                break;
+            default:
+                /* not reached */
+                op = 0;
+                break;
+            }
+            node = MakeBinaryOpNode(c, op, node, node2);
+        }
+    }
+    SaveToken(c, tkn);
+    return node;
+}
+
+/* ParseExpr11 - handle unary operators */
+static ParseTreeNode *ParseExpr11(ParseContext *c)
+{
+    ParseTreeNode *node;
+    int tkn;
+    switch (tkn = GetToken(c)) {
+    case '+':
+        node = ParsePrimary(c);
+        break;
+    case '-':
+        node = ParsePrimary(c);
+        if (IsIntegerLit(node))
+            node->u.integerLit.value = -node->u.integerLit.value;
+        else
+            node = MakeUnaryOpNode(c, OP_NEG, node);
+        break;
+    case '!':
+        node = ParsePrimary(c);
+        if (IsIntegerLit(node))
+            node->u.integerLit.value = !node->u.integerLit.value;
+        else
+            node = MakeUnaryOpNode(c, OP_NOT, node);
+        break;
+    case '~':
+        node = ParsePrimary(c);
+        if (IsIntegerLit(node))
+            node->u.integerLit.value = ~node->u.integerLit.value;
+        else
+            node = MakeUnaryOpNode(c, OP_BNOT, node);
+        break;
+    case T_INC:
+        node = NewParseTreeNode(c, NodeTypePreincrementOp);
+        node->u.incrementOp.increment = 1;
+        node->u.incrementOp.expr = ParsePrimary(c);
+        break;
+    case T_DEC:
+        node = NewParseTreeNode(c, NodeTypePreincrementOp);
+        node->u.incrementOp.increment = -1;
+        node->u.incrementOp.expr = ParsePrimary(c);
+        break;
+    default:
+        SaveToken(c,tkn);
+        node = ParsePrimary(c);
+        break;
+    }
+    return node;
+}
+
+/* ParsePrimary - parse function calls and array references */
+ParseTreeNode *ParsePrimary(ParseContext *c)
+{
+    ParseTreeNode *node, *node2;
+    int tkn;
+    node = ParseSimplePrimary(c);
+    while ((tkn = GetToken(c)) == '[' || tkn == '(' || tkn == T_INC || tkn == T_DEC) {
+        switch (tkn) {
+        case '[':
+            node = ParseArrayReference(c, node);
+            break;
+        case '(':
+            node = ParseCall(c, node);
+            break;
+        case T_INC:
+            node2 = NewParseTreeNode(c, NodeTypePostincrementOp);
+            node2->u.incrementOp.increment = 1;
+            node2->u.incrementOp.expr = node;
+            node = node2;
+            break;
+        case T_DEC:
+            node2 = NewParseTreeNode(c, NodeTypePostincrementOp);
+            node2->u.incrementOp.increment = -1;
+            node2->u.incrementOp.expr = node;
+            node = node2;
+            break;
+        }
+    }
+    SaveToken(c, tkn);
+    return node;
+}
+
+/* ParseArrayReference - parse an array reference */
+static ParseTreeNode *ParseArrayReference(ParseContext *c, ParseTreeNode *arrayNode)
+{
+    ParseTreeNode *node = NewParseTreeNode(c, NodeTypeArrayRef);
+
+    /* setup the array reference */
+    node->u.arrayRef.array = arrayNode;
+
+    /* get the index expression */
+    node->u.arrayRef.index = ParseExpr(c);
+
+    /* check for the close bracket */
+    FRequire(c, ']');
+    return node;
+}
+
+/* ParseCall - parse a function or subroutine call */
+static ParseTreeNode *ParseCall(ParseContext *c, ParseTreeNode *functionNode)
+{
+    ParseTreeNode *node = NewParseTreeNode(c, NodeTypeFunctionCall);
+    ExprListEntry **pLast;
+    int tkn;
+
+    /* intialize the function call node */
+    node->u.functionCall.fcn = functionNode;
+    pLast = &node->u.functionCall.args;
+
+    /* parse the argument list */
+    if ((tkn = GetToken(c)) != ')') {
+        SaveToken(c, tkn);
+        do {
+            ExprListEntry *actual;
+            actual = (ExprListEntry *)LocalAlloc(c, sizeof(ExprListEntry));
+            actual->expr = ParseExpr(c);
+            actual->next = NULL;
+            *pLast = actual;
+            pLast = &actual->next;
+            ++node->u.functionCall.argc;
+        } while ((tkn = GetToken(c)) == ',');
+        Require(c, tkn, ')');
+    }
+
+    /* return the function call node */
+    return node;
+}
+
+/* ParseSimplePrimary - parse a primary expression */
+static ParseTreeNode *ParseSimplePrimary(ParseContext *c)
+{
+    ParseTreeNode *node;
+    switch (GetToken(c)) {
+    case '(':
+        node = ParseExpr(c);
+        FRequire(c,')');
+        break;
+    case T_NUMBER:
+        node = NewParseTreeNode(c, NodeTypeIntegerLit);
+        node->u.integerLit.value = c->value;
+        break;
+    case T_STRING:
+        node = NewParseTreeNode(c, NodeTypeStringLit);
+        node->u.stringLit.string = AddString(c, c->token);
+        break;
+    case T_IDENTIFIER:
+        node = GetSymbolRef(c, c->token);
+        break;
+    default:
+        ParseError(c, "Expecting a primary expression");
+        node = NULL; /* not reached */
+        break;
+    }
+    return node;
+}
+
+/* GetSymbolRef - setup a symbol reference */
+ParseTreeNode *GetSymbolRef(ParseContext *c, char *name)
+{
+    ParseTreeNode *node = NewParseTreeNode(c, NodeTypeGlobalSymbolRef);
+    Symbol *symbol;
+
+    /* handle local variables within a function or subroutine */
+    if (c->codeType != CODE_TYPE_MAIN && (symbol = FindSymbol(&c->locals, name)) != NULL) {
+        if (IsConstant(symbol)) {
+            node->nodeType = NodeTypeIntegerLit;
+            node->u.integerLit.value = symbol->value;
+        }
+        else {
+            node->nodeType = NodeTypeLocalSymbolRef;
+            node->u.symbolRef.symbol = symbol;
+            node->u.symbolRef.offset = -symbol->value - FRAME_LINKAGE - 1;
+        }
+    }
+
+    /* handle function or subroutine arguments or the return value symbol */
+    else if (c->codeType != CODE_TYPE_MAIN && (symbol = FindSymbol(&c->arguments, name)) != NULL) {
+        node->nodeType = NodeTypeLocalSymbolRef;
+        node->u.symbolRef.offset = c->arguments.count - symbol->value - 1;
+    }
+
+    /* handle global symbols */
+    else if ((symbol = FindGlobal(c->image, c->token)) != NULL) {
+        if (IsConstant(symbol)) {
+            node->nodeType = NodeTypeIntegerLit;
+            node->u.integerLit.value = symbol->value;
+        }
+        else {
+            node->u.symbolRef.symbol = symbol;
+        }
+    }
+
+    /* handle undefined symbols */
+    else {
+        symbol = AddGlobal(c, name, SC_VARIABLE, 0);
+        node->u.symbolRef.symbol = symbol;
+    }
+
+    /* return the symbol reference node */
+    return node;
+}
+
+/* MakeUnaryOpNode - allocate a unary operation parse tree node */
+static ParseTreeNode *MakeUnaryOpNode(ParseContext *c, int op, ParseTreeNode *expr)
+{
+    ParseTreeNode *node = NewParseTreeNode(c, NodeTypeUnaryOp);
+    node->u.unaryOp.op = op;
+    node->u.unaryOp.expr = expr;
+    return node;
+}
+
+/* MakeBinaryOpNode - allocate a binary operation parse tree node */
+static ParseTreeNode *MakeBinaryOpNode(ParseContext *c, int op, ParseTreeNode *left, ParseTreeNode *right)
+{
+    ParseTreeNode *node = NewParseTreeNode(c, NodeTypeBinaryOp);
+    node->u.binaryOp.op = op;
+    node->u.binaryOp.left = left;
+    node->u.binaryOp.right = right;
+    return node;
+}
+
+/* MakeAssignmentOpNode - allocate an assignment operation parse tree node */
+static ParseTreeNode *MakeAssignmentOpNode(ParseContext *c, int op, ParseTreeNode *left, ParseTreeNode *right)
+{
+    ParseTreeNode *node = NewParseTreeNode(c, NodeTypeAssignmentOp);
+    node->u.binaryOp.op = op;
+    node->u.binaryOp.left = left;
+    node->u.binaryOp.right = right;
+    return node;
+}
+
+/* NewParseTreeNode - allocate a new parse tree node */
+static ParseTreeNode *NewParseTreeNode(ParseContext *c, int type)
+{
+    ParseTreeNode *node = (ParseTreeNode *)LocalAlloc(c, sizeof(ParseTreeNode));
+    memset(node, 0, sizeof(ParseTreeNode));
+    node->nodeType = type;
+    return node;
+}
+
+/* IsIntegerLit - check to see if a node is an integer literal */
+int IsIntegerLit(ParseTreeNode *node)
+{
+    return node->nodeType == NodeTypeIntegerLit;
+}
+
+/* IsShortLit - check for an integer literal that fits in a signed byte (optionally when negated) */
+int IsShortLit(ParseTreeNode *node, int negate)
+{
+    VMVALUE value;
+    if (node->nodeType != NodeTypeIntegerLit)
+        return VMFALSE;
+    value = negate ? -node->u.integerLit.value : node->u.integerLit.value;
+    return value >= -128 && value <= 127;
+}
@@ -1,309 +1,628 @@
-/* db_generate.c - code generation functions
- *
- * Copyright (c) 2014 by David Michael Betz.  All rights reserved.
- *
- */
-
-#include "db_compiler.h"
-
-/* local function prototypes */
-static void code_expr(ParseContext *c, ParseTreeNode *expr, PVAL *pv);
-static void code_shortcircuit(ParseContext *c, int op, ParseTreeNode *expr, PVAL *pv);
-static void code_arrayref(ParseContext *c, ParseTreeNode *expr, PVAL *pv);
-static void code_call(ParseContext *c, ParseTreeNode *expr, PVAL *pv);
-VMWORD rd_cword(ParseContext *c, VMUVALUE off);
-void wr_cword(ParseContext *c, VMUVALUE off, VMWORD v);
-static VMVALUE rd_clong(ParseContext *c, VMUVALUE off);
-static void wr_clong(ParseContext *c, VMUVALUE off, VMVALUE v);
-
-/* code_lvalue - generate code for an l-value expression */
-void code_lvalue(ParseContext *c, ParseTreeNode *expr, PVAL *pv)
-{
-    code_expr(c, expr, pv);
-    chklvalue(c, pv);
-}
-
-/* code_rvalue - generate code for an r-value expression */
-void code_rvalue(ParseContext *c, ParseTreeNode *expr)
-{
-    PVAL pv;
-    code_expr(c, expr, &pv);
-    rvalue(c, &pv);
-}
-
-/* code_expr - generate code for an expression parse tree */
-static void code_expr(ParseContext *c, ParseTreeNode *expr, PVAL *pv)
-{
-    VMVALUE ival;
-    PVAL pv2;
-    switch (expr->nodeType) {
-    case NodeTypeGlobalSymbolRef:
-        putcbyte(c, OP_LIT);
-        if (expr->u.symbolRef.symbol->storageClass == SC_HWVARIABLE)
-            putclong(c, expr->u.symbolRef.symbol->value);
-        else {
-            // the value is the first field of the symbol structure
-            putclong(c, (VMVALUE)expr->u.symbolRef.symbol);
-        }
-        *pv = VT_LVALUE;
-        break;
-    case NodeTypeLocalSymbolRef:
-        putcbyte(c, OP_LADDR);
-        putcbyte(c, expr->u.symbolRef.offset);
-        *pv = VT_LVALUE;
-        break;
-    case NodeTypeStringLit:
-        putcbyte(c, OP_LIT);
-        putclong(c, (VMVALUE)&expr->u.stringLit.string->data);
-        *pv = VT_RVALUE;
-        break;
-    case NodeTypeIntegerLit:
-        ival = expr->u.integerLit.value;
-        if (ival >= -128 && ival <= 127) {
-            putcbyte(c, OP_SLIT);
-            putcbyte(c, ival);
-        }
-        else {
-            putcbyte(c, OP_LIT);
-            putclong(c, ival);
-        }
-        *pv = VT_RVALUE;
-        break;
-    case NodeTypeFunctionLit:
-        putcbyte(c, OP_LIT);
-        putclong(c, expr->u.functionLit.offset);
-        *pv = VT_RVALUE;
-        break;
-    case NodeTypePreincrementOp:
-        code_lvalue(c, expr->u.incrementOp.expr, &pv2);
-        putcbyte(c, OP_DUP);
-        putcbyte(c, OP_LOAD);
-        putcbyte(c, OP_SLIT);
-        putcbyte(c, expr->u.incrementOp.increment);
-        putcbyte(c, OP_ADD);
-        putcbyte(c, OP_STORE);
-        *pv = VT_RVALUE;
-        break;
-    case NodeTypePostincrementOp:
-        code_lvalue(c, expr->u.incrementOp.expr, &pv2);
-        putcbyte(c, OP_DUP);
-        putcbyte(c, OP_LOAD);
-        putcbyte(c, OP_TUCK);
-        putcbyte(c, OP_SLIT);
-        putcbyte(c, expr->u.incrementOp.increment);
-        putcbyte(c, OP_ADD);
-        putcbyte(c, OP_STORE);
-        putcbyte(c, OP_DROP);
-        *pv = VT_RVALUE;
-        break;
-    case NodeTypeUnaryOp:
-        code_rvalue(c, expr->u.unaryOp.expr);
-        putcbyte(c, expr->u.unaryOp.op);
-        *pv = VT_RVALUE;
-        break;
-    case NodeTypeBinaryOp:
-        code_rvalue(c, expr->u.binaryOp.left);
-        code_rvalue(c, expr->u.binaryOp.right);
-        putcbyte(c, expr->u.binaryOp.op);
-        *pv = VT_RVALUE;
-        break;
-    case NodeTypeAssignmentOp:
-        if (expr->u.binaryOp.op == OP_EQ) {
-            code_lvalue(c, expr->u.binaryOp.left, &pv2);
-            code_rvalue(c, expr->u.binaryOp.right);
-            putcbyte(c, OP_STORE);
-        }
-        else {
-            code_lvalue(c, expr->u.binaryOp.left, &pv2);
-            putcbyte(c, OP_DUP);
-            putcbyte(c, OP_LOAD);
-            code_rvalue(c, expr->u.binaryOp.right);
-            putcbyte(c, expr->u.binaryOp.op);
-            putcbyte(c, OP_STORE);
-        }
-        *pv = VT_RVALUE;
-        break;
-    case NodeTypeArrayRef:
-        code_arrayref(c, expr, pv);
-        break;
-    case NodeTypeFunctionCall:
-        code_call(c, expr, pv);
-        break;
-    case NodeTypeDisjunction:
-        code_shortcircuit(c, OP_BRTSC, expr, pv);
-        break;
-    case NodeTypeConjunction:
-        code_shortcircuit(c, OP_BRFSC, expr, pv);
-        break;
-    }
-}
-
-/* code_shortcircuit - generate code for a conjunction or disjunction of boolean expressions */
-static void code_shortcircuit(ParseContext *c, int op, ParseTreeNode *expr, PVAL *pv)
-{
-    ExprListEntry *entry = expr->u.exprList.exprs;
-    int end = 0;
-
-    code_rvalue(c, entry->expr);
-    entry = entry->next;
-
-    do {
-        putcbyte(c, op);
-        end = putcword(c, end);
-        code_rvalue(c, entry->expr);
-    } while ((entry = entry->next) != NULL);
-
-    fixupbranch(c, end, codeaddr(c));
-
-    *pv = VT_RVALUE;
-}
-
-/* code_arrayref - code an array reference */
-static void code_arrayref(ParseContext *c, ParseTreeNode *expr, PVAL *pv)
-{
-    /* code the array reference */
-    code_rvalue(c, expr->u.arrayRef.array);
-
-    /* code the index */
-    code_rvalue(c, expr->u.arrayRef.index);
-
-    /* code the index operation */
-    putcbyte(c, OP_INDEX);
-
-    *pv = VT_LVALUE;
-}
-
-/* code_call - code a function call */
-static void code_call(ParseContext *c, ParseTreeNode *expr, PVAL *pv)
-{
-    ExprListEntry *arg;
-
-    /* code each argument expression */
-    for (arg = expr->u.functionCall.args; arg != NULL; arg = arg->next)
-        code_rvalue(c, arg->expr);
-
-    /* call the function */
-    code_rvalue(c, expr->u.functionCall.fcn);
-    putcbyte(c, OP_CALL);
-    putcbyte(c, expr->u.functionCall.argc);
-
-    /* we've got an rvalue now */
-    *pv = VT_RVALUE;
-}
-
-/* rvalue - get the rvalue of a partial expression */
-void rvalue(ParseContext *c, PVAL *pv)
-{
-    if (*pv == VT_LVALUE) {
-        putcbyte(c, OP_LOAD);
-        *pv = VT_RVALUE;
-    }
-}
-
-/* chklvalue - make sure we've got an lvalue */
-void chklvalue(ParseContext *c, PVAL *pv)
-{
-    if (*pv == VT_RVALUE)
-        ParseError(c,"expecting an lvalue");
-}
-
-/* codeaddr - get the current code address (actually, offset) */
-int codeaddr(ParseContext *c)
-{
-    return (int)(c->image->codeFree - c->image->codeBuf);
-}
-
-/* putcbyte - put a code byte into the code buffer */
-int putcbyte(ParseContext *c, int b)
-{
-    int addr = codeaddr(c);
-    if (c->image->codeFree >= c->image->heapFree)
-        Abort(c->sys, "insufficient memory");
-    *c->image->codeFree++ = b;
-    return addr;
-}
-
-/* putcword - put a code word into the code buffer */
-int putcword(ParseContext *c, VMWORD v)
-{
-    int addr = codeaddr(c);
-    if (c->image->codeFree + sizeof(VMWORD) > c->image->heapFree)
-        Abort(c->sys, "insufficient memory");
-    wr_cword(c, c->image->codeFree - c->image->codeBuf, v);
-    c->image->codeFree += sizeof(VMWORD);
-    return addr;
-}
-
-/* rd_cword - get a code word from the code buffer */
-VMWORD rd_cword(ParseContext *c, VMUVALUE off)
-{
-    int cnt = sizeof(VMWORD);
-    VMWORD v = 0;
-    while (--cnt >= 0)
-        v = (v << 8) | c->image->codeBuf[off++];
-    return v;
-}
-
-/* wr_cword - put a code word into the code buffer */
-void wr_cword(ParseContext *c, VMUVALUE off, VMWORD v)
-{
-    uint8_t *p = &c->image->codeBuf[off] + sizeof(VMWORD);
-    int cnt = sizeof(VMWORD);
-    while (--cnt >= 0) {
-        *--p = v;
-        v >>= 8;
-    }
-}
-
-/* fixupbranch - fixup a branch reference chain */
-void fixupbranch(ParseContext *c, VMUVALUE chn, VMUVALUE val)
-{
-    while (chn != 0) {
-        int nxt = rd_cword(c, chn);
-        VMWORD off = val - (chn + sizeof(VMWORD)); /* this assumes all 1+sizeof(VMWORD) byte branch instructions */
-        wr_cword(c, chn, off);
-        chn = nxt;
-    }
-}
-
-/* putclong - put a code word into the code buffer */
-int putclong(ParseContext *c, VMVALUE v)
-{
-    int addr = codeaddr(c);
-    if (c->image->codeFree + sizeof(VMVALUE) > c->image->heapFree)
-        Abort(c->sys, "insufficient memory");
-    wr_clong(c, c->image->codeFree - c->image->codeBuf, v);
-    c->image->codeFree += sizeof(VMVALUE);
-    return addr;
-}
-
-/* rd_clong - get a code word from the code buffer */
-VMVALUE rd_clong(ParseContext *c, VMUVALUE off)
-{
-    int cnt = sizeof(VMVALUE);
-    VMVALUE v = 0;
-    while (--cnt >= 0)
-        v = (v << 8) | c->image->codeBuf[off++];
-    return v;
-}
-
-/* wr_clong - put a code word into the code buffer */
-void wr_clong(ParseContext *c, VMUVALUE off, VMVALUE v)
-{
-    uint8_t *p = &c->image->codeBuf[off] + sizeof(VMVALUE);
-    int cnt = sizeof(VMVALUE);
-    while (--cnt >= 0) {
-        *--p = v;
-        v >>= 8;
-    }
-}
-
-/* fixup - fixup a reference chain */
-void fixup(ParseContext *c, VMUVALUE chn, VMUVALUE val)
-{
-    while (chn != 0) {
-        int nxt = rd_clong(c, chn);
-        wr_clong(c, chn, val);
-        chn = nxt;
-    }
-}
+/* db_generate.c - code generation functions
+ *
+ * Copyright (c) 2014 by David Michael Betz.  All rights reserved.
+ *
+ */
+
+#include "db_compiler.h"
+
+/* local function prototypes */
+#ifndef USE_REGISTER_CODE
+static void code_expr(ParseContext *c, ParseTreeNode *expr, PVAL *pv);
+static void code_shortcircuit(ParseContext *c, int op, ParseTreeNode *expr, PVAL *pv);
+static void code_arrayref(ParseContext *c, ParseTreeNode *expr, PVAL *pv);
+static void code_call(ParseContext *c, ParseTreeNode *expr, PVAL *pv);
+static void code_increment(ParseContext *c, int increment);
+#endif
+VMWORD rd_cword(ParseContext *c, VMUVALUE off);
+void wr_cword(ParseContext *c, VMUVALUE off, VMWORD v);
+static VMVALUE rd_clong(ParseContext *c, VMUVALUE off);
+static void wr_clong(ParseContext *c, VMUVALUE off, VMVALUE v);
+
+/* the register code generator in db_genreg.c replaces the stack code generator */
+#ifndef USE_REGISTER_CODE
+
+/* code_lvalue - generate code for an l-value expression */
+void code_lvalue(ParseContext *c, ParseTreeNode *expr, PVAL *pv)
+{
+    code_expr(c, expr, pv);
+    chklvalue(c, pv);
+}
+
+/* code_rvalue - generate code for an r-value expression */
+void code_rvalue(ParseContext *c, ParseTreeNode *expr)
+{
+    PVAL pv;
+#ifdef USE_SUPERINSTRUCTIONS
+    switch (expr->nodeType) {
+    case NodeTypeGlobalSymbolRef:
+        putcbyte(c, OP_GLOAD);
+        putclong(c, GlobalAddress(c, expr->u.symbolRef.symbol));
+        return;
+    case NodeTypeLocalSymbolRef:
+        putcbyte(c, OP_LLOAD);
+        putcbyte(c, expr->u.symbolRef.offset);
+        return;
+    default:
+        break;
+    }
+#endif
+    code_expr(c, expr, &pv);
+    rvalue(c, &pv);
+}
+
+/* code_void - generate code for an expression evaluated only for its side effects */
+void code_void(ParseContext *c, ParseTreeNode *expr)
+{
+    code_rvalue(c, expr);
+    putcbyte(c, OP_DROP);
+}
+
+/* code_branch - generate code for a test expression and a conditional branch opcode */
+void code_branch(ParseContext *c, ParseTreeNode *expr, int op)
+{
+#ifdef USE_SUPERINSTRUCTIONS
+    /* compare-and-branch opcodes indexed by comparison (OP_LT to OP_GT) */
+    static int brtops[] = { OP_BRLT, OP_BRLE, OP_BREQ, OP_BRNE, OP_BRGE, OP_BRGT };
+    static int brfops[] = { OP_BRGE, OP_BRGT, OP_BRNE, OP_BREQ, OP_BRLT, OP_BRLE };
+    if (expr->nodeType == NodeTypeBinaryOp
+    &&  expr->u.binaryOp.op >= OP_LT && expr->u.binaryOp.op <= OP_GT) {
+        int index = expr->u.binaryOp.op - OP_LT;
+        code_rvalue(c, expr->u.binaryOp.left);
+        code_rvalue(c, expr->u.binaryOp.right);
+        putcbyte(c, op == OP_BRT ? brtops[index] : brfops[index]);
+        return;
+    }
+#endif
+    code_rvalue(c, expr);
+    putcbyte(c, op);
+}
+
+/* code_expr - generate code for an expression parse tree */
+static void code_expr(ParseContext *c, ParseTreeNode *expr, PVAL *pv)
+{
+    VMVALUE ival;
+    PVAL pv2;
+    switch (expr->nodeType) {
+    case NodeTypeGlobalSymbolRef:
+        putcbyte(c, IsGlobalCell(expr->u.symbolRef.symbol) ? OP_GADDR : OP_LIT);
+        putclong(c, GlobalAddress(c, expr->u.symbolRef.symbol));
+        *pv = VT_LVALUE;
+        break;
+    case NodeTypeLocalSymbolRef:
+        putcbyte(c, OP_LADDR);
+        putcbyte(c, expr->u.symbolRef.offset);
+        *pv = VT_LVALUE;
+        break;
+    case NodeTypeStringLit:
+        putcbyte(c, OP_LIT);
+        putclong(c, VMADDR(c->image, expr->u.stringLit.string->data));
+        *pv = VT_RVALUE;
+        break;
+    case NodeTypeIntegerLit:
+        ival = expr->u.integerLit.value;
+        if (ival >= -128 && ival <= 127) {
+            putcbyte(c, OP_SLIT);
+            putcbyte(c, ival);
+        }
+        else {
+            putcbyte(c, OP_LIT);
+            putclong(c, ival);
+        }
+        *pv = VT_RVALUE;
+        break;
+    case NodeTypeFunctionLit:
+        putcbyte(c, OP_LIT);
+        putclong(c, expr->u.functionLit.offset);
+        *pv = VT_RVALUE;
+        break;
+    case NodeTypePreincrementOp:
+        code_lvalue(c, expr->u.incrementOp.expr, &pv2);
+        putcbyte(c, OP_DUP);
+        putcbyte(c, OP_LOAD);
+        code_increment(c, expr->u.incrementOp.increment);
+        putcbyte(c, OP_STORE);
+        *pv = VT_RVALUE;
+        break;
+    case NodeTypePostincrementOp:
+        code_lvalue(c, expr->u.incrementOp.expr, &pv2);
+        putcbyte(c, OP_DUP);
+        putcbyte(c, OP_LOAD);
+        putcbyte(c, OP_TUCK);
+        code_increment(c, expr->u.incrementOp.increment);
+        putcbyte(c, OP_STORE);
+        putcbyte(c, OP_DROP);
+        *pv = VT_RVALUE;
+        break;
+    case NodeTypeUnaryOp:
+        code_rvalue(c, expr->u.unaryOp.expr);
+        putcbyte(c, expr->u.unaryOp.op);
+        *pv = VT_RVALUE;
+        break;
+    case NodeTypeBinaryOp:
+#ifdef USE_SUPERINSTRUCTIONS
+        if (expr->u.binaryOp.op == OP_ADD && IsShortLit(expr->u.binaryOp.right, VMFALSE)) {
+            code_rvalue(c, expr->u.binaryOp.left);
+            putcbyte(c, OP_ADDI);
+            putcbyte(c, expr->u.binaryOp.right->u.integerLit.value);
+            *pv = VT_RVALUE;
+            break;
+        }
+        else if (expr->u.binaryOp.op == OP_ADD && IsShortLit(expr->u.binaryOp.left, VMFALSE)) {
+            code_rvalue(c, expr->u.binaryOp.right);
+            putcbyte(c, OP_ADDI);
+            putcbyte(c, expr->u.binaryOp.left->u.integerLit.value);
+            *pv = VT_RVALUE;
+            break;
+        }
+        else if (expr->u.binaryOp.op == OP_SUB && IsShortLit(expr->u.binaryOp.right, VMTRUE)) {
+            code_rvalue(c, expr->u.binaryOp.left);
+            putcbyte(c, OP_ADDI);
+            putcbyte(c, -expr->u.binaryOp.right->u.integerLit.value);
+            *pv = VT_RVALUE;
+            break;
+        }
+#endif
+        code_rvalue(c, expr->u.binaryOp.left);
+        code_rvalue(c, expr->u.binaryOp.right);
+        putcbyte(c, expr->u.binaryOp.op);
+        *pv = VT_RVALUE;
+        break;
+    case NodeTypeAssignmentOp:
+#ifdef USE_SUPERINSTRUCTIONS
+        if (expr->u.binaryOp.op == OP_EQ && expr->u.binaryOp.left->nodeType == NodeTypeLocalSymbolRef) {
+            code_rvalue(c, expr->u.binaryOp.right);
+            putcbyte(c, OP_LSTORE);
+            putcbyte(c, expr->u.binaryOp.left->u.symbolRef.offset);
+        }
+        else if (expr->u.binaryOp.op == OP_EQ && expr->u.binaryOp.left->nodeType == NodeTypeGlobalSymbolRef) {
+            code_rvalue(c, expr->u.binaryOp.right);
+            putcbyte(c, OP_GSTORE);
+            putclong(c, GlobalAddress(c, expr->u.binaryOp.left->u.symbolRef.symbol));
+        }
+        else
+#endif
+        if (expr->u.binaryOp.op == OP_EQ) {
+            code_lvalue(c, expr->u.binaryOp.left, &pv2);
+            code_rvalue(c, expr->u.binaryOp.right);
+            putcbyte(c, OP_STORE);
+        }
+        else {
+            code_lvalue(c, expr->u.binaryOp.left, &pv2);
+            putcbyte(c, OP_DUP);
+            putcbyte(c, OP_LOAD);
+            code_rvalue(c, expr->u.binaryOp.right);
+            putcbyte(c, expr->u.binaryOp.op);
+            putcbyte(c, OP_STORE);
+        }
+        *pv = VT_RVALUE;
+        break;
+    case NodeTypeArrayRef:
+        code_arrayref(c, expr, pv);
+        break;
+    case NodeTypeFunctionCall:
+        code_call(c, expr, pv);
+        break;
+    case NodeTypeDisjunction:
+        code_shortcircuit(c, OP_BRTSC, expr, pv);
+        break;
+    case NodeTypeConjunction:
+        code_shortcircuit(c, OP_BRFSC, expr, pv);
+        break;
+    }
+}
+
+/* code_shortcircuit - generate code for a conjunction or disjunction of boolean expressions */
+static void code_shortcircuit(ParseContext *c, int op, ParseTreeNode *expr, PVAL *pv)
+{
+    ExprListEntry *entry = expr->u.exprList.exprs;
+    int end = 0;
+
+    code_rvalue(c, entry->expr);
+    entry = entry->next;
+
+    do {
+        putcbyte(c, op);
+        end = putcword(c, end);
+        code_rvalue(c, entry->expr);
+    } while ((entry = entry->next) != NULL);
+
+    fixupbranch(c, end, codeaddr(c));
+
+    *pv = VT_RVALUE;
+}
+
+/* code_increment - code an increment of the value on the top of the stack */
+static void code_increment(ParseContext *c, int increment)
+{
+#ifdef USE_SUPERINSTRUCTIONS
+    putcbyte(c, OP_ADDI);
+    putcbyte(c, increment);
+#else
+    putcbyte(c, OP_SLIT);
+    putcbyte(c, increment);
+    putcbyte(c, OP_ADD);
+#endif
+}
+
+#endif
+
+#ifdef USE_STACK_DEPTH
+
+/* offset of an n byte operand stored at or after offset off */
+#define OperandOffset(off, n)   ((int)(VMOPERAND(code + (off), n) - code))
+
+/* code_stackdepth - find the maximum operand stack depth reached by the code under construction */
+int code_stackdepth(ParseContext *c)
+{
+    uint8_t *code = c->image->codeBuf;
+    int size = codeaddr(c);
+    uint8_t *depths = (uint8_t *)LocalAlloc(c, size);
+    int lc, op, len, depth, delta, target, targetDelta, next, changed, i;
+    int maxDepth = 0;
+
+    /* only the first instruction has been reached (depths are stored plus one) */
+    memset(depths, 0, size);
+    depths[0] = 1;
+
+    /* pass over the code propagating stack depths until nothing changes */
+    do {
+        changed = VMFALSE;
+        for (lc = 0; lc < size; lc += len) {
+            target = -1;
+            delta = targetDelta = 0;
+            switch (op = code[lc]) {
+            case OP_HALT:
+            case OP_RETURN:
+                len = 1;
+                break;
+            case OP_BR:
+            case OP_BRT:
+            case OP_BRTSC:
+            case OP_BRF:
+            case OP_BRFSC:
+            case OP_BRLT:
+            case OP_BRLE:
+            case OP_BREQ:
+            case OP_BRNE:
+            case OP_BRGE:
+            case OP_BRGT:
+                len = OperandOffset(lc + 1, sizeof(VMWORD)) + sizeof(VMWORD) - lc;
+                target = lc + len + rd_cword(c, lc + len - sizeof(VMWORD));
+                switch (op) {
+                case OP_BR:
+                    break;
+                case OP_BRTSC:
+                case OP_BRFSC:
+                    delta = -1;     /* the value is only dropped when the branch isn't taken */
+                    break;
+                case OP_BRT:
+                case OP_BRF:
+                    delta = targetDelta = -1;
+                    break;
+                default:
+                    delta = targetDelta = -2;
+                    break;
+                }
+                break;
+            case OP_LIT:
+            case OP_GADDR:
+            case OP_GLOAD:
+                len = OperandOffset(lc + 1, sizeof(VMVALUE)) + sizeof(VMVALUE) - lc;
+                delta = 1;
+                break;
+            case OP_NATIVE:
+            case OP_GSTORE:
+                len = OperandOffset(lc + 1, sizeof(VMVALUE)) + sizeof(VMVALUE) - lc;
+                break;
+            case OP_SLIT:
+            case OP_LADDR:
+            case OP_LLOAD:
+                len = 2;
+                delta = 1;
+                break;
+            case OP_LSTORE:
+            case OP_ADDI:
+                len = 2;
+                break;
+            case OP_CALL:
+                len = 2;
+                delta = -code[lc + 1];  /* the arguments and the function are replaced by the result */
+                break;
+            case OP_FRAME:
+                len = 3;
+                break;
+#ifdef USE_REGISTER_CODE
+            case OP_RBRLT:
+            case OP_RBRLE:
+            case OP_RBREQ:
+            case OP_RBRNE:
+            case OP_RBRGE:
+            case OP_RBRGT:
+                len = OperandOffset(lc + 3, sizeof(VMWORD)) + sizeof(VMWORD) - lc;
+                target = lc + len + rd_cword(c, lc + len - sizeof(VMWORD));
+                break;
+            case OP_RBRT:
+            case OP_RBRF:
+                len = OperandOffset(lc + 2, sizeof(VMWORD)) + sizeof(VMWORD) - lc;
+                target = lc + len + rd_cword(c, lc + len - sizeof(VMWORD));
+                break;
+            case OP_RLIT:
+            case OP_RGLOAD:
+            case OP_RGSTORE:
+                len = OperandOffset(lc + 2, sizeof(VMVALUE)) + sizeof(VMVALUE) - lc;
+                break;
+            case OP_RPUSH:
+                len = 2;
+                delta = 1;
+                break;
+            case OP_RPOP:
+                len = 2;
+                delta = -1;
+                break;
+            case OP_RNOT:
+            case OP_RNEG:
+            case OP_RBNOT:
+            case OP_RMOV:
+            case OP_RLOAD:
+            case OP_RSTORE:
+            case OP_RSLIT:
+                len = 3;
+                break;
+            case OP_RADD:
+            case OP_RSUB:
+            case OP_RMUL:
+            case OP_RDIV:
+            case OP_RREM:
+            case OP_RBAND:
+            case OP_RBOR:
+            case OP_RBXOR:
+            case OP_RSHL:
+            case OP_RSHR:
+            case OP_RLT:
+            case OP_RLE:
+            case OP_REQ:
+            case OP_RNE:
+            case OP_RGE:
+            case OP_RGT:
+            case OP_RINDEX:
+            case OP_RADDI:
+                len = 4;
+                break;
+#endif
+            case OP_TRAP:
+                len = 2;
+                switch (code[lc + 1]) {
+                case TRAP_GetChar:
+                    delta = 1;
+                    break;
+                case TRAP_PutChar:
+                case TRAP_PrintStr:
+                case TRAP_PrintInt:
+                    delta = -1;
+                    break;
+                }
+                break;
+            case OP_DUP:
+            case OP_TUCK:
+                len = 1;
+                delta = 1;
+                break;
+            case OP_NOT:
+            case OP_NEG:
+            case OP_BNOT:
+            case OP_LOAD:
+            case OP_LOADB:
+                len = 1;
+                break;
+            default:
+                /* the binary operators, STORE, STOREB, INDEX and DROP */
+                len = 1;
+                delta = -1;
+                break;
+            }
+
+            /* skip instructions that haven't been reached yet */
+            if (!depths[lc])
+                continue;
+            depth = depths[lc] - 1;
+
+            /* the next instruction and the branch target are reached with the new depth */
+            for (i = 0; i < 2; ++i) {
+                if (i == 0) {
+                    if (op == OP_HALT || op == OP_RETURN || op == OP_BR)
+                        continue;
+                    next = lc + len;
+                }
+                else {
+                    if (target < 0)
+                        continue;
+                    next = target;
+                    delta = targetDelta;
+                }
+                if (next < 0 || next >= size)
+                    ParseError(c, "branch outside of function");
+                if (depth + delta + 1 > depths[next]) {
+                    if (depth + delta >= 255)
+                        ParseError(c, "expression too complex");
+                    depths[next] = depth + delta + 1;
+                    if (depth + delta > maxDepth)
+                        maxDepth = depth + delta;
+                    changed = VMTRUE;
+                }
+            }
+        }
+    } while (changed);
+
+    /* return the maximum depth */
+    return maxDepth;
+}
+
+#endif
+
+#ifndef USE_REGISTER_CODE
+
+/* code_arrayref - code an array reference */
+static void code_arrayref(ParseContext *c, ParseTreeNode *expr, PVAL *pv)
+{
+    /* code the array reference */
+    code_rvalue(c, expr->u.arrayRef.array);
+
+    /* code the index */
+    code_rvalue(c, expr->u.arrayRef.index);
+
+    /* code the index operation */
+    putcbyte(c, OP_INDEX);
+
+    *pv = VT_LVALUE;
+}
+
+/* code_call - code a function call */
+static void code_call(ParseContext *c, ParseTreeNode *expr, PVAL *pv)
+{
+    ExprListEntry *arg;
+
+    /* code each argument expression */
+    for (arg = expr->u.functionCall.args; arg != NULL; arg = arg->next)
+        code_rvalue(c, arg->expr);
+
+    /* call the function */
+    code_rvalue(c, expr->u.functionCall.fcn);
+    putcbyte(c, OP_CALL);
+    putcbyte(c, expr->u.functionCall.argc);
+
+    /* we've got an rvalue now */
+    *pv = VT_RVALUE;
+}
+
+/* rvalue - get the rvalue of a partial expression */
+void rvalue(ParseContext *c, PVAL *pv)
+{
+    if (*pv == VT_LVALUE) {
+        putcbyte(c, OP_LOAD);
+        *pv = VT_RVALUE;
+    }
+}
+
+/* chklvalue - make sure we've got an lvalue */
+void chklvalue(ParseContext *c, PVAL *pv)
+{
+    if (*pv == VT_RVALUE)
+        ParseError(c,"expecting an lvalue");
+}
+
+#endif
+
+/* GlobalAddress - get the operand that addresses a global variable
+
+   Variables are addressed relative to the global segment of the interpreter
+   running the code.  Hardware registers are addressed directly. */
+VMVALUE GlobalAddress(ParseContext *c, Symbol *symbol)
+{
+    if (!IsGlobalCell(symbol))
+        return symbol->value;
+    return VMADDR(c->image->data, GlobalCell(c->image->data, symbol));
+}
+
+/* codeaddr - get the current code address (actually, offset) */
+int codeaddr(ParseContext *c)
+{
+    return (int)(c->image->codeFree - c->image->codeBuf);
+}
+
+/* putcbyte - put a code byte into the code buffer */
+int putcbyte(ParseContext *c, int b)
+{
+    int addr = codeaddr(c);
+    if (c->image->codeFree >= c->image->heapFree)
+        Abort(c->sys, "insufficient memory");
+    *c->image->codeFree++ = b;
+    return addr;
+}
+
+/* putcalign - pad the code buffer to the alignment of an operand of the given size */
+void putcalign(ParseContext *c, int size)
+{
+    while (c->image->codeFree != VMOPERAND(c->image->codeFree, size))
+        putcbyte(c, 0);
+}
+
+/* putcword - put a code word into the code buffer */
+int putcword(ParseContext *c, VMWORD v)
+{
+    int addr;
+    putcalign(c, sizeof(VMWORD));
+    addr = codeaddr(c);
+    if (c->image->codeFree + sizeof(VMWORD) > c->image->heapFree)
+        Abort(c->sys, "insufficient memory");
+    wr_cword(c, c->image->codeFree - c->image->codeBuf, v);
+    c->image->codeFree += sizeof(VMWORD);
+    return addr;
+}
+
+/* putcbranch - put the offset to a branch target into the code buffer */
+int putcbranch(ParseContext *c, int target)
+{
+    putcalign(c, sizeof(VMWORD));
+    return putcword(c, target - codeaddr(c) - sizeof(VMWORD));
+}
+
+/* rd_cword - get a code word from the code buffer */
+VMWORD rd_cword(ParseContext *c, VMUVALUE off)
+{
+    return VMCODEWORD(&c->image->codeBuf[off]);
+}
+
+/* wr_cword - put a code word into the code buffer */
+void wr_cword(ParseContext *c, VMUVALUE off, VMWORD v)
+{
+    uint8_t *p = &c->image->codeBuf[off];
+    VMSETCODEWORD(p, v);
+}
+
+/* fixupbranch - fixup a branch reference chain */
+void fixupbranch(ParseContext *c, VMUVALUE chn, VMUVALUE val)
+{
+    while (chn != 0) {
+        int nxt = rd_cword(c, chn);
+        VMWORD off = val - (chn + sizeof(VMWORD)); /* offsets are relative to the end of the operand */
+        wr_cword(c, chn, off);
+        chn = nxt;
+    }
+}
+
+/* putclong - put a code word into the code buffer */
+int putclong(ParseContext *c, VMVALUE v)
+{
+    int addr;
+    putcalign(c, sizeof(VMVALUE));
+    addr = codeaddr(c);
+    if (c->image->codeFree + sizeof(VMVALUE) > c->image->heapFree)
+        Abort(c->sys, "insufficient memory");
+    wr_clong(c, c->image->codeFree - c->image->codeBuf, v);
+    c->image->codeFree += sizeof(VMVALUE);
+    return addr;
+}
+
+/* rd_clong - get a code word from the code buffer */
+VMVALUE rd_clong(ParseContext *c, VMUVALUE off)
+{
+    return VMCODELONG(&c->image->codeBuf[off]);
+}
+
+/* wr_clong - put a code word into the code buffer */
+void wr_clong(ParseContext *c, VMUVALUE off, VMVALUE v)
+{
+    uint8_t *p = &c->image->codeBuf[off];
+    VMSETCODELONG(p, v);
+}
+
+/* fixup - fixup a reference chain */
+void fixup(ParseContext *c, VMUVALUE chn, VMUVALUE val)
+{
+    while (chn != 0) {
+        int nxt = rd_clong(c, chn);
+        wr_clong(c, chn, val);
+        chn = nxt;
+    }
+}
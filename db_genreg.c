@@ -0,0 +1,517 @@
+/* db_genreg.c - register code generation functions
+ *
+ * Copyright (c) 2014 by David Michael Betz.  All rights reserved.
+ *
+ */
+
+#include "db_compiler.h"
+
+#ifdef USE_REGISTER_CODE
+
+/* the main code needs the frame that is added along with its stack depth */
+#ifndef USE_STACK_DEPTH
+#error USE_REGISTER_CODE requires USE_STACK_DEPTH
+#endif
+
+/* Registers are frame slots. Arguments and local variables are addressed by
+   their frame offsets. Temporary registers are numbered from REG_TEMP until
+   code_temps places them after the local variables at the end of the function.
+   The remaining values are used to tell code_expr where its result should go. */
+#define REG_TEMP        0x100   /* first temporary register */
+#define REG_ANY         0x1000  /* any register */
+#define REG_NONE        0x1001  /* the result isn't needed */
+#define REG_STACK       0x1002  /* push the result onto the stack */
+
+#define IsTemp(r)       ((r) >= REG_TEMP && (r) < REG_ANY)
+#define IsReg(r)        ((r) < REG_ANY)
+
+/* local function prototypes */
+static int code_expr(ParseContext *c, ParseTreeNode *expr, int dst);
+static void code_into(ParseContext *c, ParseTreeNode *expr, int dst);
+static int code_operand(ParseContext *c, ParseTreeNode *expr, ParseTreeNode *next);
+static int code_assignment(ParseContext *c, ParseTreeNode *expr, int dst);
+static int code_increment(ParseContext *c, ParseTreeNode *expr, int dst, int post);
+static int code_shortcircuit(ParseContext *c, int op, ParseTreeNode *expr, int dst);
+static int code_arrayaddr(ParseContext *c, ParseTreeNode *expr);
+static int code_call(ParseContext *c, ParseTreeNode *expr, int dst);
+static void code_op1(ParseContext *c, int op, int r);
+static void code_op2(ParseContext *c, int op, int d, int a);
+static void code_op3(ParseContext *c, int op, int d, int a, int b);
+static void code_oplong(ParseContext *c, int op, int r, VMVALUE v);
+static int ModifiesLocals(ParseTreeNode *expr);
+static int NewTemp(ParseContext *c);
+static int Target(ParseContext *c, int dst);
+static void putcreg(ParseContext *c, int reg);
+
+/* code_rvalue - generate code for an r-value expression leaving its value on the stack */
+void code_rvalue(ParseContext *c, ParseTreeNode *expr)
+{
+    int mark = c->tempCount;
+    int r;
+    switch (expr->nodeType) {
+    case NodeTypeGlobalSymbolRef:
+        putcbyte(c, OP_GLOAD);
+        putclong(c, GlobalAddress(c, expr->u.symbolRef.symbol));
+        break;
+    case NodeTypeIntegerLit:
+        if (IsShortLit(expr, VMFALSE)) {
+            putcbyte(c, OP_SLIT);
+            putcbyte(c, expr->u.integerLit.value);
+        }
+        else {
+            putcbyte(c, OP_LIT);
+            putclong(c, expr->u.integerLit.value);
+        }
+        break;
+    case NodeTypeFunctionCall:
+        code_call(c, expr, REG_STACK);
+        break;
+    default:
+        r = code_expr(c, expr, REG_ANY);
+        code_op1(c, OP_RPUSH, r);
+        break;
+    }
+    c->tempCount = mark;
+}
+
+/* code_void - generate code for an expression evaluated only for its side effects */
+void code_void(ParseContext *c, ParseTreeNode *expr)
+{
+    int mark = c->tempCount;
+    code_expr(c, expr, REG_NONE);
+    c->tempCount = mark;
+}
+
+/* code_branch - generate code for a test expression and a conditional branch opcode */
+void code_branch(ParseContext *c, ParseTreeNode *expr, int op)
+{
+    /* branch on false opcodes indexed by comparison (OP_LT to OP_GT) */
+    static int brfops[] = { OP_RBRGE, OP_RBRGT, OP_RBRNE, OP_RBREQ, OP_RBRLT, OP_RBRLE };
+    int mark = c->tempCount;
+    int a, b;
+
+    /* branch on the operand of a logical not with the opposite sense */
+    if (expr->nodeType == NodeTypeUnaryOp && expr->u.unaryOp.op == OP_NOT)
+        code_branch(c, expr->u.unaryOp.expr, op == OP_BRT ? OP_BRF : OP_BRT);
+
+    /* compare two registers and branch */
+    else if (expr->nodeType == NodeTypeBinaryOp
+         &&  expr->u.binaryOp.op >= OP_LT && expr->u.binaryOp.op <= OP_GT) {
+        int index = expr->u.binaryOp.op - OP_LT;
+        a = code_operand(c, expr->u.binaryOp.left, expr->u.binaryOp.right);
+        b = code_expr(c, expr->u.binaryOp.right, REG_ANY);
+        code_op2(c, op == OP_BRT ? OP_RBRLT + index : brfops[index], a, b);
+    }
+
+    /* test a register and branch */
+    else {
+        a = code_expr(c, expr, REG_ANY);
+        code_op1(c, op == OP_BRT ? OP_RBRT : OP_RBRF, a);
+    }
+
+    c->tempCount = mark;
+}
+
+/* code_temps - place the temporary registers after the local variables and return how many there are */
+int code_temps(ParseContext *c)
+{
+    int base = FRAME_LINKAGE + 1 + c->localOffset;
+    int temps = c->maxTemps;
+    TempRef *ref;
+
+    /* make sure all of the registers can be addressed by a signed byte offset */
+    if (base + temps > 128)
+        ParseError(c, "too many local variables");
+
+    /* convert the temporary register numbers to frame offsets */
+    for (ref = c->tempRefs; ref != NULL; ref = ref->next)
+        c->image->codeBuf[ref->offset] = -(base + c->image->codeBuf[ref->offset]);
+
+    /* reset for the next function */
+    c->tempRefs = NULL;
+    c->tempCount = c->maxTemps = 0;
+
+    /* return the number of temporary registers */
+    return temps;
+}
+
+/* code_expr - generate code for an expression parse tree and return the register holding its value
+
+   The destination is only a suggestion and is never written before the
+   last instruction of the expression so it can also be one of its operands. */
+static int code_expr(ParseContext *c, ParseTreeNode *expr, int dst)
+{
+    ParseTreeNode *left, *right;
+    int mark = c->tempCount;
+    int d = REG_NONE, a, b;
+    VMVALUE ival;
+    switch (expr->nodeType) {
+    case NodeTypeGlobalSymbolRef:
+        d = Target(c, dst);
+        code_oplong(c, OP_RGLOAD, d, GlobalAddress(c, expr->u.symbolRef.symbol));
+        break;
+    case NodeTypeLocalSymbolRef:
+        d = expr->u.symbolRef.offset;
+        break;
+    case NodeTypeStringLit:
+        d = Target(c, dst);
+        code_oplong(c, OP_RLIT, d, VMADDR(c->image, expr->u.stringLit.string->data));
+        break;
+    case NodeTypeIntegerLit:
+        d = Target(c, dst);
+        if (IsShortLit(expr, VMFALSE)) {
+            code_op1(c, OP_RSLIT, d);
+            putcbyte(c, expr->u.integerLit.value);
+        }
+        else
+            code_oplong(c, OP_RLIT, d, expr->u.integerLit.value);
+        break;
+    case NodeTypeFunctionLit:
+        d = Target(c, dst);
+        code_oplong(c, OP_RLIT, d, expr->u.functionLit.offset);
+        break;
+    case NodeTypePreincrementOp:
+        d = code_increment(c, expr, dst, VMFALSE);
+        break;
+    case NodeTypePostincrementOp:
+        d = code_increment(c, expr, dst, VMTRUE);
+        break;
+    case NodeTypeUnaryOp:
+        a = code_expr(c, expr->u.unaryOp.expr, REG_ANY);
+        c->tempCount = mark;
+        d = Target(c, dst);
+        code_op2(c, OP_RNOT + expr->u.unaryOp.op - OP_NOT, d, a);
+        break;
+    case NodeTypeBinaryOp:
+        left = expr->u.binaryOp.left;
+        right = expr->u.binaryOp.right;
+        if (expr->u.binaryOp.op == OP_ADD && IsShortLit(right, VMFALSE))
+            ival = right->u.integerLit.value;
+        else if (expr->u.binaryOp.op == OP_ADD && IsShortLit(left, VMFALSE)) {
+            ival = left->u.integerLit.value;
+            left = right;
+        }
+        else if (expr->u.binaryOp.op == OP_SUB && IsShortLit(right, VMTRUE))
+            ival = -right->u.integerLit.value;
+        else {
+            a = code_operand(c, left, right);
+            b = code_expr(c, right, REG_ANY);
+            c->tempCount = mark;
+            d = Target(c, dst);
+            code_op3(c, OP_RNOT + expr->u.binaryOp.op - OP_NOT, d, a, b);
+            break;
+        }
+        a = code_expr(c, left, REG_ANY);
+        c->tempCount = mark;
+        d = Target(c, dst);
+        code_op2(c, OP_RADDI, d, a);
+        putcbyte(c, ival);
+        break;
+    case NodeTypeAssignmentOp:
+        d = code_assignment(c, expr, dst);
+        break;
+    case NodeTypeArrayRef:
+        a = code_arrayaddr(c, expr);
+        c->tempCount = mark;
+        d = Target(c, dst);
+        code_op2(c, OP_RLOAD, d, a);
+        break;
+    case NodeTypeFunctionCall:
+        d = code_call(c, expr, dst);
+        break;
+    case NodeTypeDisjunction:
+        d = code_shortcircuit(c, OP_RBRT, expr, dst);
+        break;
+    case NodeTypeConjunction:
+        d = code_shortcircuit(c, OP_RBRF, expr, dst);
+        break;
+    }
+    return d;
+}
+
+/* code_into - generate code for an expression leaving its value in a specific register */
+static void code_into(ParseContext *c, ParseTreeNode *expr, int dst)
+{
+    int r = code_expr(c, expr, dst);
+    if (r != dst)
+        code_op2(c, OP_RMOV, dst, r);
+}
+
+/* code_operand - generate code for a left operand that must keep its value while the next one is evaluated */
+static int code_operand(ParseContext *c, ParseTreeNode *expr, ParseTreeNode *next)
+{
+    int r = code_expr(c, expr, REG_ANY);
+    if (!IsTemp(r) && ModifiesLocals(next)) {
+        int t = NewTemp(c);
+        code_op2(c, OP_RMOV, t, r);
+        r = t;
+    }
+    return r;
+}
+
+/* code_assignment - generate code for an assignment */
+static int code_assignment(ParseContext *c, ParseTreeNode *expr, int dst)
+{
+    ParseTreeNode *left = expr->u.binaryOp.left;
+    ParseTreeNode *right = expr->u.binaryOp.right;
+    int op = expr->u.binaryOp.op;
+    int hint = IsReg(dst) ? dst : REG_ANY;
+    int r = REG_NONE, a, b;
+    switch (left->nodeType) {
+    case NodeTypeLocalSymbolRef:
+        r = left->u.symbolRef.offset;
+        if (op == OP_EQ)
+            code_into(c, right, r);
+        else {
+            a = code_operand(c, left, right);
+            b = code_expr(c, right, REG_ANY);
+            code_op3(c, OP_RNOT + op - OP_NOT, r, a, b);
+        }
+        break;
+    case NodeTypeGlobalSymbolRef:
+        if (op == OP_EQ)
+            r = code_expr(c, right, hint);
+        else {
+            r = NewTemp(c);
+            code_oplong(c, OP_RGLOAD, r, GlobalAddress(c, left->u.symbolRef.symbol));
+            b = code_expr(c, right, REG_ANY);
+            code_op3(c, OP_RNOT + op - OP_NOT, r, r, b);
+        }
+        code_oplong(c, OP_RGSTORE, r, GlobalAddress(c, left->u.symbolRef.symbol));
+        break;
+    case NodeTypeArrayRef:
+        a = code_arrayaddr(c, left);
+        if (op == OP_EQ)
+            r = code_expr(c, right, hint);
+        else {
+            r = NewTemp(c);
+            code_op2(c, OP_RLOAD, r, a);
+            b = code_expr(c, right, REG_ANY);
+            code_op3(c, OP_RNOT + op - OP_NOT, r, r, b);
+        }
+        code_op2(c, OP_RSTORE, a, r);
+        break;
+    default:
+        ParseError(c, "expecting an lvalue");
+        break;
+    }
+    return r;
+}
+
+/* code_increment - generate code for a pre or post increment or decrement */
+static int code_increment(ParseContext *c, ParseTreeNode *expr, int dst, int post)
+{
+    ParseTreeNode *lvalue = expr->u.incrementOp.expr;
+    int increment = expr->u.incrementOp.increment;
+    int r = REG_NONE, old = REG_NONE, a;
+
+    /* there is no old value to keep if the result isn't used */
+    if (dst == REG_NONE)
+        post = VMFALSE;
+
+    switch (lvalue->nodeType) {
+    case NodeTypeLocalSymbolRef:
+        r = lvalue->u.symbolRef.offset;
+        if (post) {
+            old = (IsReg(dst) && dst != r) ? dst : NewTemp(c);
+            code_op2(c, OP_RMOV, old, r);
+        }
+        code_op2(c, OP_RADDI, r, r);
+        putcbyte(c, increment);
+        break;
+    case NodeTypeGlobalSymbolRef:
+        old = NewTemp(c);
+        r = post ? NewTemp(c) : old;
+        code_oplong(c, OP_RGLOAD, old, GlobalAddress(c, lvalue->u.symbolRef.symbol));
+        code_op2(c, OP_RADDI, r, old);
+        putcbyte(c, increment);
+        code_oplong(c, OP_RGSTORE, r, GlobalAddress(c, lvalue->u.symbolRef.symbol));
+        break;
+    case NodeTypeArrayRef:
+        a = code_arrayaddr(c, lvalue);
+        old = NewTemp(c);
+        r = post ? NewTemp(c) : old;
+        code_op2(c, OP_RLOAD, old, a);
+        code_op2(c, OP_RADDI, r, old);
+        putcbyte(c, increment);
+        code_op2(c, OP_RSTORE, a, r);
+        break;
+    default:
+        ParseError(c, "expecting an lvalue");
+        break;
+    }
+
+    /* return the old value of a post increment or the new value otherwise */
+    return post ? old : r;
+}
+
+/* code_shortcircuit - generate code for a conjunction or disjunction of boolean expressions */
+static int code_shortcircuit(ParseContext *c, int op, ParseTreeNode *expr, int dst)
+{
+    ExprListEntry *entry = expr->u.exprList.exprs;
+    int d = IsTemp(dst) ? dst : NewTemp(c);
+    int mark = c->tempCount;
+    int end = 0;
+
+    code_into(c, entry->expr, d);
+    c->tempCount = mark;
+
+    while ((entry = entry->next) != NULL) {
+        code_op1(c, op, d);
+        end = putcword(c, end);
+        code_into(c, entry->expr, d);
+        c->tempCount = mark;
+    }
+
+    fixupbranch(c, end, codeaddr(c));
+
+    return d;
+}
+
+/* code_arrayaddr - generate code for the address of an array element */
+static int code_arrayaddr(ParseContext *c, ParseTreeNode *expr)
+{
+    int mark = c->tempCount;
+    int d, a, b;
+
+    a = code_operand(c, expr->u.arrayRef.array, expr->u.arrayRef.index);
+    b = code_expr(c, expr->u.arrayRef.index, REG_ANY);
+    c->tempCount = mark;
+
+    d = NewTemp(c);
+    code_op3(c, OP_RINDEX, d, a, b);
+
+    return d;
+}
+
+/* code_call - generate code for a function call */
+static int code_call(ParseContext *c, ParseTreeNode *expr, int dst)
+{
+    ExprListEntry *arg;
+    int d = dst;
+
+    /* push each argument and the function */
+    for (arg = expr->u.functionCall.args; arg != NULL; arg = arg->next)
+        code_rvalue(c, arg->expr);
+    code_rvalue(c, expr->u.functionCall.fcn);
+
+    /* call the function */
+    putcbyte(c, OP_CALL);
+    putcbyte(c, expr->u.functionCall.argc);
+
+    /* move the result off of the stack unless it is wanted there */
+    switch (dst) {
+    case REG_STACK:
+        break;
+    case REG_NONE:
+        putcbyte(c, OP_DROP);
+        break;
+    default:
+        d = Target(c, dst);
+        code_op1(c, OP_RPOP, d);
+        break;
+    }
+
+    return d;
+}
+
+/* code_op1 - code an instruction with one register operand */
+static void code_op1(ParseContext *c, int op, int r)
+{
+    putcbyte(c, op);
+    putcreg(c, r);
+}
+
+/* code_op2 - code an instruction with two register operands */
+static void code_op2(ParseContext *c, int op, int d, int a)
+{
+    putcbyte(c, op);
+    putcreg(c, d);
+    putcreg(c, a);
+}
+
+/* code_op3 - code an instruction with three register operands */
+static void code_op3(ParseContext *c, int op, int d, int a, int b)
+{
+    putcbyte(c, op);
+    putcreg(c, d);
+    putcreg(c, a);
+    putcreg(c, b);
+}
+
+/* code_oplong - code an instruction with a register and a long operand */
+static void code_oplong(ParseContext *c, int op, int r, VMVALUE v)
+{
+    code_op1(c, op, r);
+    putclong(c, v);
+}
+
+/* ModifiesLocals - check to see if evaluating an expression might change a local variable */
+static int ModifiesLocals(ParseTreeNode *expr)
+{
+    ExprListEntry *entry;
+    switch (expr->nodeType) {
+    case NodeTypePreincrementOp:
+    case NodeTypePostincrementOp:
+    case NodeTypeAssignmentOp:
+        return VMTRUE;
+    case NodeTypeUnaryOp:
+        return ModifiesLocals(expr->u.unaryOp.expr);
+    case NodeTypeBinaryOp:
+        return ModifiesLocals(expr->u.binaryOp.left) || ModifiesLocals(expr->u.binaryOp.right);
+    case NodeTypeArrayRef:
+        return ModifiesLocals(expr->u.arrayRef.array) || ModifiesLocals(expr->u.arrayRef.index);
+    case NodeTypeFunctionCall:
+        if (ModifiesLocals(expr->u.functionCall.fcn))
+            return VMTRUE;
+        for (entry = expr->u.functionCall.args; entry != NULL; entry = entry->next)
+            if (ModifiesLocals(entry->expr))
+                return VMTRUE;
+        return VMFALSE;
+    case NodeTypeDisjunction:
+    case NodeTypeConjunction:
+        for (entry = expr->u.exprList.exprs; entry != NULL; entry = entry->next)
+            if (ModifiesLocals(entry->expr))
+                return VMTRUE;
+        return VMFALSE;
+    default:
+        return VMFALSE;
+    }
+}
+
+/* NewTemp - allocate a temporary register */
+static int NewTemp(ParseContext *c)
+{
+    int reg = REG_TEMP + c->tempCount++;
+    if (c->tempCount > c->maxTemps)
+        c->maxTemps = c->tempCount;
+    return reg;
+}
+
+/* Target - get the register to hold the result of an instruction */
+static int Target(ParseContext *c, int dst)
+{
+    return IsReg(dst) ? dst : NewTemp(c);
+}
+
+/* putcreg - put a register operand into the code buffer */
+static void putcreg(ParseContext *c, int reg)
+{
+    /* the main code has no local variables so its temporaries can be placed right away */
+    if (IsTemp(reg) && c->codeType == CODE_TYPE_MAIN)
+        putcbyte(c, -FRAME_LINKAGE - 1 - (reg - REG_TEMP));
+
+    /* otherwise, remember where the temporary is referenced */
+    else if (IsTemp(reg)) {
+        TempRef *ref = (TempRef *)LocalAlloc(c, sizeof(TempRef));
+        ref->offset = putcbyte(c, reg - REG_TEMP);
+        ref->next = c->tempRefs;
+        c->tempRefs = ref;
+    }
+
+    /* arguments and local variables are already frame offsets */
+    else
+        putcbyte(c, reg);
+}
+
+#endif
@@ -1,54 +1,198 @@
-/* db_image.c - compiled image functions
- *
- * Copyright (c) 2014 by David Michael Betz.  All rights reserved.
- *
- */
-
-#include "db_system.h"
-#include "db_image.h"
-
-/* AllocateImage - allocate a program image */
-ImageHdr *AllocateImage(System *sys, size_t size)
-{
-    ImageHdr *image;
-    if (!(image = (ImageHdr *)AllocateFreeSpace(sys, size)))
-        return NULL;
-    image->heapTop = (uint8_t *)image + size;
-    InitImage(image);
-    return image;
-}
-        
-/* InitImage - initialize an image */
-void InitImage(ImageHdr *image)
-{
-    InitSymbolTable(&image->globals);
-    image->codeBuf = image->codeFree = image->data;
-    image->heapFree = image->heapTop;
-    image->strings = NULL;
-}
-
-/* AllocateImageSpace - allocate image space */
-void *AllocateImageSpace(ImageHdr *image, size_t size)
-{
-    size = (size + ALIGN_MASK) & ~ALIGN_MASK;
-    if (image->heapFree - size < image->codeFree)
-        return NULL;
-    image->heapFree -= size;
-    return image->heapFree;
-}
-
-/* StoreVector - store a vector */
-VMVALUE StoreVector(ImageHdr *image, const VMVALUE *buf, size_t size)
-{
-    return StoreBVector(image, (uint8_t *)buf, size * sizeof(VMVALUE));
-}
-
-/* StoreBVector - store a byte vector */
-VMVALUE StoreBVector(ImageHdr *image, const uint8_t *buf, size_t size)
-{
-    void *addr;
-    if (!(addr = AllocateImageSpace(image, size)))
-        return 0;
-    memcpy(addr, buf, size);
-    return (VMVALUE)addr;
-}
+/* db_image.c - compiled image functions
+ *
+ * Copyright (c) 2014 by David Michael Betz.  All rights reserved.
+ *
+ */
+
+#include <stddef.h>
+#include "db_system.h"
+#include "db_image.h"
+
+#ifdef USE_NAME_INDEX
+static VMVALUE FindName(ImageHdr *image, NameIndex *index, const char *name);
+static void InsertName(ImageHdr *image, NameIndex *index, VMVALUE name);
+static VMUVALUE HashName(const char *name);
+#endif
+
+/* AllocateImage - allocate a program image */
+ImageHdr *AllocateImage(System *sys, size_t size)
+{
+    ImageHdr *image;
+    if (size < sizeof(ImageHdr) || !(image = (ImageHdr *)AllocateFreeSpace(sys, size)))
+        return NULL;
+    image->heapTop = (uint8_t *)image + (size & ~ALIGN_MASK);
+    InitImage(image);
+    return image;
+}
+        
+/* InitImage - initialize an image */
+void InitImage(ImageHdr *image)
+{
+    InitSymbolTable(&image->globals);
+#ifdef USE_NAME_INDEX
+    memset(&image->globalIndex, 0, sizeof(NameIndex));
+    memset(&image->stringIndex, 0, sizeof(NameIndex));
+#endif
+    image->globalsFree = image->codeBuf = image->codeFree = image->data;
+    image->heapFree = image->heapTop;
+    image->strings = NULL;
+}
+
+/* AllocateImageSpace - allocate image space */
+void *AllocateImageSpace(ImageHdr *image, size_t size)
+{
+    size = (size + ALIGN_MASK) & ~ALIGN_MASK;
+    if (image->heapFree - size < image->codeFree)
+        return NULL;
+    image->heapFree -= size;
+    return image->heapFree;
+}
+
+/* AllocateGlobalSpace - allocate space at the end of the global segment
+
+   Any code under construction is moved up to make room.  It only refers to
+   itself by offsets from the start of the code so it doesn't mind.  This
+   includes main code set aside below a function being compiled since all
+   code under construction starts at the end of the global segment. */
+void *AllocateGlobalSpace(ImageHdr *image, size_t size)
+{
+    uint8_t *addr = image->globalsFree;
+    size = (size + ALIGN_MASK) & ~ALIGN_MASK;
+    if (image->codeFree + size > image->heapFree)
+        return NULL;
+    memmove(image->globalsFree + size, image->globalsFree, image->codeFree - image->globalsFree);
+    image->globalsFree += size;
+    image->codeBuf += size;
+    image->codeFree += size;
+    return addr;
+}
+
+/* FindGlobal - find a global symbol */
+Symbol *FindGlobal(ImageHdr *image, const char *name)
+{
+#ifdef USE_NAME_INDEX
+    VMVALUE addr = FindName(image, &image->globalIndex, name);
+    return addr ? (Symbol *)((uint8_t *)VMPTR(image, addr) - offsetof(Symbol, name)) : NULL;
+#else
+    return FindSymbol(&image->globals, name);
+#endif
+}
+
+/* FindString - find a string constant */
+String *FindString(ImageHdr *image, const char *value)
+{
+#ifdef USE_NAME_INDEX
+    VMVALUE addr = FindName(image, &image->stringIndex, value);
+    return addr ? (String *)((uint8_t *)VMPTR(image, addr) - offsetof(String, data)) : NULL;
+#else
+    String *str;
+    for (str = image->strings; str != NULL; str = str->next)
+        if (strcmp(value, str->data) == 0)
+            return str;
+    return NULL;
+#endif
+}
+
+#ifdef USE_NAME_INDEX
+
+/* IndexName - add a name stored in the image heap to an index
+
+   The index uses open addressing and is kept no more than half full.  When
+   it fills up the names are moved to a new index twice the size.  The old
+   one can't be given back since the heap only grows down so the space lost
+   is never more than the size of the current index. */
+int IndexName(ImageHdr *image, NameIndex *index, const char *name)
+{
+    if ((index->count + 1) * 2 > index->size) {
+        NameIndex old = *index;
+        VMVALUE i;
+        index->size = old.size ? old.size * 2 : MIN_INDEX_SIZE;
+        if (!(index->slots = (VMVALUE *)AllocateImageSpace(image, index->size * sizeof(VMVALUE)))) {
+            *index = old;
+            return VMFALSE;
+        }
+        memset(index->slots, 0, index->size * sizeof(VMVALUE));
+        for (i = 0; i < old.size; ++i)
+            if (old.slots[i] != 0)
+                InsertName(image, index, old.slots[i]);
+    }
+    InsertName(image, index, VMADDR(image, name));
+    ++index->count;
+    return VMTRUE;
+}
+
+/* FindName - find the VM address of a name in an index */
+static VMVALUE FindName(ImageHdr *image, NameIndex *index, const char *name)
+{
+    VMUVALUE mask = index->size - 1, i;
+    if (!index->slots)
+        return 0;
+    for (i = HashName(name) & mask; index->slots[i] != 0; i = (i + 1) & mask)
+        if (strcmp(name, (char *)VMPTR(image, index->slots[i])) == 0)
+            return index->slots[i];
+    return 0;
+}
+
+/* InsertName - put the VM address of a name in the first free slot of its chain */
+static void InsertName(ImageHdr *image, NameIndex *index, VMVALUE name)
+{
+    VMUVALUE mask = index->size - 1, i;
+    for (i = HashName((char *)VMPTR(image, name)) & mask; index->slots[i] != 0; i = (i + 1) & mask)
+        ;
+    index->slots[i] = name;
+}
+
+/* HashName - compute the hash of a name (FNV-1a) */
+static VMUVALUE HashName(const char *name)
+{
+    VMUVALUE hash = 2166136261u;
+    while (*name)
+        hash = (hash ^ (uint8_t)*name++) * 16777619u;
+    return hash;
+}
+
+#endif
+
+/* CopyGlobals - make a private copy of the global segment of an image
+
+   The copy is allocated from free space.  Array data moves with the rest of
+   the segment so array variables that still point at their original data
+   are pointed at the copy of it. */
+uint8_t *CopyGlobals(System *sys, ImageHdr *image)
+{
+    size_t size = image->globalsFree - image->data;
+    VMVALUE start = VMADDR(image, image->data);
+    VMVALUE end = VMADDR(image, image->globalsFree);
+    uint8_t *globals;
+    Symbol *symbol;
+
+    if (!(globals = (uint8_t *)AllocateFreeSpace(sys, size)))
+        return NULL;
+    memcpy(globals, image->data, size);
+
+    for (symbol = image->globals.head; symbol != NULL; symbol = symbol->next) {
+        if (symbol->storageClass == SC_ARRAY) {
+            VMVALUE *cell = GlobalCell(globals, symbol);
+            if (*cell >= start && *cell < end)
+                *cell += VMADDR(image, globals) - start;
+        }
+    }
+
+    return globals;
+}
+
+/* StoreVector - store a vector */
+VMVALUE StoreVector(ImageHdr *image, const VMVALUE *buf, size_t size)
+{
+    return StoreBVector(image, (uint8_t *)buf, size * sizeof(VMVALUE));
+}
+
+/* StoreBVector - store a byte vector */
+VMVALUE StoreBVector(ImageHdr *image, const uint8_t *buf, size_t size)
+{
+    void *addr;
+    if (!(addr = AllocateImageSpace(image, size)))
+        return 0;
+    memcpy(addr, buf, size);
+    return VMADDR(image, addr);
+}
@@ -1,96 +1,266 @@
-/* db_image.h - compiled image file definitions
- *
- * Copyright (c) 2014 by David Michael Betz.  All rights reserved.
- *
- */
-
-#ifndef __DB_IMAGE_H__
-#define __DB_IMAGE_H__
-
-#include <stdarg.h>
-#include "db_symbols.h"
-#include "db_system.h"
-#include "db_types.h"
-
-/* forward type declarations */
-typedef struct String String;
-
-/* string structure */
-struct String {
-    String *next;
-    char data[1];
-};
-
-/* image header */
-typedef struct {
-    SymbolTable globals;    /* global variables and constants */
-    String *strings;        /* string constants */
-    uint8_t *codeBuf;       /* code starts at beginning of heap */
-    uint8_t *codeFree;      /* next available code location */
-    uint8_t *heapFree;      /* next free heap location */
-    uint8_t *heapTop;       /* top of heap */
-    uint8_t data[1];        /* data space */
-} ImageHdr;
-
-/* opcodes */
-#define OP_HALT         0x00    /* halt */
-#define OP_BRT          0x01    /* branch on true */
-#define OP_BRTSC        0x02    /* branch on true (for short circuit booleans) */
-#define OP_BRF          0x03    /* branch on false */
-#define OP_BRFSC        0x04    /* branch on false (for short circuit booleans) */
-#define OP_BR           0x05    /* branch unconditionally */
-#define OP_NOT          0x06    /* logical negate top of stack */
-#define OP_NEG          0x07    /* negate */
-#define OP_ADD          0x08    /* add two numeric expressions */
-#define OP_SUB          0x09    /* subtract two numeric expressions */
-#define OP_MUL          0x0a    /* multiply two numeric expressions */
-#define OP_DIV          0x0b    /* divide two numeric expressions */
-#define OP_REM          0x0c    /* remainder of two numeric expressions */
-#define OP_BNOT         0x0d    /* bitwise not of two numeric expressions */
-#define OP_BAND         0x0e    /* bitwise and of two numeric expressions */
-#define OP_BOR          0x0f    /* bitwise or of two numeric expressions */
-#define OP_BXOR         0x10    /* bitwise exclusive or */
-#define OP_SHL          0x11    /* shift left */
-#define OP_SHR          0x12    /* shift right */
-#define OP_LT           0x13    /* less than */
-#define OP_LE           0x14    /* less than or equal to */
-#define OP_EQ           0x15    /* equal to */
-#define OP_NE           0x16    /* not equal to */
-#define OP_GE           0x17    /* greater than or equal to */
-#define OP_GT           0x18    /* greater than */
-#define OP_LIT          0x19    /* load a literal */
-#define OP_SLIT         0x1a    /* load a short literal (-128 to 127) */
-#define OP_LOAD         0x1b    /* load a long from memory */
-#define OP_LOADB        0x1c    /* load a byte from memory */
-#define OP_STORE        0x1d    /* store a long into memory */
-#define OP_STOREB       0x1e    /* store a byte into memory */
-#define OP_LADDR        0x1f    /* load the address of a local variable */
-#define OP_INDEX        0x20    /* index into a vector of longs */
-#define OP_CALL         0x21    /* call a function */
-#define OP_FRAME        0x22    /* create a stack frame */
-#define OP_RETURN       0x23    /* remove a stack frame and return from a function call */
-#define OP_DROP         0x24    /* drop the top element of the stack */
-#define OP_DUP          0x25    /* duplicate the top element of the stack */
-#define OP_TUCK         0x26    /* a b -> b a b */
-#define OP_NATIVE       0x27    /* execute native code */
-#define OP_TRAP         0x28    /* trap to handler */
-
-/* VM trap codes */
-enum {
-    TRAP_GetChar      = 0,
-    TRAP_PutChar      = 1,
-    TRAP_PrintStr     = 2,
-    TRAP_PrintInt     = 3,
-    TRAP_PrintTab     = 4,
-    TRAP_PrintNL      = 5,
-    TRAP_PrintFlush   = 6,
-};
-
-/* prototypes */
-ImageHdr *AllocateImage(System *sys, size_t imageBufferSize);
-void InitImage(ImageHdr *image);
-void *AllocateImageSpace(ImageHdr *image, size_t size);
-VMVALUE StoreVector(ImageHdr *image, const VMVALUE *buf, size_t size);
-VMVALUE StoreBVector(ImageHdr *image, const uint8_t *buf, size_t size);
-
-#endif
+/* db_image.h - compiled image file definitions
+ *
+ * Copyright (c) 2014 by David Michael Betz.  All rights reserved.
+ *
+ */
+
+#ifndef __DB_IMAGE_H__
+#define __DB_IMAGE_H__
+
+#include <stdarg.h>
+#include "db_symbols.h"
+#include "db_system.h"
+#include "db_types.h"
+
+/* forward type declarations */
+typedef struct String String;
+
+/* string structure (the data is also zero terminated) */
+struct String {
+    String *next;
+    VMVALUE length;
+    char data[1];
+};
+
+/* find the length of a string from the address of its data */
+#define StringLength(data)  (*(VMVALUE *)((uint8_t *)(data) - sizeof(VMVALUE)))
+
+#ifdef USE_NAME_INDEX
+
+/* hash index of names stored in the image (each slot holds the VM address
+   of a name or zero if it is empty) */
+typedef struct {
+    VMVALUE *slots;         /* slots allocated from the image heap */
+    VMVALUE size;           /* number of slots (a power of two) */
+    VMVALUE count;          /* number of slots in use */
+} NameIndex;
+
+#endif
+
+#ifdef USE_TIERS
+
+/* execution profile (stored in front of the FRAME instruction that starts
+   each function or main code when profiling for tiered execution) */
+typedef struct {
+    VMVALUE calls;          /* number of times the code was entered */
+    VMVALUE loops;          /* number of backward branches taken */
+    VMVALUE tier;           /* native code offset, zero if not yet promoted or TIER_NONE */
+    VMVALUE size;           /* size of the bytecode */
+} Profile;
+
+/* tier of code that can't be promoted */
+#define TIER_NONE       (-1)
+
+/* find the profile of the code whose FRAME instruction is at p (main code
+   starts its FRAME up to three bytes past its profile to keep its operands
+   aligned) */
+#define CodeProfile(p)  ((Profile *)(((uintptr_t)(p) - sizeof(Profile)) & ~(uintptr_t)ALIGN_MASK))
+
+#endif
+
+/* number of frame slots used to link frames (the saved fp, the return address
+   and, when profiling for tiered execution, the profile of the function) */
+#ifdef USE_TIERS
+#define FRAME_LINKAGE   3
+#else
+#define FRAME_LINKAGE   2
+#endif
+
+/* image header
+
+   The data space starts with the global segment which holds the values of
+   the global variables and grows up.  The code, strings and symbols are
+   allocated from the heap which grows down from the top of the image and is
+   never written once a function is stored so a compiled image can be shared
+   by any number of interpreters each with its own copy of the global
+   segment.  Code under construction is built in the space between the two
+   and moved to the heap when it is finished.  The name indexes are the one
+   thing in the heap that changes and then only as names are added. */
+typedef struct {
+    SymbolTable globals;    /* global variables and constants */
+    String *strings;        /* string constants */
+#ifdef USE_NAME_INDEX
+    NameIndex globalIndex;  /* index of the names of the global symbols */
+    NameIndex stringIndex;  /* index of the string constants */
+#endif
+    uint8_t *globalsFree;   /* next available global segment location */
+    uint8_t *codeBuf;       /* code under construction starts after the global segment */
+    uint8_t *codeFree;      /* next available code location */
+    uint8_t *heapFree;      /* next free heap location */
+    uint8_t *heapTop;       /* top of heap */
+    uint8_t data[1];        /* data space */
+} ImageHdr;
+
+/* find the cell holding the value of a global variable in a global segment */
+#define GlobalCell(globals, symbol) ((VMVALUE *)((uint8_t *)(globals) + (symbol)->value))
+
+#ifdef USE_IMAGE_FILES
+
+/* image file header
+
+   An image file starts with the image laid out exactly as it is in memory
+   (the space between the global segment and the heap is left as a hole) so
+   that it can be mapped and run in place.  It is followed by the relocation
+   table, the address of the main code of each top level statement in the
+   order they are to be run and finally this header.  The host pointers in
+   the image are stored as offsets from the image header and each has an
+   entry in the relocation table holding its offset with its type in the low
+   bits (host pointers are aligned so the low bits of their offsets are
+   always zero).  Nothing that runs the code uses them so a mapped image
+   needs no fixups unless its code has to be translated or profiled. */
+typedef struct {
+    char tag[4];            /* IMAGE_TAG */
+    uint32_t flags;         /* build options the code depends on */
+    uint32_t top;           /* offset of the top of the heap */
+    uint32_t segmentSize;   /* size of the image header and global segment */
+    uint32_t heapSize;      /* size of the heap */
+    uint32_t relocCount;    /* number of relocation table entries */
+    uint32_t mainCount;     /* number of main code addresses */
+} ImageFileHdr;
+
+/* image file tag */
+#define IMAGE_TAG       "NBC4"
+
+/* relocation types */
+#define RELOC_POINTER   0       /* pointer into the image */
+#define RELOC_HANDLER   1       /* threaded code handler (stored as its opcode) */
+#define RELOC_TYPE_MASK 3
+
+#endif
+
+/* opcodes */
+#define OP_HALT         0x00    /* halt */
+#define OP_BRT          0x01    /* branch on true */
+#define OP_BRTSC        0x02    /* branch on true (for short circuit booleans) */
+#define OP_BRF          0x03    /* branch on false */
+#define OP_BRFSC        0x04    /* branch on false (for short circuit booleans) */
+#define OP_BR           0x05    /* branch unconditionally */
+#define OP_NOT          0x06    /* logical negate top of stack */
+#define OP_NEG          0x07    /* negate */
+#define OP_ADD          0x08    /* add two numeric expressions */
+#define OP_SUB          0x09    /* subtract two numeric expressions */
+#define OP_MUL          0x0a    /* multiply two numeric expressions */
+#define OP_DIV          0x0b    /* divide two numeric expressions */
+#define OP_REM          0x0c    /* remainder of two numeric expressions */
+#define OP_BNOT         0x0d    /* bitwise not of two numeric expressions */
+#define OP_BAND         0x0e    /* bitwise and of two numeric expressions */
+#define OP_BOR          0x0f    /* bitwise or of two numeric expressions */
+#define OP_BXOR         0x10    /* bitwise exclusive or */
+#define OP_SHL          0x11    /* shift left */
+#define OP_SHR          0x12    /* shift right */
+#define OP_LT           0x13    /* less than */
+#define OP_LE           0x14    /* less than or equal to */
+#define OP_EQ           0x15    /* equal to */
+#define OP_NE           0x16    /* not equal to */
+#define OP_GE           0x17    /* greater than or equal to */
+#define OP_GT           0x18    /* greater than */
+#define OP_LIT          0x19    /* load a literal */
+#define OP_SLIT         0x1a    /* load a short literal (-128 to 127) */
+#define OP_LOAD         0x1b    /* load a long from memory */
+#define OP_LOADB        0x1c    /* load a byte from memory */
+#define OP_STORE        0x1d    /* store a long into memory */
+#define OP_STOREB       0x1e    /* store a byte into memory */
+#define OP_LADDR        0x1f    /* load the address of a local variable */
+#define OP_INDEX        0x20    /* index into a vector of longs */
+#define OP_CALL         0x21    /* call a function */
+#define OP_FRAME        0x22    /* create a stack frame (and check the maximum stack depth) */
+#define OP_RETURN       0x23    /* remove a stack frame and return from a function call */
+#define OP_DROP         0x24    /* drop the top element of the stack */
+#define OP_DUP          0x25    /* duplicate the top element of the stack */
+#define OP_TUCK         0x26    /* a b -> b a b */
+#define OP_NATIVE       0x27    /* execute native code */
+#define OP_TRAP         0x28    /* trap to handler */
+#define OP_GADDR        0x29    /* load the address of a global variable */
+
+/* superinstructions (fused versions of common opcode sequences) */
+#define OP_LLOAD        0x2a    /* load a local variable (LADDR n; LOAD) */
+#define OP_LSTORE       0x2b    /* store a local variable (LADDR n; ...; STORE) */
+#define OP_GLOAD        0x2c    /* load a global variable (GADDR addr; LOAD) */
+#define OP_ADDI         0x2d    /* add an immediate value (SLIT n; ADD) */
+#define OP_BRLT         0x2e    /* branch on less than (LT; BRT) */
+#define OP_BRLE         0x2f    /* branch on less than or equal to (LE; BRT) */
+#define OP_BREQ         0x30    /* branch on equal to (EQ; BRT) */
+#define OP_BRNE         0x31    /* branch on not equal to (NE; BRT) */
+#define OP_BRGE         0x32    /* branch on greater than or equal to (GE; BRT) */
+#define OP_BRGT         0x33    /* branch on greater than (GT; BRT) */
+#define OP_GSTORE       0x34    /* store a global variable (GADDR addr; ...; STORE) */
+
+/* register instructions (three-address operations on frame slots)
+
+   The register operands are signed frame offsets like the LADDR operand.
+   OP_RNOT to OP_RGT are in the same order as OP_NOT to OP_GT and OP_RBRLT
+   to OP_RBRGT are in the same order as OP_LT to OP_GT. */
+#define OP_RNOT         0x35    /* d = !a */
+#define OP_RNEG         0x36    /* d = -a */
+#define OP_RADD         0x37    /* d = a + b */
+#define OP_RSUB         0x38    /* d = a - b */
+#define OP_RMUL         0x39    /* d = a * b */
+#define OP_RDIV         0x3a    /* d = a / b */
+#define OP_RREM         0x3b    /* d = a % b */
+#define OP_RBNOT        0x3c    /* d = ~a */
+#define OP_RBAND        0x3d    /* d = a & b */
+#define OP_RBOR         0x3e    /* d = a | b */
+#define OP_RBXOR        0x3f    /* d = a ^ b */
+#define OP_RSHL         0x40    /* d = a << b */
+#define OP_RSHR         0x41    /* d = a >> b */
+#define OP_RLT          0x42    /* d = a < b */
+#define OP_RLE          0x43    /* d = a <= b */
+#define OP_REQ          0x44    /* d = a == b */
+#define OP_RNE          0x45    /* d = a != b */
+#define OP_RGE          0x46    /* d = a >= b */
+#define OP_RGT          0x47    /* d = a > b */
+#define OP_RBRLT        0x48    /* branch if a < b */
+#define OP_RBRLE        0x49    /* branch if a <= b */
+#define OP_RBREQ        0x4a    /* branch if a == b */
+#define OP_RBRNE        0x4b    /* branch if a != b */
+#define OP_RBRGE        0x4c    /* branch if a >= b */
+#define OP_RBRGT        0x4d    /* branch if a > b */
+#define OP_RBRT         0x4e    /* branch if a is true */
+#define OP_RBRF         0x4f    /* branch if a is false */
+#define OP_RMOV         0x50    /* d = a */
+#define OP_RLIT         0x51    /* d = literal */
+#define OP_RGLOAD       0x52    /* d = *addr */
+#define OP_RGSTORE      0x53    /* *addr = a */
+#define OP_RLOAD        0x54    /* d = *a */
+#define OP_RSTORE       0x55    /* *d = a */
+#define OP_RINDEX       0x56    /* d = a + b * sizeof(VMVALUE) */
+#define OP_RADDI        0x57    /* d = a + immediate (-128 to 127) */
+#define OP_RPUSH        0x58    /* push a onto the stack */
+#define OP_RPOP         0x59    /* pop the top of the stack into d */
+#define OP_RSLIT        0x5a    /* d = short literal (-128 to 127) */
+
+/* VM trap codes */
+enum {
+    TRAP_GetChar      = 0,
+    TRAP_PutChar      = 1,
+    TRAP_PrintStr     = 2,
+    TRAP_PrintInt     = 3,
+    TRAP_PrintTab     = 4,
+    TRAP_PrintNL      = 5,
+    TRAP_PrintFlush   = 6,
+};
+
+/* prototypes */
+ImageHdr *AllocateImage(System *sys, size_t imageBufferSize);
+void InitImage(ImageHdr *image);
+void *AllocateImageSpace(ImageHdr *image, size_t size);
+void *AllocateGlobalSpace(ImageHdr *image, size_t size);
+Symbol *FindGlobal(ImageHdr *image, const char *name);
+String *FindString(ImageHdr *image, const char *value);
+#ifdef USE_NAME_INDEX
+int IndexName(ImageHdr *image, NameIndex *index, const char *name);
+#endif
+uint8_t *CopyGlobals(System *sys, ImageHdr *image);
+VMVALUE StoreVector(ImageHdr *image, const VMVALUE *buf, size_t size);
+VMVALUE StoreBVector(ImageHdr *image, const uint8_t *buf, size_t size);
+
+/* prototypes from db_imagefile.c */
+#ifdef USE_IMAGE_FILES
+int SaveImage(ImageHdr *image, const VMVALUE *mains, int mainCount, FILE *fp);
+VMVALUE *LoadImage(System *sys, ImageHdr *image, FILE *fp, int *pMainCount);
+ImageHdr *MapImage(FILE *fp, size_t freeSize, uint8_t **pFreeSpace, VMVALUE **pMains, int *pMainCount);
+size_t ImageFileSize(FILE *fp);
+int IsImageFile(const char *name);
+#endif
+
+#endif
@@ -0,0 +1,497 @@
+/* db_imagefile.c - save compiled images to files and load them again
+ *
+ * Copyright (c) 2014 by David Michael Betz.  All rights reserved.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stddef.h>
+#include <string.h>
+#include "db_vm.h"
+
+#ifdef USE_IMAGE_FILES
+
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+/* build options that change the code or the layout of an image (an image can
+   only be loaded by a build with the same options) */
+#define FLAG_POINTER_SIZE       0x00ff  /* size of a host pointer */
+#define FLAG_NATIVE_OPERANDS    0x0100
+#define FLAG_SUPERINSTRUCTIONS  0x0200
+#define FLAG_STACK_DEPTH        0x0400
+#define FLAG_REGISTER_CODE      0x0800
+#define FLAG_THREADED_CODE      0x1000
+#define FLAG_JIT                0x2000
+#define FLAG_TIERS              0x4000
+
+/* relocation table under construction */
+typedef struct {
+    ImageHdr *image;            /* image being saved */
+    uint32_t *entries;          /* relocation entries */
+    uint32_t count;             /* number of entries */
+    uint32_t size;              /* number of entries there is room for */
+    int ok;                     /* no allocation has failed */
+} RelocTable;
+
+/* local function prototypes */
+static int ReadHeader(FILE *fp, ImageFileHdr *hdr, uint32_t size);
+static VMVALUE *ReadMains(FILE *fp, ImageFileHdr *hdr);
+#ifdef USE_TIERS
+static void ResetProfiles(ImageHdr *image);
+#endif
+static uint32_t BuildFlags(void);
+static int FindPointers(RelocTable *t, const VMVALUE *mains, int mainCount);
+static void AddPointer(RelocTable *t, void *p);
+static void AddReloc(RelocTable *t, void *p, int type);
+#ifdef USE_THREADED_CODE
+static void AddCodePointer(void *cookie, VMCELL *cell, int type);
+#endif
+static void ToOffsets(ImageHdr *image, uint8_t *copy, const ImageFileHdr *hdr, const uint32_t *relocs, uint32_t count);
+static int ToPointers(ImageHdr *image, const uint32_t *relocs, uint32_t count, uint32_t top);
+
+/* SaveImage - save an image and the main code of its top level statements
+
+   The image must not have any code under construction.  A copy of its
+   global segment and heap with offsets in place of its host pointers is
+   written so the image itself is left alone and can go on being used by
+   other threads.  An image that has
+   run code can be saved as a checkpoint with the current values of its
+   global variables and no main code. */
+int SaveImage(ImageHdr *image, const VMVALUE *mains, int mainCount, FILE *fp)
+{
+    uint8_t *heap = image->heapFree;
+    uint8_t *copy;
+    ImageFileHdr hdr;
+    RelocTable t;
+    int ok;
+
+    if (image->codeFree != image->codeBuf)
+        return VMFALSE;
+
+    /* find the host pointers */
+    t.image = image;
+    t.entries = NULL;
+    t.count = t.size = 0;
+    t.ok = VMTRUE;
+    if (!FindPointers(&t, mains, mainCount)) {
+        free(t.entries);
+        return VMFALSE;
+    }
+
+    /* fill in the file header */
+    memcpy(hdr.tag, IMAGE_TAG, sizeof(hdr.tag));
+    hdr.flags = BuildFlags();
+    hdr.top = image->heapTop - (uint8_t *)image;
+    hdr.segmentSize = image->globalsFree - (uint8_t *)image;
+    hdr.heapSize = image->heapTop - heap;
+    hdr.relocCount = t.count;
+    hdr.mainCount = mainCount;
+
+    /* copy the global segment and the heap right after it */
+    if (!(copy = (uint8_t *)malloc(hdr.segmentSize + hdr.heapSize))) {
+        free(t.entries);
+        return VMFALSE;
+    }
+    memcpy(copy, image, hdr.segmentSize);
+    memcpy(copy + hdr.segmentSize, heap, hdr.heapSize);
+
+    /* write the copy with offsets in place of its host pointers and with
+       the heap in the same place as it is in the image */
+    ToOffsets(image, copy, &hdr, t.entries, t.count);
+    ok = fwrite(copy, 1, hdr.segmentSize, fp) == hdr.segmentSize
+      && fseek(fp, hdr.top - hdr.heapSize, SEEK_SET) == 0
+      && fwrite(copy + hdr.segmentSize, 1, hdr.heapSize, fp) == hdr.heapSize
+      && fwrite(t.entries, sizeof(uint32_t), t.count, fp) == t.count
+      && fwrite(mains, sizeof(VMVALUE), mainCount, fp) == (size_t)mainCount
+      && fwrite(&hdr, sizeof(hdr), 1, fp) == 1;
+
+    free(copy);
+    free(t.entries);
+    return ok;
+}
+
+/* LoadImage - load an image saved by SaveImage
+
+   The image must have just been allocated and be at least as large as the
+   image that was saved (see ImageFileSize).  Returns the list of main code
+   addresses to run (which the caller must free) or NULL if the file isn't
+   an image saved by a build with the same options or doesn't fit. */
+VMVALUE *LoadImage(System *sys, ImageHdr *image, FILE *fp, int *pMainCount)
+{
+    uint32_t *relocs = NULL;
+    VMVALUE *mains = NULL;
+    ImageFileHdr hdr;
+    uint8_t *heap;
+
+    /* read the file header and allocate the relocation table */
+    if (!ReadHeader(fp, &hdr, image->heapTop - (uint8_t *)image)
+    ||  !(relocs = (uint32_t *)malloc(hdr.relocCount * sizeof(uint32_t) + 1)))
+        return NULL;
+
+    /* read the image with its heap in the same place as it was */
+    heap = (uint8_t *)image + hdr.top - hdr.heapSize;
+    if (fseek(fp, 0, SEEK_SET) != 0
+    ||  fread(image, 1, hdr.segmentSize, fp) != hdr.segmentSize
+    ||  fseek(fp, hdr.top - hdr.heapSize, SEEK_SET) != 0
+    ||  fread(heap, 1, hdr.heapSize, fp) != hdr.heapSize
+    ||  fread(relocs, sizeof(uint32_t), hdr.relocCount, fp) != hdr.relocCount)
+        goto fail;
+
+    /* turn the offsets back into host pointers */
+    if (!ToPointers(image, relocs, hdr.relocCount, hdr.top)
+    ||  !(mains = ReadMains(fp, &hdr)))
+        goto fail;
+
+#if defined(USE_JIT) && !defined(USE_TIERS)
+    /* the native code isn't saved so translate the functions again */
+    JitRelink(sys, image);
+#endif
+#ifdef USE_TIERS
+    /* the native code isn't saved so promoted functions have to get hot again */
+    ResetProfiles(image);
+#endif
+
+    free(relocs);
+    *pMainCount = hdr.mainCount;
+    return mains;
+
+fail:
+    free(relocs);
+    return NULL;
+}
+
+/* MapImage - map an image file so that its code can be run in place
+
+   The image is mapped copy-on-write with its heap read-only so every process
+   running the image shares the pages holding its code and only the pages of
+   the global segment are copied when they are written.  The image is used
+   as it is in the file so its host pointers are left as offsets and it can't
+   be compiled into.  Free space for the system follows the image since the
+   stack has to be addressable from it.  Returns NULL if the file can't be
+   mapped, is shorter than its header says it is or if the code has to be
+   fixed up or written when it runs in this build. */
+ImageHdr *MapImage(FILE *fp, size_t freeSize, uint8_t **pFreeSpace, VMVALUE **pMains, int *pMainCount)
+{
+#if defined(USE_THREADED_CODE) || defined(USE_JIT) || defined(USE_TIERS)
+    return NULL;
+#else
+    size_t pageSize = sysconf(_SC_PAGESIZE), mapSize, heapPage;
+    ImageFileHdr hdr;
+    struct stat st;
+    uint8_t *base;
+
+    /* read the file header and make sure the file holds everything it
+       describes since touching a mapped page past the end of the file
+       raises SIGBUS */
+    if (!ReadHeader(fp, &hdr, UINT32_MAX)
+    ||  fstat(fileno(fp), &st) != 0
+    ||  (uint64_t)st.st_size < (uint64_t)hdr.top + hdr.relocCount * sizeof(uint32_t) + hdr.mainCount * sizeof(VMVALUE) + sizeof(ImageFileHdr))
+        return NULL;
+    mapSize = (hdr.top + pageSize - 1) & ~(pageSize - 1);
+
+    /* reserve space for the image and the free space and map the image over
+       the start of it */
+    base = (uint8_t *)mmap(NULL, mapSize + freeSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANON | MAP_NORESERVE, -1, 0);
+    if (base == (uint8_t *)MAP_FAILED)
+        return NULL;
+    if (mmap(base, hdr.top, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_FIXED, fileno(fp), 0) == MAP_FAILED
+    ||  !(*pMains = ReadMains(fp, &hdr))) {
+        munmap(base, mapSize + freeSize);
+        return NULL;
+    }
+
+    /* protect the pages past the global segment since nothing is compiled
+       into the image and the code, strings and symbols are never written */
+    heapPage = (hdr.segmentSize + pageSize - 1) & ~(pageSize - 1);
+    if (heapPage < mapSize)
+        mprotect(base + heapPage, mapSize - heapPage, PROT_READ);
+
+    *pFreeSpace = base + mapSize;
+    *pMainCount = hdr.mainCount;
+    return (ImageHdr *)base;
+#endif
+}
+
+/* ImageFileSize - get the size of the image needed to load an image file
+
+   Returns zero if the file isn't an image saved by a build with the same
+   options. */
+size_t ImageFileSize(FILE *fp)
+{
+    ImageFileHdr hdr;
+    if (!ReadHeader(fp, &hdr, UINT32_MAX))
+        return 0;
+    return hdr.top;
+}
+
+/* IsImageFile - check whether a file is an image file made by any build
+
+   A file is taken to be an image if it ends with the tag of an image file
+   or has a zero byte near its start.  Source text never has a zero byte
+   and an image always starts with the offsets in its header, so this also
+   catches image files that were truncated or saved in an older format
+   rather than letting them be compiled as source. */
+int IsImageFile(const char *name)
+{
+    ImageFileHdr hdr;
+    char buf[256];
+    int isImage;
+    size_t size;
+    FILE *fp;
+
+    if (!(fp = fopen(name, "rb")))
+        return VMFALSE;
+    isImage = fseek(fp, -(long)sizeof(ImageFileHdr), SEEK_END) == 0
+           && fread(&hdr, sizeof(ImageFileHdr), 1, fp) == 1
+           && memcmp(hdr.tag, IMAGE_TAG, sizeof(hdr.tag)) == 0;
+    if (!isImage && fseek(fp, 0, SEEK_SET) == 0) {
+        size = fread(buf, 1, sizeof(buf), fp);
+        isImage = memchr(buf, '\0', size) != NULL;
+    }
+    fclose(fp);
+
+    return isImage;
+}
+
+/* ReadHeader - read and check the header at the end of an image file */
+static int ReadHeader(FILE *fp, ImageFileHdr *hdr, uint32_t size)
+{
+    return fseek(fp, -(long)sizeof(ImageFileHdr), SEEK_END) == 0
+        && fread(hdr, sizeof(ImageFileHdr), 1, fp) == 1
+        && memcmp(hdr->tag, IMAGE_TAG, sizeof(hdr->tag)) == 0
+        && hdr->flags == BuildFlags()
+        && hdr->top <= size
+        && hdr->segmentSize >= offsetof(ImageHdr, data)
+        && hdr->segmentSize <= hdr->top
+        && hdr->heapSize <= hdr->top - hdr->segmentSize;
+}
+
+/* ReadMains - read the list of main code addresses of an image file */
+static VMVALUE *ReadMains(FILE *fp, ImageFileHdr *hdr)
+{
+    long offset = hdr->top + hdr->relocCount * sizeof(uint32_t);
+    VMVALUE *mains;
+    uint32_t i;
+
+    if (!(mains = (VMVALUE *)malloc(hdr->mainCount * sizeof(VMVALUE) + 1)))
+        return NULL;
+    if (fseek(fp, offset, SEEK_SET) != 0
+    ||  fread(mains, sizeof(VMVALUE), hdr->mainCount, fp) != hdr->mainCount) {
+        free(mains);
+        return NULL;
+    }
+
+    /* make sure the code is in the image */
+    for (i = 0; i < hdr->mainCount; ++i) {
+        if ((VMUVALUE)mains[i] < hdr->top - hdr->heapSize || (VMUVALUE)mains[i] >= hdr->top) {
+            free(mains);
+            return NULL;
+        }
+    }
+
+    return mains;
+}
+
+#ifdef USE_TIERS
+
+/* ResetProfiles - start over profiling the functions that were promoted */
+static void ResetProfiles(ImageHdr *image)
+{
+    Symbol *symbol;
+    for (symbol = image->globals.head; symbol != NULL; symbol = symbol->next) {
+        if (symbol->storageClass == SC_FUNCTION && *GlobalCell(image->data, symbol) != 0) {
+            Profile *profile = CodeProfile(VMPTR(image, *GlobalCell(image->data, symbol)));
+            if (profile->tier > 0) {
+                profile->calls = 0;
+                profile->loops = 0;
+                profile->tier = 0;
+            }
+        }
+    }
+}
+
+#endif
+
+/* BuildFlags - get the build options that an image depends on */
+static uint32_t BuildFlags(void)
+{
+    uint32_t flags = sizeof(void *);
+#ifdef NATIVE_OPERANDS
+    flags |= FLAG_NATIVE_OPERANDS;
+#endif
+#ifdef USE_SUPERINSTRUCTIONS
+    flags |= FLAG_SUPERINSTRUCTIONS;
+#endif
+#ifdef USE_STACK_DEPTH
+    flags |= FLAG_STACK_DEPTH;
+#endif
+#ifdef USE_REGISTER_CODE
+    flags |= FLAG_REGISTER_CODE;
+#endif
+#ifdef USE_THREADED_CODE
+    flags |= FLAG_THREADED_CODE;
+#endif
+#ifdef USE_JIT
+    flags |= FLAG_JIT;
+#endif
+#ifdef USE_TIERS
+    flags |= FLAG_TIERS;
+#endif
+    return flags;
+}
+
+/* FindPointers - build the relocation table for an image
+
+   The host pointers are the free pointers, list heads and name indexes in
+   the image header, the links of the symbol and string lists and, with
+   threaded code, the handlers and branch targets of the code of each
+   function and each top level statement. */
+static int FindPointers(RelocTable *t, const VMVALUE *mains, int mainCount)
+{
+    ImageHdr *image = t->image;
+    Symbol *symbol;
+    String *str;
+#ifdef USE_THREADED_CODE
+    int i;
+#endif
+
+    /* the image header */
+    AddPointer(t, &image->globals.head);
+    AddPointer(t, &image->globals.pTail);
+#ifdef USE_NAME_INDEX
+    AddPointer(t, &image->globalIndex.slots);
+    AddPointer(t, &image->stringIndex.slots);
+#endif
+    AddPointer(t, &image->strings);
+    AddPointer(t, &image->globalsFree);
+    AddPointer(t, &image->codeBuf);
+    AddPointer(t, &image->codeFree);
+    AddPointer(t, &image->heapFree);
+    AddPointer(t, &image->heapTop);
+
+    /* the symbol and string lists */
+    for (symbol = image->globals.head; symbol != NULL; symbol = symbol->next)
+        AddPointer(t, &symbol->next);
+    for (str = image->strings; str != NULL; str = str->next)
+        AddPointer(t, &str->next);
+
+#ifdef USE_THREADED_CODE
+    /* the threaded code */
+    for (symbol = image->globals.head; symbol != NULL; symbol = symbol->next) {
+        if (symbol->storageClass == SC_FUNCTION) {
+            VMVALUE code = *GlobalCell(image->data, symbol);
+            if (code != 0 && !FindCodePointers((VMCELL *)VMPTR(image, code), AddCodePointer, t))
+                return VMFALSE;
+        }
+    }
+    for (i = 0; i < mainCount; ++i)
+        if (!FindCodePointers((VMCELL *)VMPTR(image, mains[i]), AddCodePointer, t))
+            return VMFALSE;
+#endif
+
+    return t->ok;
+}
+
+/* AddPointer - add a pointer to the relocation table unless it is NULL */
+static void AddPointer(RelocTable *t, void *p)
+{
+    if (*(void **)p)
+        AddReloc(t, p, RELOC_POINTER);
+}
+
+/* AddReloc - add an entry to the relocation table */
+static void AddReloc(RelocTable *t, void *p, int type)
+{
+    if (t->count >= t->size) {
+        uint32_t size = t->size ? t->size * 2 : 256;
+        uint32_t *entries;
+        if (!(entries = (uint32_t *)realloc(t->entries, size * sizeof(uint32_t)))) {
+            t->ok = VMFALSE;
+            return;
+        }
+        t->entries = entries;
+        t->size = size;
+    }
+    t->entries[t->count++] = ((uint8_t *)p - (uint8_t *)t->image) | type;
+}
+
+#ifdef USE_THREADED_CODE
+
+/* AddCodePointer - add a threaded code cell to the relocation table */
+static void AddCodePointer(void *cookie, VMCELL *cell, int type)
+{
+    AddReloc((RelocTable *)cookie, cell, type);
+}
+
+#endif
+
+/* ToOffsets - replace the host pointers in a copy of an image with offsets
+
+   The copy holds the global segment followed by the heap. */
+static void ToOffsets(ImageHdr *image, uint8_t *copy, const ImageFileHdr *hdr, const uint32_t *relocs, uint32_t count)
+{
+    uint32_t gap = hdr->top - hdr->heapSize - hdr->segmentSize;
+#ifdef USE_THREADED_CODE
+    void **handlers = ThreadedHandlers();
+    uintptr_t op;
+#endif
+    uint32_t i;
+
+    for (i = 0; i < count; ++i) {
+        uint32_t offset = relocs[i] & ~RELOC_TYPE_MASK;
+        uint8_t *p = copy + (offset < hdr->segmentSize ? offset : offset - gap);
+        switch (relocs[i] & RELOC_TYPE_MASK) {
+        case RELOC_POINTER:
+            *(uintptr_t *)p = *(uint8_t **)p - (uint8_t *)image;
+            break;
+#ifdef USE_THREADED_CODE
+        case RELOC_HANDLER:
+            for (op = 0; handlers[op] != ((VMCELL *)p)->handler; ++op)
+                ;
+            ((VMCELL *)p)->handler = (void *)op;
+            break;
+#endif
+        }
+    }
+}
+
+/* ToPointers - replace the offsets in an image with host pointers
+
+   Returns VMFALSE if any entry or offset lies outside of the image. */
+static int ToPointers(ImageHdr *image, const uint32_t *relocs, uint32_t count, uint32_t top)
+{
+#ifdef USE_THREADED_CODE
+    void **handlers = ThreadedHandlers();
+#endif
+    uint32_t i;
+
+    for (i = 0; i < count; ++i) {
+        uint32_t offset = relocs[i] & ~RELOC_TYPE_MASK;
+        uint8_t *p = (uint8_t *)image + offset;
+        if (offset > top - sizeof(void *))
+            return VMFALSE;
+        switch (relocs[i] & RELOC_TYPE_MASK) {
+        case RELOC_POINTER:
+            if (*(uintptr_t *)p > top)
+                return VMFALSE;
+            *(uint8_t **)p = (uint8_t *)image + *(uintptr_t *)p;
+            break;
+#ifdef USE_THREADED_CODE
+        case RELOC_HANDLER:
+            if ((uintptr_t)((VMCELL *)p)->handler > 255)
+                return VMFALSE;
+            ((VMCELL *)p)->handler = handlers[(uintptr_t)((VMCELL *)p)->handler];
+            break;
+#endif
+        default:
+            return VMFALSE;
+        }
+    }
+
+    return VMTRUE;
+}
+
+#endif
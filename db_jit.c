@@ -0,0 +1,791 @@
+/* db_jit.c - translate bytecode functions to native x86-64 code
+ *
+ * Copyright (c) 2014 by David Michael Betz.  All rights reserved.
+ *
+ */
+
+#include <stdio.h>
+#include <stddef.h>
+#include <string.h>
+#include "db_vm.h"
+
+#ifdef USE_JIT
+
+#include <sys/mman.h>
+
+#ifndef __x86_64__
+#error USE_JIT requires an x86-64 host
+#endif
+#ifndef USE_STACK_DEPTH
+#error USE_JIT requires USE_STACK_DEPTH
+#endif
+#ifndef NATIVE_OPERANDS
+#error USE_JIT requires NATIVE_OPERANDS
+#endif
+#ifdef USE_THREADED_CODE
+#error USE_JIT requires the bytecode interpreter
+#endif
+
+/* The native code is made by pasting together a fixed template for each
+   bytecode instruction.  The interpreter registers live in callee-saved
+   machine registers so they survive calls to the C runtime helpers:
+
+     rbx    sp
+     r12    fp
+     r13d   tos
+     r14    interpreter state
+     r15    base of the native code region
+     rbp    image header (the base of VM addresses)
+
+   Frames are laid out exactly as the interpreter lays them out and the return
+   address in each frame is still the bytecode address following the CALL so
+   native and bytecode functions can call each other in either direction.
+
+   A translated function is entered through a stub in the image containing an
+   OP_NATIVE instruction whose operand is the offset of the native code from
+   the start of the region.  The stub replaces the function's code address
+   and also records where the bytecode is so that the function can be
+   translated again when a saved image is loaded.
+
+   With tiered execution functions are only translated once they get hot and
+   keep their bytecode address.  The tier field of the profile in front of
+   the bytecode holds the offset of the native code instead of a stub. */
+
+/* machine registers */
+enum {
+    RAX, RCX, RDX, RBX, RSP, RBP, RSI, RDI,
+    R8, R9, R10, R11, R12, R13, R14, R15
+};
+
+/* VM registers */
+#define SP          RBX
+#define FP          R12
+#define TOS         R13
+#define STATE       R14
+#define BASE        R15
+#define IMAGE       RBP
+
+/* condition codes */
+#define CC_NONE     -1
+#define CC_AE       0x3
+#define CC_E        0x4
+#define CC_NE       0x5
+#define CC_L        0xc
+#define CC_GE       0xd
+#define CC_LE       0xe
+#define CC_G        0xf
+
+/* condition codes for OP_LT to OP_GT and OP_BRLT to OP_BRGT */
+static int ccTab[] = { CC_L, CC_LE, CC_E, CC_NE, CC_GE, CC_G };
+
+/* offsets of the fields of an OP_NATIVE stub (the stub is aligned so the
+   operand is at the first aligned offset after the opcode and is followed by
+   the address and size of the bytecode) */
+#define STUB_OPERAND    sizeof(VMVALUE)
+#define STUB_CODE       (STUB_OPERAND + sizeof(VMVALUE))
+#define STUB_CODESIZE   (STUB_CODE + sizeof(VMVALUE))
+#define STUB_SIZE       (STUB_CODESIZE + sizeof(VMVALUE))
+
+/* largest template (the CALL template is the largest) */
+#define MAX_TEMPLATE    128
+
+/* native code buffer */
+typedef struct {
+    ImageHdr *image;        /* image containing the bytecode */
+    uint8_t *start;         /* start of the function */
+    uint8_t *p;             /* next byte to store */
+    uint8_t *top;           /* end of the native code region */
+    const uint8_t *code;    /* bytecode being translated */
+    size_t size;            /* size of the bytecode */
+    int *map;               /* native offset of each bytecode offset */
+    int final;              /* branch targets are known */
+} JitBuf;
+
+/* prototypes for local functions */
+static int InitJit(System *sys);
+static int Translate(JitBuf *b);
+static int Jump(JitBuf *b, int cc, const uint8_t *lc);
+static uint8_t *JumpShort(JitBuf *b, int cc);
+static void PatchShort(JitBuf *b, uint8_t *from);
+static void CallHelper(JitBuf *b, void *fn, int arg);
+static void PushTos(JitBuf *b);
+static void PopReg(JitBuf *b, int r);
+static void Compare(JitBuf *b, int cc);
+static void Divide(JitBuf *b, int result);
+static void LoadImm(JitBuf *b, int r, uint32_t v);
+static void LoadImm64(JitBuf *b, int r, uint64_t v);
+static void AddImm(JitBuf *b, int w, int r, int v);
+static void OpMem(JitBuf *b, int w, int op, int reg, int base, int disp);
+static void OpIndex(JitBuf *b, int w, int op, int reg, int base, int index, int scale);
+static void OpReg(JitBuf *b, int w, int op, int reg, int rm);
+static void Opcode(JitBuf *b, int rex, int op);
+static void Byte(JitBuf *b, int v);
+static void Long(JitBuf *b, uint32_t v);
+
+/* instructions used by the templates */
+#define Load(b, r, base, d)     OpMem(b, 0, 0x8b, r, base, d)       /* mov r32, [base + d] */
+#define Store(b, r, base, d)    OpMem(b, 0, 0x89, r, base, d)       /* mov [base + d], r32 */
+#define Load64(b, r, base, d)   OpMem(b, 1, 0x8b, r, base, d)       /* mov r64, [base + d] */
+#define Store64(b, r, base, d)  OpMem(b, 1, 0x89, r, base, d)       /* mov [base + d], r64 */
+#define Move(b, d, s)           OpReg(b, 0, 0x8b, d, s)             /* mov d32, s32 */
+#define Move64(b, d, s)         OpReg(b, 1, 0x8b, d, s)             /* mov d64, s64 */
+#define Test(b, r)              OpReg(b, 0, 0x85, r, r)             /* test r32, r32 */
+#define Clear(b, r)             OpReg(b, 0, 0x33, r, r)             /* xor r32, r32 */
+#define SetCC(b, cc, r)         OpReg(b, 0, 0x0f90 | (cc), 0, r)    /* setcc r8 */
+#define CallReg(b, r)           OpReg(b, 0, 0xff, 2, r)             /* call r64 */
+#define Push64(b, r)            Opcode(b, (r) & 8 ? 0x41 : 0, 0x50 | ((r) & 7))
+#define Pop64(b, r)             Opcode(b, (r) & 8 ? 0x41 : 0, 0x58 | ((r) & 7))
+#define Ret(b)                  Byte(b, 0xc3)
+
+/* JitTranslate - translate a bytecode function to native code
+
+   Returns the offset of the native code from the start of the region or zero
+   if the function can't be translated and should be left to the interpreter.
+   When loop isn't negative the offset of the native code for the bytecode at
+   that offset is stored in *pEntry. */
+VMVALUE JitTranslate(System *sys, ImageHdr *image, const uint8_t *code, size_t size, int loop, VMVALUE *pEntry)
+{
+    JitBuf b;
+    int ok;
+
+    /* create the native code region the first time through */
+    if (!sys->jitBase && !InitJit(sys))
+        return 0;
+
+    /* setup the code buffer (the offset map goes in the unused top of the region) */
+    b.start = (uint8_t *)(((uintptr_t)sys->jitFree + 15) & ~(uintptr_t)15);
+    b.map = (int *)sys->jitTop - (size + 1);
+    b.top = (uint8_t *)b.map;
+    b.image = image;
+    b.code = code;
+    b.size = size;
+    if (b.top < b.start)
+        return 0;
+
+    /* make the region writable while the function is translated */
+    if (mprotect(sys->jitBase, JITSIZE, PROT_READ | PROT_WRITE) != 0)
+        return 0;
+    memset(b.map, -1, (size + 1) * sizeof(int));
+
+    /* translate once to find the branch targets and again to resolve them */
+    b.final = VMFALSE;
+    if ((ok = Translate(&b)) != VMFALSE) {
+        b.final = VMTRUE;
+        ok = Translate(&b);
+    }
+    mprotect(sys->jitBase, JITSIZE, PROT_READ | PROT_EXEC);
+    if (!ok)
+        return 0;
+    sys->jitFree = b.p;
+
+    /* find the native code for the loop being entered */
+    if (loop >= 0 && loop <= (int)size && b.map[loop] >= 0)
+        *pEntry = b.start - sys->jitBase + b.map[loop];
+
+    /* return the offset of the native code */
+    return b.start - sys->jitBase;
+}
+
+#ifndef USE_TIERS
+
+/* JitCompile - translate a bytecode function to native code
+
+   Returns the address of the stub to use in place of the bytecode or zero if
+   the function can't be translated and should be left to the interpreter. */
+VMVALUE JitCompile(System *sys, ImageHdr *image, const uint8_t *code, size_t size)
+{
+    VMVALUE entry, native;
+    uint8_t *stub;
+
+    /* translate the function and allocate the stub that enters it */
+    if (!(native = JitTranslate(sys, image, code, size, -1, &entry)))
+        return 0;
+    if (!(stub = (uint8_t *)AllocateImageSpace(image, STUB_SIZE)))
+        return 0;
+
+    /* fill in the stub */
+    memset(stub, 0, STUB_SIZE);
+    stub[0] = OP_NATIVE;
+    VMSETCODELONG(stub + STUB_OPERAND, native);
+    VMSETCODELONG(stub + STUB_CODE, VMADDR(image, code));
+    VMSETCODELONG(stub + STUB_CODESIZE, size);
+
+    /* return the stub address */
+    return VMADDR(image, stub);
+}
+
+#ifdef USE_IMAGE_FILES
+
+/* JitRelink - translate the functions of an image loaded from a file again
+
+   The native code isn't saved with an image so each stub is pointed at a new
+   translation of its bytecode.  A function that can't be translated goes
+   back to running its bytecode. */
+void JitRelink(System *sys, ImageHdr *image)
+{
+    VMVALUE entry, native;
+    Symbol *symbol;
+
+    for (symbol = image->globals.head; symbol != NULL; symbol = symbol->next) {
+        if (symbol->storageClass == SC_FUNCTION) {
+            VMVALUE *cell = GlobalCell(image->data, symbol);
+            uint8_t *stub = (uint8_t *)VMPTR(image, *cell);
+            if (*cell != 0 && stub[0] == OP_NATIVE) {
+                VMVALUE code = VMCODELONG(stub + STUB_CODE);
+                VMVALUE size = VMCODELONG(stub + STUB_CODESIZE);
+                if ((native = JitTranslate(sys, image, (uint8_t *)VMPTR(image, code), size, -1, &entry)) != 0)
+                    VMSETCODELONG(stub + STUB_OPERAND, native);
+                else
+                    *cell = code;
+            }
+        }
+    }
+}
+
+#endif
+
+#endif
+
+/* trampoline at the start of the region */
+typedef void Trampoline(Interpreter *i, uint8_t *entry, uint8_t *target);
+
+/* JitEnter - call the native code of a function through the trampoline */
+void JitEnter(Interpreter *i, VMVALUE entry)
+{
+    uint8_t *base = i->sys->jitBase;
+    ((Trampoline *)base)(i, base + entry, NULL);
+}
+
+#ifdef USE_TIERS
+
+/* JitResume - finish the current call in native code starting at entry */
+void JitResume(Interpreter *i, VMVALUE entry)
+{
+    uint8_t *base = i->sys->jitBase;
+    ((Trampoline *)base)(i, base + i->sys->jitResume, base + entry);
+}
+
+#endif
+
+/* FreeJit - release the native code region of a system */
+void FreeJit(System *sys)
+{
+    if (sys->jitBase) {
+        munmap(sys->jitBase, JITSIZE);
+        sys->jitBase = NULL;
+    }
+}
+
+/* InitJit - create the native code region and its trampoline
+
+   The trampoline is called from C as trampoline(i, entry, target).  It saves
+   the callee-saved registers, loads the VM registers from the interpreter
+   state, calls the native code and stores the VM registers back.  Resuming a
+   function calls a thunk that sets up the machine stack the way the function
+   prolog does and jumps to the target. */
+static int InitJit(System *sys)
+{
+    JitBuf b;
+    void *base;
+
+    /* map the region writable while the trampoline is being built */
+    base = mmap(NULL, JITSIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANON, -1, 0);
+    if (base == MAP_FAILED)
+        return VMFALSE;
+    sys->jitBase = (uint8_t *)base;
+    sys->jitTop = sys->jitBase + JITSIZE;
+
+    /* build the trampoline (six pushes and eight more bytes keep the machine
+       stack aligned for the call) */
+    b.p = sys->jitBase;
+    Push64(&b, RBX);
+    Push64(&b, RBP);
+    Push64(&b, R12);
+    Push64(&b, R13);
+    Push64(&b, R14);
+    Push64(&b, R15);
+    AddImm(&b, 1, RSP, -8);
+    Move64(&b, STATE, RDI);
+    Load64(&b, SP, STATE, offsetof(Interpreter, sp));
+    Load64(&b, FP, STATE, offsetof(Interpreter, fp));
+    Load(&b, TOS, STATE, offsetof(Interpreter, tos));
+    Load64(&b, IMAGE, STATE, offsetof(Interpreter, image));
+    LoadImm64(&b, BASE, (uintptr_t)sys->jitBase);
+    CallReg(&b, RSI);
+    Store64(&b, SP, STATE, offsetof(Interpreter, sp));
+    Store64(&b, FP, STATE, offsetof(Interpreter, fp));
+    Store(&b, TOS, STATE, offsetof(Interpreter, tos));
+    AddImm(&b, 1, RSP, 8);
+    Pop64(&b, R15);
+    Pop64(&b, R14);
+    Pop64(&b, R13);
+    Pop64(&b, R12);
+    Pop64(&b, RBP);
+    Pop64(&b, RBX);
+    Ret(&b);
+#ifdef USE_TIERS
+    sys->jitResume = b.p - sys->jitBase;
+    AddImm(&b, 1, RSP, -8);
+    OpReg(&b, 0, 0xff, 4, RDX);                     /* jmp rdx */
+#endif
+    sys->jitFree = b.p;
+
+    /* the region is only writable while a function is being translated */
+    return mprotect(sys->jitBase, JITSIZE, PROT_READ | PROT_EXEC) == 0;
+}
+
+/* Translate - translate the bytecode to native code */
+static int Translate(JitBuf *b)
+{
+    const uint8_t *lc = b->code, *end = b->code + b->size;
+    VMVALUE value;
+    uint8_t *skip, *done;
+    int op, n;
+
+    /* keep the machine stack aligned for calls to the runtime helpers */
+    b->p = b->start;
+    AddImm(b, 1, RSP, -8);
+
+    while (lc < end) {
+
+        /* make sure there is room for the largest template */
+        if (b->p + MAX_TEMPLATE > b->top)
+            return VMFALSE;
+        b->map[lc - b->code] = b->p - b->start;
+
+        switch (op = *lc++) {
+        case OP_BRT:
+        case OP_BRF:
+            Test(b, TOS);
+            PopReg(b, TOS);
+            if (!Jump(b, op == OP_BRT ? CC_NE : CC_E, lc))
+                return VMFALSE;
+            lc = VMOPERAND(lc, sizeof(VMWORD)) + sizeof(VMWORD);
+            break;
+        case OP_BRTSC:
+        case OP_BRFSC:
+            Test(b, TOS);
+            if (!Jump(b, op == OP_BRTSC ? CC_NE : CC_E, lc))
+                return VMFALSE;
+            PopReg(b, TOS);
+            lc = VMOPERAND(lc, sizeof(VMWORD)) + sizeof(VMWORD);
+            break;
+        case OP_BR:
+            if (!Jump(b, CC_NONE, lc))
+                return VMFALSE;
+            lc = VMOPERAND(lc, sizeof(VMWORD)) + sizeof(VMWORD);
+            break;
+        case OP_NOT:
+            Clear(b, RAX);
+            Test(b, TOS);
+            SetCC(b, CC_E, RAX);
+            Move(b, TOS, RAX);
+            break;
+        case OP_NEG:
+            OpReg(b, 0, 0xf7, 3, TOS);                  /* neg r13d */
+            break;
+        case OP_ADD:
+            OpMem(b, 0, 0x03, TOS, SP, 0);              /* add r13d, [rbx] */
+            AddImm(b, 1, SP, sizeof(VMVALUE));
+            break;
+        case OP_SUB:
+            PopReg(b, RAX);
+            OpReg(b, 0, 0x2b, RAX, TOS);                /* sub eax, r13d */
+            Move(b, TOS, RAX);
+            break;
+        case OP_MUL:
+            OpMem(b, 0, 0x0faf, TOS, SP, 0);            /* imul r13d, [rbx] */
+            AddImm(b, 1, SP, sizeof(VMVALUE));
+            break;
+        case OP_DIV:
+            Divide(b, RAX);
+            break;
+        case OP_REM:
+            Divide(b, RDX);
+            break;
+        case OP_BNOT:
+            OpReg(b, 0, 0xf7, 2, TOS);                  /* not r13d */
+            break;
+        case OP_BAND:
+            OpMem(b, 0, 0x23, TOS, SP, 0);              /* and r13d, [rbx] */
+            AddImm(b, 1, SP, sizeof(VMVALUE));
+            break;
+        case OP_BOR:
+            OpMem(b, 0, 0x0b, TOS, SP, 0);              /* or r13d, [rbx] */
+            AddImm(b, 1, SP, sizeof(VMVALUE));
+            break;
+        case OP_BXOR:
+            OpMem(b, 0, 0x33, TOS, SP, 0);              /* xor r13d, [rbx] */
+            AddImm(b, 1, SP, sizeof(VMVALUE));
+            break;
+        case OP_SHL:
+        case OP_SHR:
+            Move(b, RCX, TOS);
+            PopReg(b, TOS);
+            OpReg(b, 0, 0xd3, op == OP_SHL ? 4 : 7, TOS); /* shl/sar r13d, cl */
+            break;
+        case OP_LT:
+        case OP_LE:
+        case OP_EQ:
+        case OP_NE:
+        case OP_GE:
+        case OP_GT:
+            Compare(b, ccTab[op - OP_LT]);
+            break;
+        case OP_LIT:
+            lc = VMOPERAND(lc, sizeof(VMVALUE));
+            value = VMCODELONG(lc);
+            lc += sizeof(VMVALUE);
+            PushTos(b);
+            LoadImm(b, TOS, value);
+            break;
+        case OP_SLIT:
+            PushTos(b);
+            LoadImm(b, TOS, (int8_t)*lc++);
+            break;
+        case OP_GADDR:
+            lc = VMOPERAND(lc, sizeof(VMVALUE));
+            value = VMCODELONG(lc);
+            lc += sizeof(VMVALUE);
+            PushTos(b);
+            Load64(b, TOS, STATE, offsetof(Interpreter, globals));
+            OpReg(b, 0, 0x2b, TOS, IMAGE);              /* sub r13d, ebp */
+            AddImm(b, 0, TOS, value);
+            break;
+        case OP_LOAD:
+            OpIndex(b, 0, 0x8b, TOS, IMAGE, TOS, 0);    /* mov r13d, [rbp + r13] */
+            break;
+        case OP_LOADB:
+            OpIndex(b, 0, 0x0fb6, TOS, IMAGE, TOS, 0);  /* movzx r13d, byte [rbp + r13] */
+            break;
+        case OP_STORE:
+            PopReg(b, RAX);
+            OpIndex(b, 0, 0x89, TOS, IMAGE, RAX, 0);    /* mov [rbp + rax], r13d */
+            break;
+        case OP_STOREB:
+            PopReg(b, RAX);
+            OpIndex(b, 0, 0x88, TOS, IMAGE, RAX, 0);    /* mov [rbp + rax], r13b */
+            break;
+        case OP_LADDR:
+            PushTos(b);
+            OpMem(b, 0, 0x8d, TOS, FP, (int8_t)*lc++ * (int)sizeof(VMVALUE)); /* lea r13d, [r12 + n * 4] */
+            OpReg(b, 0, 0x2b, TOS, IMAGE);              /* sub r13d, ebp */
+            break;
+        case OP_INDEX:
+            PopReg(b, RAX);
+            OpIndex(b, 0, 0x8d, TOS, RAX, TOS, 2);      /* lea r13d, [rax + r13 * 4] */
+            break;
+        case OP_CALL:
+
+            /* the function is in tos and is replaced by the return address */
+            n = *lc++;
+            Move(b, RAX, TOS);
+            OpReg(b, 1, 0x03, RAX, IMAGE);              /* add rax, rbp */
+
+            /* call native functions directly */
+#ifdef USE_TIERS
+            OpMem(b, 1, 0x8d, RCX, RAX, -(int)sizeof(Profile)); /* lea rcx, [rax - sizeof(Profile)] */
+            OpReg(b, 1, 0x83, 4, RCX);                  /* and rcx, ~ALIGN_MASK */
+            Byte(b, ~ALIGN_MASK);
+            Load(b, RCX, RCX, offsetof(Profile, tier));
+            Test(b, RCX);
+            skip = JumpShort(b, CC_LE);
+            LoadImm(b, TOS, VMADDR(b->image, lc));
+#else
+            OpMem(b, 0, 0x80, 7, RAX, 0);               /* cmp byte [rax], OP_NATIVE */
+            Byte(b, OP_NATIVE);
+            skip = JumpShort(b, CC_NE);
+            LoadImm(b, TOS, VMADDR(b->image, lc));
+            Load(b, RCX, RAX, STUB_OPERAND);
+#endif
+            OpReg(b, 1, 0x03, RCX, BASE);               /* add rcx, r15 */
+            CallReg(b, RCX);
+            done = JumpShort(b, CC_NONE);
+
+            /* let the interpreter run bytecode functions */
+            PatchShort(b, skip);
+            CallHelper(b, (void *)CallBytecode, n);
+            PatchShort(b, done);
+            break;
+        case OP_FRAME:
+
+            /* check the stack for the whole frame and the maximum stack depth */
+            n = *lc++;
+            value = n + *lc++;
+            Move(b, RAX, FP);
+            OpReg(b, 0, 0x2b, RAX, IMAGE);              /* sub eax, ebp */
+            Move64(b, FP, SP);
+            OpMem(b, 1, 0x8d, RCX, SP, -value * (int)sizeof(VMVALUE)); /* lea rcx, [rbx - depth * 4] */
+            OpMem(b, 1, 0x3b, RCX, STATE, offsetof(Interpreter, stack)); /* cmp rcx, [r14 + stack] */
+            skip = JumpShort(b, CC_AE);
+            CallHelper(b, (void *)CallStackOverflow, 0);
+            PatchShort(b, skip);
+
+            /* build the frame */
+            AddImm(b, 1, SP, -n * (int)sizeof(VMVALUE));
+            Store(b, RAX, FP, -1 * (int)sizeof(VMVALUE));
+            Store(b, TOS, FP, -2 * (int)sizeof(VMVALUE));
+#ifdef USE_TIERS
+            LoadImm(b, RAX, VMADDR(b->image, CodeProfile(b->code)));
+            Store(b, RAX, FP, -3 * (int)sizeof(VMVALUE));
+#endif
+            break;
+        case OP_RETURN:
+
+            /* the argument count is just before the return address */
+            Load(b, RAX, FP, -2 * (int)sizeof(VMVALUE));
+            OpReg(b, 1, 0x03, RAX, IMAGE);              /* add rax, rbp */
+            OpMem(b, 0, 0x0fb6, RCX, RAX, -1);          /* movzx ecx, byte [rax - 1] */
+            OpIndex(b, 1, 0x8d, SP, FP, RCX, 2);        /* lea rbx, [r12 + rcx * 4] */
+            Load(b, FP, FP, -1 * (int)sizeof(VMVALUE));
+            OpReg(b, 1, 0x03, FP, IMAGE);               /* add r12, rbp */
+            AddImm(b, 1, RSP, 8);
+            Ret(b);
+            break;
+        case OP_DROP:
+            PopReg(b, TOS);
+            break;
+        case OP_DUP:
+            PushTos(b);
+            break;
+        case OP_TUCK:
+            Load(b, RAX, SP, 0);
+            AddImm(b, 1, SP, -(int)sizeof(VMVALUE));
+            Store(b, RAX, SP, 0);
+            Store(b, TOS, SP, sizeof(VMVALUE));
+            break;
+        case OP_TRAP:
+            CallHelper(b, (void *)CallTrap, *lc++);
+            break;
+        case OP_LLOAD:
+            PushTos(b);
+            Load(b, TOS, FP, (int8_t)*lc++ * (int)sizeof(VMVALUE));
+            break;
+        case OP_LSTORE:
+            Store(b, TOS, FP, (int8_t)*lc++ * (int)sizeof(VMVALUE));
+            break;
+        case OP_GLOAD:
+            lc = VMOPERAND(lc, sizeof(VMVALUE));
+            value = VMCODELONG(lc);
+            lc += sizeof(VMVALUE);
+            PushTos(b);
+            Load64(b, RAX, STATE, offsetof(Interpreter, globals));
+            Load(b, TOS, RAX, value);                   /* mov r13d, [rax + value] */
+            break;
+        case OP_GSTORE:
+            lc = VMOPERAND(lc, sizeof(VMVALUE));
+            value = VMCODELONG(lc);
+            lc += sizeof(VMVALUE);
+            Load64(b, RAX, STATE, offsetof(Interpreter, globals));
+            Store(b, TOS, RAX, value);                  /* mov [rax + value], r13d */
+            break;
+        case OP_ADDI:
+            AddImm(b, 0, TOS, (int8_t)*lc++);
+            break;
+        case OP_BRLT:
+        case OP_BRLE:
+        case OP_BREQ:
+        case OP_BRNE:
+        case OP_BRGE:
+        case OP_BRGT:
+            Load(b, RAX, SP, 0);
+            OpReg(b, 0, 0x3b, RAX, TOS);                /* cmp eax, r13d */
+            Load(b, TOS, SP, sizeof(VMVALUE));
+            OpMem(b, 1, 0x8d, SP, SP, 2 * sizeof(VMVALUE)); /* lea rbx, [rbx + 8] (leaves the flags) */
+            if (!Jump(b, ccTab[op - OP_BRLT], lc))
+                return VMFALSE;
+            lc = VMOPERAND(lc, sizeof(VMWORD)) + sizeof(VMWORD);
+            break;
+        default:
+            /* leave anything else to the interpreter */
+            return VMFALSE;
+        }
+    }
+    b->map[b->size] = b->p - b->start;
+
+    /* return successfully */
+    return VMTRUE;
+}
+
+/* Jump - jump to the target of the branch instruction whose operand is at lc */
+static int Jump(JitBuf *b, int cc, const uint8_t *lc)
+{
+    int offset;
+
+    /* find the bytecode offset of the target */
+    lc = VMOPERAND(lc, sizeof(VMWORD));
+    offset = lc + sizeof(VMWORD) + VMCODEWORD(lc) - b->code;
+    if (offset < 0 || offset > (int)b->size || (b->final && b->map[offset] < 0))
+        return VMFALSE;
+
+    /* emit a jump with a 32 bit displacement (the target is unknown on the first pass) */
+    if (cc == CC_NONE)
+        Byte(b, 0xe9);
+    else {
+        Byte(b, 0x0f);
+        Byte(b, 0x80 | cc);
+    }
+    Long(b, b->map[offset] - (b->p + sizeof(uint32_t) - b->start));
+    return VMTRUE;
+}
+
+/* JumpShort - emit a short forward jump to be patched by PatchShort */
+static uint8_t *JumpShort(JitBuf *b, int cc)
+{
+    Byte(b, cc == CC_NONE ? 0xeb : 0x70 | cc);
+    Byte(b, 0);
+    return b->p;
+}
+
+/* PatchShort - point a short jump at the current location */
+static void PatchShort(JitBuf *b, uint8_t *from)
+{
+    from[-1] = (uint8_t)(b->p - from);
+}
+
+/* CallHelper - call a runtime helper as helper(i, arg) with the VM registers in the state */
+static void CallHelper(JitBuf *b, void *fn, int arg)
+{
+    Store64(b, SP, STATE, offsetof(Interpreter, sp));
+    Store64(b, FP, STATE, offsetof(Interpreter, fp));
+    Store(b, TOS, STATE, offsetof(Interpreter, tos));
+    Move64(b, RDI, STATE);
+    LoadImm(b, RSI, arg);
+    LoadImm64(b, RAX, (uintptr_t)fn);
+    CallReg(b, RAX);
+    Load64(b, SP, STATE, offsetof(Interpreter, sp));
+    Load64(b, FP, STATE, offsetof(Interpreter, fp));
+    Load(b, TOS, STATE, offsetof(Interpreter, tos));
+}
+
+/* PushTos - push the cached top of stack onto the VM stack */
+static void PushTos(JitBuf *b)
+{
+    AddImm(b, 1, SP, -(int)sizeof(VMVALUE));
+    Store(b, TOS, SP, 0);
+}
+
+/* PopReg - pop the VM stack into a register */
+static void PopReg(JitBuf *b, int r)
+{
+    Load(b, r, SP, 0);
+    OpMem(b, 1, 0x8d, SP, SP, sizeof(VMVALUE));     /* lea rbx, [rbx + 4] (leaves the flags) */
+}
+
+/* Compare - replace tos with the result of comparing the next value with it */
+static void Compare(JitBuf *b, int cc)
+{
+    PopReg(b, RCX);
+    Clear(b, RAX);
+    OpReg(b, 0, 0x3b, RCX, TOS);                    /* cmp ecx, r13d */
+    SetCC(b, cc, RAX);
+    Move(b, TOS, RAX);
+}
+
+/* Divide - replace tos with the quotient (eax) or remainder (edx) of the next value and tos */
+static void Divide(JitBuf *b, int result)
+{
+    uint8_t *skip;
+    PopReg(b, RAX);
+    Test(b, TOS);
+    skip = JumpShort(b, CC_E);                      /* dividing by zero gives zero */
+    Byte(b, 0x99);                                  /* cdq */
+    OpReg(b, 0, 0xf7, 7, TOS);                      /* idiv r13d */
+    Move(b, TOS, result);
+    PatchShort(b, skip);
+}
+
+/* LoadImm - load a 32 bit immediate value into a register */
+static void LoadImm(JitBuf *b, int r, uint32_t v)
+{
+    Opcode(b, r & 8 ? 0x41 : 0, 0xb8 | (r & 7));
+    Long(b, v);
+}
+
+/* LoadImm64 - load a 64 bit immediate value into a register */
+static void LoadImm64(JitBuf *b, int r, uint64_t v)
+{
+    Opcode(b, r & 8 ? 0x49 : 0x48, 0xb8 | (r & 7));
+    Long(b, (uint32_t)v);
+    Long(b, (uint32_t)(v >> 32));
+}
+
+/* AddImm - add an immediate value to a 32 or 64 bit register */
+static void AddImm(JitBuf *b, int w, int r, int v)
+{
+    if (v >= -128 && v <= 127) {
+        OpReg(b, w, 0x83, 0, r);
+        Byte(b, v);
+    }
+    else {
+        OpReg(b, w, 0x81, 0, r);
+        Long(b, v);
+    }
+}
+
+/* OpMem - emit an instruction with a register and a [base + disp] operand */
+static void OpMem(JitBuf *b, int w, int op, int reg, int base, int disp)
+{
+    int mod;
+    Opcode(b, 0x40 | (w ? 8 : 0) | (reg & 8 ? 4 : 0) | (base & 8 ? 1 : 0), op);
+    if (disp == 0 && (base & 7) != RBP)
+        mod = 0;
+    else if (disp >= -128 && disp <= 127)
+        mod = 1;
+    else
+        mod = 2;
+    Byte(b, (mod << 6) | ((reg & 7) << 3) | (base & 7));
+    if ((base & 7) == RSP)
+        Byte(b, 0x24);
+    if (mod == 1)
+        Byte(b, disp);
+    else if (mod == 2)
+        Long(b, disp);
+}
+
+/* OpIndex - emit an instruction with a register and a [base + index << scale] operand */
+static void OpIndex(JitBuf *b, int w, int op, int reg, int base, int index, int scale)
+{
+    Opcode(b, 0x40 | (w ? 8 : 0) | (reg & 8 ? 4 : 0) | (index & 8 ? 2 : 0) | (base & 8 ? 1 : 0), op);
+    if ((base & 7) == RBP) {
+        Byte(b, 0x44 | ((reg & 7) << 3));
+        Byte(b, (scale << 6) | ((index & 7) << 3) | (base & 7));
+        Byte(b, 0);
+    }
+    else {
+        Byte(b, 0x04 | ((reg & 7) << 3));
+        Byte(b, (scale << 6) | ((index & 7) << 3) | (base & 7));
+    }
+}
+
+/* OpReg - emit an instruction with two register operands (or an opcode extension and a register) */
+static void OpReg(JitBuf *b, int w, int op, int reg, int rm)
+{
+    Opcode(b, 0x40 | (w ? 8 : 0) | (reg & 8 ? 4 : 0) | (rm & 8 ? 1 : 0), op);
+    Byte(b, 0xc0 | ((reg & 7) << 3) | (rm & 7));
+}
+
+/* Opcode - emit a REX prefix (unless it is empty) and a one or two byte opcode */
+static void Opcode(JitBuf *b, int rex, int op)
+{
+    if (rex && rex != 0x40)
+        Byte(b, rex);
+    if (op > 0xff)
+        Byte(b, op >> 8);
+    Byte(b, op);
+}
+
+/* Byte - emit a byte */
+static void Byte(JitBuf *b, int v)
+{
+    *b->p++ = (uint8_t)v;
+}
+
+/* Long - emit a 32 bit value */
+static void Long(JitBuf *b, uint32_t v)
+{
+    memcpy(b->p, &v, sizeof(v));
+    b->p += sizeof(v);
+}
+
+#endif
@@ -1,518 +1,669 @@
-/* db_scan.c - token scanner
- *
- * Copyright (c) 2014 by David Michael Betz.  All rights reserved.
- *
- */
-
-#include <stdio.h>
-#include <stdlib.h>
-#include <stdarg.h>
-#include <string.h>
-#include <setjmp.h>
-#include <ctype.h>
-#include "db_compiler.h"
-
-/* keyword table */
-static struct {
-    char *keyword;
-    int token;
-} ktab[] = {
-
-/* these must be in the same order as the int enum */
-{   "def",      T_DEF       },
-{   "var",      T_VAR       },
-{   "if",       T_IF        },
-{   "else",     T_ELSE      },
-{   "for",      T_FOR       },
-{   "do",       T_DO        },
-{   "while",    T_WHILE     },
-{   "continue", T_CONTINUE  },
-{   "break",    T_BREAK     },
-{   "goto",     T_GOTO      },
-{   "return",   T_RETURN    },
-{   "print",    T_PRINT     },
-#ifdef USE_ASM
-{   "asm",      T_ASM       },
-#endif
-{   NULL,       0           }
-};
-
-/* special no-identifier tokens */
-static char *ttab[] = {
-"<=",
-"==",
-"!=",
-">=",
-"<<",
-">>",
-"&&",
-"||",
-"++",
-"--",
-"+=",
-"-=",
-"*=",
-"/=",
-"%=",
-"&=",
-"|=",
-"^=",
-"<<=",
-">>=",
-"<identifier>",
-"<integer>",
-"<string>",
-"<eol>",
-"<eof>"
-};
-
-/* local function prototypes */
-static int NextToken(ParseContext *c);
-static int IdentifierToken(ParseContext *c, int ch);
-static int IdentifierCharP(int ch);
-static int NumberToken(ParseContext *c, int ch);
-static int HexNumberToken(ParseContext *c);
-static int BinaryNumberToken(ParseContext *c);
-static int StringToken(ParseContext *c);
-static int CharToken(ParseContext *c);
-static int LiteralChar(ParseContext *c);
-
-/* FRequire - fetch a token and check it */
-void FRequire(ParseContext *c, int requiredToken)
-{
-    Require(c, GetToken(c), requiredToken);
-}
-
-/* Require - check for a required token */
-void Require(ParseContext *c, int token, int requiredToken)
-{
-    char tknbuf[MAXTOKEN];
-    if (token != requiredToken) {
-        strcpy(tknbuf, TokenName(requiredToken));
-        ParseError(c, "Expecting '%s', found '%s'", tknbuf, TokenName(token));
-    }
-}
-
-/* GetToken - get the next token */
-int GetToken(ParseContext *c)
-{
-    int tkn;
-
-    /* check for a saved token */
-    if ((tkn = c->savedToken) != T_NONE)
-        c->savedToken = T_NONE;
-
-    /* otherwise, get the next token */
-    else
-        tkn = NextToken(c);
-
-    /* return the token */
-    return tkn;
-}
-
-/* SaveToken - save a token */
-void SaveToken(ParseContext *c, int token)
-{
-    c->savedToken = token;
-}
-
-/* TokenName - get the name of a token */
-char *TokenName(int token)
-{
-    char *name;
-    
-    if (token < _T_FIRST_KEYWORD) {
-        static char nameBuf[4];
-        nameBuf[0] = '\'';
-        nameBuf[1] = token;
-        nameBuf[2] = '\'';
-        nameBuf[3] = '\0';
-        name = nameBuf;
-    }
-    else if (token < _T_NON_KEYWORDS)
-        name = ktab[token - _T_FIRST_KEYWORD].keyword;
-    else if (token < _T_MAX)
-        name = ttab[token - _T_NON_KEYWORDS];
-    else
-        name = "<invalid>";
-        
-    /* return the token name */
-    return name;
-}
-
-/* NextToken - read the next token */
-static int NextToken(ParseContext *c)
-{
-    int tkn = T_NONE;
-    int ch, ch2;
-    
-again:
-    /* skip leading blanks */
-    ch = SkipSpaces(c);
-
-    /* remember the start of the current token */
-    c->tokenOffset = (int)(c->sys->linePtr - c->sys->lineBuf);
-
-    /* check the next character */
-    switch (ch) {
-    case EOF:
-        tkn = T_EOL;
-        break;
-    case '"':
-        tkn = StringToken(c);
-        break;
-    case '\'':
-        tkn = CharToken(c);
-        break;
-    case '<':
-        switch (ch = GetChar(c)) {
-        case '=':
-            return T_LE;
-        case '<':
-            if ((ch = GetChar(c)) == '=')
-                return T_SHLEQ;
-            UngetC(c);
-            return T_SHL;
-        default:
-            UngetC(c);
-            return '<';
-        }
-    case '=':
-        if ((ch = GetChar(c)) == '=')
-            return T_EQ;
-        else {
-            UngetC(c);
-            return '=';
-        }
-        break;
-    case '!':
-        if ((ch = GetChar(c)) == '=')
-            tkn = T_NE;
-        else {
-            UngetC(c);
-            tkn = '!';
-        }
-        break;
-    case '>':
-       switch (ch = GetChar(c)) {
-        case '=':
-            return T_GE;
-        case '>':
-            if ((ch = GetChar(c)) == '=')
-                return T_SHREQ;
-            UngetC(c);
-            return T_SHR;
-        default:
-            UngetC(c);
-            return '>';
-        }
-    case '&':
-        switch (ch = GetChar(c)) {
-        case '&':
-            return T_AND;
-        case '=':
-            return T_ANDEQ;
-        default:
-            UngetC(c);
-            return '&';
-        }
-    case '|':
-        switch (ch = GetChar(c)) {
-        case '|':
-            return T_OR;
-        case '=':
-            return T_OREQ;
-        default:
-            UngetC(c);
-            return '|';
-        }
-    case '^':
-        if ((ch = GetChar(c)) == '=')
-            return T_XOREQ;
-        UngetC(c);
-        return '^';
-    case '+':
-        switch (ch = GetChar(c)) {
-        case '+':
-            return T_INC;
-        case '=':
-            return T_ADDEQ;
-        default:
-            UngetC(c);
-            return '+';
-        }
-    case '-':
-        switch (ch = GetChar(c)) {
-        case '-':
-            return T_DEC;
-        case '=':
-            return T_SUBEQ;
-        default:
-            UngetC(c);
-            return '-';
-        }
-    case '*':
-        if ((ch = GetChar(c)) == '=')
-            return T_MULEQ;
-        UngetC(c);
-        return '*';
-    case '/':
-        switch (ch = GetChar(c)) {
-        case '=':
-            return T_DIVEQ;
-        case '/':
-            while ((ch = GetChar(c)) != EOF)
-                if (ch == '\n')
-                    goto again;
-            break;
-        case '*':
-            ch = ch2 = EOF;
-            for (; (ch2 = GetChar(c)) != EOF; ch = ch2)
-                if (ch == '*' && ch2 == '/')
-                    goto again;
-            break;
-        default:
-            UngetC(c);
-            return '/';
-        }
-        break;
-    case '0':
-        switch (GetChar(c)) {
-        case 'x':
-        case 'X':
-            tkn = HexNumberToken(c);
-            break;
-        case 'b':
-        case 'B':
-            tkn = BinaryNumberToken(c);
-            break;
-        default:
-            UngetC(c);
-            tkn = NumberToken(c, '0');
-            break;
-        }
-        break;
-    default:
-        if (isdigit(ch))
-            tkn = NumberToken(c, ch);
-        else if (IdentifierCharP(ch))
-            tkn = IdentifierToken(c,ch);
-        else
-            tkn = ch;
-    }
-
-    /* return the token */
-    return tkn;
-}
-
-/* IdentifierToken - get an identifier */
-static int IdentifierToken(ParseContext *c, int ch)
-{
-    int len, i;
-    char *p;
-
-    /* get the identifier */
-    p = c->token; *p++ = ch; len = 1;
-    while ((ch = GetChar(c)) != EOF && IdentifierCharP(ch)) {
-        if (++len > MAXTOKEN)
-            ParseError(c, "Identifier too long");
-        *p++ = ch;
-    }
-    UngetC(c);
-    *p = '\0';
-
-    /* check to see if it is a keyword */
-    for (i = 0; ktab[i].keyword != NULL; ++i)
-        if (strcmp(ktab[i].keyword, c->token) == 0)
-            return ktab[i].token;
-
-    /* otherwise, it is an identifier */
-    return T_IDENTIFIER;
-}
-
-/* IdentifierCharP - is this an identifier character? */
-static int IdentifierCharP(int ch)
-{
-    return isupper(ch)
-        || islower(ch)
-        || isdigit(ch)
-        || ch == '_';
-}
-
-/* NumberToken - get a number */
-static int NumberToken(ParseContext *c, int ch)
-{
-    char *p = c->token;
-
-    /* get the number */
-    *p++ = ch;
-    while ((ch = GetChar(c)) != EOF) {
-        if (isdigit(ch))
-            *p++ = ch;
-        else if (ch != '_')
-            break;
-    }
-    UngetC(c);
-    *p = '\0';
-    
-    /* convert the string to an integer */
-    c->value = (VMVALUE)atol(c->token);
-    
-    /* return the token */
-    return T_NUMBER;
-}
-
-/* HexNumberToken - get a hexadecimal number */
-static int HexNumberToken(ParseContext *c)
-{
-    char *p = c->token;
-    int ch;
-
-    /* get the number */
-    while ((ch = GetChar(c)) != EOF) {
-        if (isxdigit(ch))
-            *p++ = ch;
-        else if (ch != '_')
-            break;
-    }
-    UngetC(c);
-    *p = '\0';
-    
-    /* convert the string to an integer */
-    c->value = (VMVALUE)strtoul(c->token, NULL, 16);
-    
-    /* return the token */
-    return T_NUMBER;
-}
-
-/* BinaryNumberToken - get a binary number */
-static int BinaryNumberToken(ParseContext *c)
-{
-    char *p = c->token;
-    int ch;
-
-    /* get the number */
-    while ((ch = GetChar(c)) != EOF) {
-        if (ch == '0' || ch == '1')
-            *p++ = ch;
-        else if (ch != '_')
-            break;
-    }
-    UngetC(c);
-    *p = '\0';
-    
-    /* convert the string to an integer */
-    c->value = (VMVALUE)strtoul(c->token, NULL, 2);
-    
-    /* return the token */
-    return T_NUMBER;
-}
-
-/* StringToken - get a string */
-static int StringToken(ParseContext *c)
-{
-    int ch,len;
-    char *p;
-
-    /* collect the string */
-    p = c->token; len = 0;
-    while ((ch = GetChar(c)) != EOF && ch != '"') {
-        if (++len > MAXTOKEN)
-            ParseError(c, "String too long");
-        *p++ = (ch == '\\' ? LiteralChar(c) : ch);
-    }
-    *p = '\0';
-
-    /* check for premature end of file */
-    if (ch != '"')
-        ParseError(c, "unterminated string");
-
-    /* return the token */
-    return T_STRING;
-}
-
-/* CharToken - get a character constant */
-static int CharToken(ParseContext *c)
-{
-    int ch = LiteralChar(c);
-    if (GetChar(c) != '\'')
-        ParseError(c,"Expecting a closing single quote");
-    c->token[0] = ch;
-    c->token[1] = '\0';
-    c->value = ch;
-    return T_NUMBER;
-}
-
-/* LiteralChar - get a character from a literal string */
-static int LiteralChar(ParseContext *c)
-{
-    int ch;
-    switch (ch = GetChar(c)) {
-    case 'n': 
-        ch = '\n';
-        break;
-    case 'r':
-        ch = '\r';
-        break;
-    case 't':
-        ch = '\t';
-        break;
-    case EOF:
-        ch = '\\';
-        break;
-    }
-    return ch;
-}
-
-/* SkipSpaces - skip leading spaces and the the next non-blank character */
-int SkipSpaces(ParseContext *c)
-{
-    int ch;
-    while ((ch = GetChar(c)) != EOF)
-        if (!isspace(ch))
-            break;
-    return ch;
-}
-
-/* GetChar - get the next character */
-int GetChar(ParseContext *c)
-{
-    int ch;
-    
-    /* get the next character on the current line */
-    while (!(ch = *c->sys->linePtr++)) {
-        if (!GetLine(c->sys))
-            return EOF;
-    }
-    
-    /* return the character */
-    return ch;
-}
-
-/* UngetC - unget the most recent character */
-void UngetC(ParseContext *c)
-{
-    /* backup the input pointer */
-    --c->sys->linePtr;
-}
-
-/* ParseError - report a parsing error */
-void ParseError(ParseContext *c, char *fmt, ...)
-{
-    va_list ap;
-
-    /* print the error message */
-    va_start(ap, fmt);
-    VM_printf("error: ");
-    VM_vprintf(fmt, ap);
-    VM_putchar('\n');
-    va_end(ap);
-
-    /* show the context */
-    VM_printf("  line %d\n", c->lineNumber);
-    VM_printf("    %s\n", c->sys->lineBuf);
-    VM_printf("    %*s\n", c->tokenOffset, "^");
-
-    /* exit until we fix the compiler so it can recover from parse errors */
-    longjmp(c->sys->errorTarget, 1);
-}
+/* db_scan.c - token scanner
+ *
+ * Copyright (c) 2014 by David Michael Betz.  All rights reserved.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <setjmp.h>
+#include <ctype.h>
+#include "db_compiler.h"
+
+/* vector operations for skipping runs of characters in a source scanned in
+   place (a block at a time using aligned loads so a load never crosses into
+   the page after the zero byte at the end of the source) */
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define SCAN_BLOCK          32
+#define SCAN_ALL            0xffffffffu
+typedef __m256i ScanVec;
+#define ScanLoad(p)         _mm256_load_si256((const __m256i *)(p))
+#define ScanSet(ch)         _mm256_set1_epi8(ch)
+#define ScanEq(a, b)        _mm256_cmpeq_epi8(a, b)
+#define ScanGt(a, b)        _mm256_cmpgt_epi8(a, b)
+#define ScanAnd(a, b)       _mm256_and_si256(a, b)
+#define ScanOr(a, b)        _mm256_or_si256(a, b)
+#define ScanMask(a)         ((uint32_t)_mm256_movemask_epi8(a))
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#define SCAN_BLOCK          16
+#define SCAN_ALL            0xffffu
+typedef __m128i ScanVec;
+#define ScanLoad(p)         _mm_load_si128((const __m128i *)(p))
+#define ScanSet(ch)         _mm_set1_epi8(ch)
+#define ScanEq(a, b)        _mm_cmpeq_epi8(a, b)
+#define ScanGt(a, b)        _mm_cmpgt_epi8(a, b)
+#define ScanAnd(a, b)       _mm_and_si128(a, b)
+#define ScanOr(a, b)        _mm_or_si128(a, b)
+#define ScanMask(a)         ((uint32_t)_mm_movemask_epi8(a))
+#endif
+
+/* keyword table */
+static struct {
+    char *keyword;
+    int token;
+} ktab[] = {
+
+/* these must be in the same order as the int enum (and KeywordToken must
+   know about each of them) */
+{   "def",      T_DEF       },
+{   "var",      T_VAR       },
+{   "if",       T_IF        },
+{   "else",     T_ELSE      },
+{   "for",      T_FOR       },
+{   "do",       T_DO        },
+{   "while",    T_WHILE     },
+{   "continue", T_CONTINUE  },
+{   "break",    T_BREAK     },
+{   "goto",     T_GOTO      },
+{   "return",   T_RETURN    },
+{   "print",    T_PRINT     },
+#ifdef USE_ASM
+{   "asm",      T_ASM       },
+#endif
+{   NULL,       0           }
+};
+
+/* special no-identifier tokens */
+static char *ttab[] = {
+"<=",
+"==",
+"!=",
+">=",
+"<<",
+">>",
+"&&",
+"||",
+"++",
+"--",
+"+=",
+"-=",
+"*=",
+"/=",
+"%=",
+"&=",
+"|=",
+"^=",
+"<<=",
+">>=",
+"<identifier>",
+"<integer>",
+"<string>",
+"<eol>",
+"<eof>"
+};
+
+/* local function prototypes */
+static int NextToken(ParseContext *c);
+static int IdentifierToken(ParseContext *c, int ch);
+static int KeywordToken(const char *name, int len);
+static int IdentifierCharP(int ch);
+static int NumberToken(ParseContext *c, int ch);
+static int HexNumberToken(ParseContext *c);
+static int BinaryNumberToken(ParseContext *c);
+static int StringToken(ParseContext *c);
+static int CharToken(ParseContext *c);
+static int LiteralChar(ParseContext *c);
+static void ShowErrorLine(ParseContext *c);
+static char *SkipBlanks(char *p);
+static char *FindChar(char *p, int ch);
+
+/* FRequire - fetch a token and check it */
+void FRequire(ParseContext *c, int requiredToken)
+{
+    Require(c, GetToken(c), requiredToken);
+}
+
+/* Require - check for a required token */
+void Require(ParseContext *c, int token, int requiredToken)
+{
+    char requiredBuf[4], tokenBuf[4];
+    if (token != requiredToken)
+        ParseError(c, "Expecting '%s', found '%s'", TokenName(requiredToken, requiredBuf), TokenName(token, tokenBuf));
+}
+
+/* GetToken - get the next token */
+int GetToken(ParseContext *c)
+{
+    int tkn;
+
+    /* check for a saved token */
+    if ((tkn = c->savedToken) != T_NONE)
+        c->savedToken = T_NONE;
+
+    /* otherwise, get the next token */
+    else
+        tkn = NextToken(c);
+
+    /* return the token */
+    return tkn;
+}
+
+/* SaveToken - save a token */
+void SaveToken(ParseContext *c, int token)
+{
+    c->savedToken = token;
+}
+
+/* TokenName - get the name of a token (buf holds the name of a single character token) */
+char *TokenName(int token, char *buf)
+{
+    char *name;
+    
+    if (token < _T_FIRST_KEYWORD) {
+        buf[0] = '\'';
+        buf[1] = token;
+        buf[2] = '\'';
+        buf[3] = '\0';
+        name = buf;
+    }
+    else if (token < _T_NON_KEYWORDS)
+        name = ktab[token - _T_FIRST_KEYWORD].keyword;
+    else if (token < _T_MAX)
+        name = ttab[token - _T_NON_KEYWORDS];
+    else
+        name = "<invalid>";
+        
+    /* return the token name */
+    return name;
+}
+
+/* NextToken - read the next token */
+static int NextToken(ParseContext *c)
+{
+    int tkn = T_NONE;
+    int ch, ch2;
+    
+again:
+    /* skip leading blanks */
+    ch = SkipSpaces(c);
+
+    /* remember the start of the current token */
+    c->tokenPtr = c->sys->linePtr;
+
+    /* check the next character */
+    switch (ch) {
+    case EOF:
+        tkn = T_EOF;
+        break;
+    case '"':
+        tkn = StringToken(c);
+        break;
+    case '\'':
+        tkn = CharToken(c);
+        break;
+    case '<':
+        switch (ch = GetChar(c)) {
+        case '=':
+            return T_LE;
+        case '<':
+            if ((ch = GetChar(c)) == '=')
+                return T_SHLEQ;
+            UngetC(c);
+            return T_SHL;
+        default:
+            UngetC(c);
+            return '<';
+        }
+    case '=':
+        if ((ch = GetChar(c)) == '=')
+            return T_EQ;
+        else {
+            UngetC(c);
+            return '=';
+        }
+        break;
+    case '!':
+        if ((ch = GetChar(c)) == '=')
+            tkn = T_NE;
+        else {
+            UngetC(c);
+            tkn = '!';
+        }
+        break;
+    case '>':
+       switch (ch = GetChar(c)) {
+        case '=':
+            return T_GE;
+        case '>':
+            if ((ch = GetChar(c)) == '=')
+                return T_SHREQ;
+            UngetC(c);
+            return T_SHR;
+        default:
+            UngetC(c);
+            return '>';
+        }
+    case '&':
+        switch (ch = GetChar(c)) {
+        case '&':
+            return T_AND;
+        case '=':
+            return T_ANDEQ;
+        default:
+            UngetC(c);
+            return '&';
+        }
+    case '|':
+        switch (ch = GetChar(c)) {
+        case '|':
+            return T_OR;
+        case '=':
+            return T_OREQ;
+        default:
+            UngetC(c);
+            return '|';
+        }
+    case '^':
+        if ((ch = GetChar(c)) == '=')
+            return T_XOREQ;
+        UngetC(c);
+        return '^';
+    case '+':
+        switch (ch = GetChar(c)) {
+        case '+':
+            return T_INC;
+        case '=':
+            return T_ADDEQ;
+        default:
+            UngetC(c);
+            return '+';
+        }
+    case '-':
+        switch (ch = GetChar(c)) {
+        case '-':
+            return T_DEC;
+        case '=':
+            return T_SUBEQ;
+        default:
+            UngetC(c);
+            return '-';
+        }
+    case '*':
+        if ((ch = GetChar(c)) == '=')
+            return T_MULEQ;
+        UngetC(c);
+        return '*';
+    case '/':
+        switch (ch = GetChar(c)) {
+        case '=':
+            return T_DIVEQ;
+        case '/':
+            if (c->sys->source)
+                c->sys->linePtr = FindChar(c->sys->linePtr, '\n');
+            while ((ch = GetChar(c)) != EOF)
+                if (ch == '\n')
+                    goto again;
+            break;
+        case '*':
+            ch = ch2 = EOF;
+            for (; (ch2 = GetChar(c)) != EOF; ch = ch2) {
+                if (ch == '*' && ch2 == '/')
+                    goto again;
+                if (c->sys->source && ch2 != '*')
+                    c->sys->linePtr = FindChar(c->sys->linePtr, '*');
+            }
+            break;
+        default:
+            UngetC(c);
+            return '/';
+        }
+        break;
+    case '0':
+        switch (GetChar(c)) {
+        case 'x':
+        case 'X':
+            tkn = HexNumberToken(c);
+            break;
+        case 'b':
+        case 'B':
+            tkn = BinaryNumberToken(c);
+            break;
+        default:
+            UngetC(c);
+            tkn = NumberToken(c, '0');
+            break;
+        }
+        break;
+    default:
+        if (isdigit(ch))
+            tkn = NumberToken(c, ch);
+        else if (IdentifierCharP(ch))
+            tkn = IdentifierToken(c,ch);
+        else
+            tkn = ch;
+    }
+
+    /* return the token */
+    return tkn;
+}
+
+/* IdentifierToken - get an identifier */
+static int IdentifierToken(ParseContext *c, int ch)
+{
+    int len;
+    char *p;
+
+    /* get the identifier */
+    p = c->token; *p++ = ch; len = 1;
+    while ((ch = GetChar(c)) != EOF && IdentifierCharP(ch)) {
+        if (++len > MAXTOKEN)
+            ParseError(c, "Identifier too long");
+        *p++ = ch;
+    }
+    UngetC(c);
+    *p = '\0';
+
+    /* check to see if it is a keyword */
+    return KeywordToken(c->token, len);
+}
+
+/* KeywordToken - find the keyword token for an identifier
+
+   No two keywords have the same first character and length so those pick
+   the only keyword the identifier could be and a single compare decides.
+   Most identifiers are rejected by their first character alone. */
+static int KeywordToken(const char *name, int len)
+{
+    int token;
+
+    switch (name[0]) {
+#ifdef USE_ASM
+    case 'a':   token = T_ASM;                          break;
+#endif
+    case 'b':   token = T_BREAK;                        break;
+    case 'c':   token = T_CONTINUE;                     break;
+    case 'd':   token = len == 2 ? T_DO : T_DEF;        break;
+    case 'e':   token = T_ELSE;                         break;
+    case 'f':   token = T_FOR;                          break;
+    case 'g':   token = T_GOTO;                         break;
+    case 'i':   token = T_IF;                           break;
+    case 'p':   token = T_PRINT;                        break;
+    case 'r':   token = T_RETURN;                       break;
+    case 'v':   token = T_VAR;                          break;
+    case 'w':   token = T_WHILE;                        break;
+    default:    return T_IDENTIFIER;
+    }
+
+    /* make sure it is the keyword and not just another identifier like it */
+    if (strcmp(name, ktab[token - _T_FIRST_KEYWORD].keyword) != 0)
+        return T_IDENTIFIER;
+    return token;
+}
+
+/* IdentifierCharP - is this an identifier character? */
+static int IdentifierCharP(int ch)
+{
+    return isupper(ch)
+        || islower(ch)
+        || isdigit(ch)
+        || ch == '_';
+}
+
+/* NumberToken - get a number */
+static int NumberToken(ParseContext *c, int ch)
+{
+    char *p = c->token;
+
+    /* get the number */
+    *p++ = ch;
+    while ((ch = GetChar(c)) != EOF) {
+        if (isdigit(ch))
+            *p++ = ch;
+        else if (ch != '_')
+            break;
+    }
+    UngetC(c);
+    *p = '\0';
+    
+    /* convert the string to an integer */
+    c->value = (VMVALUE)atol(c->token);
+    
+    /* return the token */
+    return T_NUMBER;
+}
+
+/* HexNumberToken - get a hexadecimal number */
+static int HexNumberToken(ParseContext *c)
+{
+    char *p = c->token;
+    int ch;
+
+    /* get the number */
+    while ((ch = GetChar(c)) != EOF) {
+        if (isxdigit(ch))
+            *p++ = ch;
+        else if (ch != '_')
+            break;
+    }
+    UngetC(c);
+    *p = '\0';
+    
+    /* convert the string to an integer */
+    c->value = (VMVALUE)strtoul(c->token, NULL, 16);
+    
+    /* return the token */
+    return T_NUMBER;
+}
+
+/* BinaryNumberToken - get a binary number */
+static int BinaryNumberToken(ParseContext *c)
+{
+    char *p = c->token;
+    int ch;
+
+    /* get the number */
+    while ((ch = GetChar(c)) != EOF) {
+        if (ch == '0' || ch == '1')
+            *p++ = ch;
+        else if (ch != '_')
+            break;
+    }
+    UngetC(c);
+    *p = '\0';
+    
+    /* convert the string to an integer */
+    c->value = (VMVALUE)strtoul(c->token, NULL, 2);
+    
+    /* return the token */
+    return T_NUMBER;
+}
+
+/* StringToken - get a string */
+static int StringToken(ParseContext *c)
+{
+    int ch,len;
+    char *p;
+
+    /* collect the string */
+    p = c->token; len = 0;
+    while ((ch = GetChar(c)) != EOF && ch != '"') {
+        if (++len > MAXTOKEN)
+            ParseError(c, "String too long");
+        *p++ = (ch == '\\' ? LiteralChar(c) : ch);
+    }
+    *p = '\0';
+
+    /* check for premature end of file */
+    if (ch != '"')
+        ParseError(c, "unterminated string");
+
+    /* return the token */
+    return T_STRING;
+}
+
+/* CharToken - get a character constant */
+static int CharToken(ParseContext *c)
+{
+    int ch = LiteralChar(c);
+    if (GetChar(c) != '\'')
+        ParseError(c,"Expecting a closing single quote");
+    c->token[0] = ch;
+    c->token[1] = '\0';
+    c->value = ch;
+    return T_NUMBER;
+}
+
+/* LiteralChar - get a character from a literal string */
+static int LiteralChar(ParseContext *c)
+{
+    int ch;
+    switch (ch = GetChar(c)) {
+    case 'n': 
+        ch = '\n';
+        break;
+    case 'r':
+        ch = '\r';
+        break;
+    case 't':
+        ch = '\t';
+        break;
+    case EOF:
+        ch = '\\';
+        break;
+    }
+    return ch;
+}
+
+/* SkipSpaces - skip leading spaces and the the next non-blank character */
+int SkipSpaces(ParseContext *c)
+{
+    int ch;
+    if (c->sys->source)
+        c->sys->linePtr = SkipBlanks(c->sys->linePtr);
+    while ((ch = GetChar(c)) != EOF)
+        if (!isspace(ch))
+            break;
+    return ch;
+}
+
+/* GetChar - get the next character */
+int GetChar(ParseContext *c)
+{
+    int ch;
+    
+    /* get the next character on the current line (staying on the terminator
+       at the end of the input so every later call returns EOF too) */
+    while (!(ch = *c->sys->linePtr++)) {
+        if (!GetLine(c->sys)) {
+            --c->sys->linePtr;
+            return EOF;
+        }
+    }
+    
+    /* return the character */
+    return ch;
+}
+
+/* UngetC - unget the most recent character */
+void UngetC(ParseContext *c)
+{
+    /* backup the input pointer */
+    --c->sys->linePtr;
+}
+
+/* ParseError - report a parsing error */
+void ParseError(ParseContext *c, char *fmt, ...)
+{
+    va_list ap;
+
+    /* print the error message */
+    va_start(ap, fmt);
+    Printf(c->sys, "error: ");
+    VPrintf(c->sys, fmt, ap);
+    PutChar(c->sys, '\n');
+    va_end(ap);
+
+    /* show the context */
+    ShowErrorLine(c);
+
+    /* exit until we fix the compiler so it can recover from parse errors */
+    longjmp(c->sys->errorTarget, 1);
+}
+
+/* ShowErrorLine - show the line holding the current token
+
+   A whole source scanned in place isn't split into lines so the line and
+   its number are found by looking for the newlines in front of the token. */
+static void ShowErrorLine(ParseContext *c)
+{
+    char *line, *end, *p;
+    int lineNumber;
+
+    /* find the start of the line and its number */
+    if ((line = c->sys->source) != NULL) {
+        lineNumber = 1;
+        for (p = line; p < c->tokenPtr - 1; ++p)
+            if (*p == '\n') {
+                line = p + 1;
+                ++lineNumber;
+            }
+    }
+    else {
+        line = c->sys->lineBuf;
+        lineNumber = c->sys->lineNumber;
+    }
+
+    /* find the end of the line */
+    for (end = line; *end != '\0' && *end != '\n'; ++end)
+        ;
+
+    Printf(c->sys, "  line %d\n", lineNumber);
+    Printf(c->sys, "    ");
+    PutString(c->sys, line, end - line);
+    Printf(c->sys, "\n    %*s\n", (int)(c->tokenPtr - line), "^");
+}
+
+/* SkipBlanks - skip a run of whitespace in a source scanned in place */
+static char *SkipBlanks(char *p)
+{
+#ifdef SCAN_BLOCK
+    ScanVec space = ScanSet(' '), below = ScanSet('\t' - 1), above = ScanSet('\r' + 1);
+    uint32_t stop;
+
+    /* check up to the first aligned block a character at a time */
+    for (; ((uintptr_t)p & (SCAN_BLOCK - 1)) != 0; ++p)
+        if (!isspace((uint8_t)*p))
+            return p;
+
+    /* then a block at a time (the zero byte at the end stops the scan) */
+    for (;; p += SCAN_BLOCK) {
+        ScanVec v = ScanLoad(p);
+        ScanVec blank = ScanOr(ScanEq(v, space), ScanAnd(ScanGt(v, below), ScanGt(above, v)));
+        if ((stop = ~ScanMask(blank) & SCAN_ALL) != 0)
+            return p + __builtin_ctz(stop);
+    }
+#else
+    while (isspace((uint8_t)*p))
+        ++p;
+    return p;
+#endif
+}
+
+/* FindChar - find a character or the end of a source scanned in place */
+static char *FindChar(char *p, int ch)
+{
+#ifdef SCAN_BLOCK
+    ScanVec match = ScanSet(ch), zero = ScanSet(0);
+    uint32_t found;
+
+    /* check up to the first aligned block a character at a time */
+    for (; ((uintptr_t)p & (SCAN_BLOCK - 1)) != 0; ++p)
+        if (*p == ch || *p == '\0')
+            return p;
+
+    /* then a block at a time */
+    for (;; p += SCAN_BLOCK) {
+        ScanVec v = ScanLoad(p);
+        if ((found = ScanMask(ScanOr(ScanEq(v, match), ScanEq(v, zero)))) != 0)
+            return p + __builtin_ctz(found);
+    }
+#else
+    while (*p != ch && *p != '\0')
+        ++p;
+    return p;
+#endif
+}
@@ -0,0 +1,50 @@
+/* db_sched.c - round robin scheduler for interpreters sharing one thread
+ *
+ * Copyright (c) 2014 by David Michael Betz.  All rights reserved.
+ *
+ */
+
+#include "db_vm.h"
+
+/* InitScheduler - initialize a scheduler
+
+   Each interpreter runs until it has used up quantum units of fuel and then
+   goes to the back of the ring. */
+void InitScheduler(Scheduler *s, VMVALUE quantum)
+{
+    s->head = s->tail = NULL;
+    s->quantum = quantum;
+}
+
+/* AddInterpreter - add an interpreter to the back of the ring */
+void AddInterpreter(Scheduler *s, Interpreter *i)
+{
+    i->next = NULL;
+    if (s->tail)
+        s->tail->next = i;
+    else
+        s->head = i;
+    s->tail = i;
+}
+
+/* Schedule - give the next interpreter its turn
+
+   An interpreter that yields goes to the back of the ring and one that halts
+   or aborts with an error is removed from it.  Returns VMFALSE when there are
+   no interpreters left to run. */
+int Schedule(Scheduler *s)
+{
+    Interpreter *i;
+
+    /* remove the next interpreter from the ring */
+    if (!(i = s->head))
+        return VMFALSE;
+    if (!(s->head = i->next))
+        s->tail = NULL;
+
+    /* run it for one quantum and put it back if it isn't done */
+    if (Run(i, s->quantum) == VMSTS_YIELD)
+        AddInterpreter(s, i);
+
+    return s->head != NULL;
+}
@@ -13,7 +13,9 @@
 typedef enum {
     SC_CONSTANT,
     SC_VARIABLE,
-    SC_HWVARIABLE
+    SC_HWVARIABLE,
+    SC_FUNCTION,
+    SC_ARRAY
 } StorageClass;
 
 /* forward type declarations */
@@ -26,11 +28,14 @@ typedef struct {
     int count;
 } SymbolTable;
 
-/* symbol structure */
+/* symbol structure (the value of a global variable, function or array is
+   the offset of its cell in the global segment and a function also records
+   the number of arguments it takes) */
 struct Symbol {
-    VMVALUE value;  // must be first
+    VMVALUE value;
     Symbol *next;
     StorageClass storageClass;
+    int argumentCount;
     char name[1];
 };
 
@@ -7,6 +7,8 @@
 #include <stdarg.h>
 #include "db_system.h"
 
+static void DefaultPutChar(void *cookie, int ch);
+
 /* InitSystem - initialize the compiler */
 System *InitSystem(uint8_t *freeSpace, size_t freeSize)
 {
@@ -18,6 +20,16 @@ System *InitSystem(uint8_t *freeSpace, size_t freeSize)
     sys->freeNext = sys->freeSpace;
     sys->linePtr = sys->lineBuf;
     sys->lineBuf[0] = '\0';
+    sys->source = NULL;
+    sys->putChar = DefaultPutChar;
+    sys->putCharCookie = NULL;
+    sys->update = NULL;
+#ifdef USE_TIERS
+    sys->tierThreshold = TIER_THRESHOLD;
+#endif
+#ifdef USE_JIT
+    sys->jitBase = NULL;
+#endif
     return sys;
 }
 
@@ -38,9 +50,67 @@ int GetLine(System *sys)
     if (!(*sys->getLine)(sys->getLineCookie, sys->lineBuf, sizeof(sys->lineBuf), &sys->lineNumber))
         return VMFALSE;
     sys->linePtr = sys->lineBuf;
+    sys->source = NULL;
     return VMTRUE;
 }
 
+/* SetSource - scan a whole source in place
+
+   The source must end with a zero byte and can have lines of any length.
+   The scanner walks it directly and only asks for another line with
+   GetLine once it reaches the end. */
+void SetSource(System *sys, char *source)
+{
+    sys->source = sys->linePtr = source;
+}
+
+/* BeginUpdate - wait until the compiler can change what running code sees
+
+   Nothing needs to wait unless statements compiled earlier may still be
+   running on another thread. */
+void BeginUpdate(System *sys)
+{
+    if (sys->update)
+        (*sys->update)(sys->updateCookie);
+}
+
+/* PutChar - output a character */
+void PutChar(System *sys, int ch)
+{
+    (*sys->putChar)(sys->putCharCookie, ch);
+}
+
+/* PutString - output a string of known length */
+void PutString(System *sys, const char *str, size_t length)
+{
+    while (length-- > 0)
+        PutChar(sys, *str++);
+}
+
+/* Printf - formatted print */
+void Printf(System *sys, const char *fmt, ...)
+{
+    va_list ap;
+    va_start(ap, fmt);
+    VPrintf(sys, fmt, ap);
+    va_end(ap);
+}
+
+/* VPrintf - formatted print with an argument list */
+void VPrintf(System *sys, const char *fmt, va_list ap)
+{
+    char buf[100], *p = buf;
+    vsnprintf(buf, sizeof(buf), fmt, ap);
+    while (*p != '\0')
+        PutChar(sys, *p++);
+}
+
+/* DefaultPutChar - output a character to the console */
+static void DefaultPutChar(void *cookie, int ch)
+{
+    VM_putchar(ch);
+}
+
 /* VM_printf - formatted print */
 void VM_printf(const char *fmt, ...)
 {
@@ -53,16 +123,14 @@ void VM_printf(const char *fmt, ...)
     va_end(ap);
 }
 
+/* Abort - report an error and return to the error target */
 void Abort(System *sys, const char *fmt, ...)
 {
-    char buf[100], *p = buf;
     va_list ap;
     va_start(ap, fmt);
-    VM_printf("error: ");
-    vsnprintf(buf, sizeof(buf), fmt, ap);
-    while (*p != '\0')
-        VM_putchar(*p++);
-    VM_putchar('\n');
+    Printf(sys, "error: ");
+    VPrintf(sys, fmt, ap);
+    PutChar(sys, '\n');
     va_end(ap);
     longjmp(sys->errorTarget, 1);
 }
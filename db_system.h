@@ -17,11 +17,21 @@
 /* line input handler */
 typedef int GetLineHandler(void *cookie, char *buf, int len, VMVALUE *pLineNumber);
 
+/* character output handler */
+typedef void PutCharHandler(void *cookie, int ch);
+
+/* handler to wait until the compiler can change what running code sees */
+typedef void UpdateHandler(void *cookie);
+
 /* system context */
 typedef struct {
     jmp_buf errorTarget;        /* error target */
     GetLineHandler *getLine;    /* function to get a line of input */
     void *getLineCookie;        /* cookie for the getLine function */
+    PutCharHandler *putChar;    /* function to output a character */
+    void *putCharCookie;        /* cookie for the putChar function */
+    UpdateHandler *update;      /* function to wait for earlier statements to finish or NULL */
+    void *updateCookie;         /* cookie for the update function */
     int lineNumber;             /* current line number */
     uint8_t *freeSpace;         /* base of free space */
     uint8_t *freeMark;          /* top of permanently allocated storage */
@@ -29,11 +39,29 @@ typedef struct {
     uint8_t *freeTop;           /* top of free space */
     char lineBuf[MAXLINE];      /* current input line */
     char *linePtr;              /* pointer to the current character */
+    char *source;               /* whole source being scanned in place or NULL */
+#ifdef USE_TIERS
+    int tierThreshold;          /* calls or loop iterations before promoting code */
+#endif
+#ifdef USE_JIT
+    uint8_t *jitBase;           /* base of the native code region */
+    uint8_t *jitFree;           /* next free space in the native code region */
+    uint8_t *jitTop;            /* top of the native code region */
+#ifdef USE_TIERS
+    VMVALUE jitResume;          /* offset of the code that resumes a function */
+#endif
+#endif
 } System;
 
 System *InitSystem(uint8_t *freeSpace, size_t freeSize);
 uint8_t *AllocateFreeSpace(System *sys, size_t size);
 int GetLine(System *sys);
+void SetSource(System *sys, char *source);
+void BeginUpdate(System *sys);
+void PutChar(System *sys, int ch);
+void PutString(System *sys, const char *str, size_t length);
+void Printf(System *sys, const char *fmt, ...);
+void VPrintf(System *sys, const char *fmt, va_list ap);
 void Abort(System *sys, const char *fmt, ...);
 
 /* directory entry structure (platform specific) */
@@ -49,6 +77,7 @@ void VM_printf(const char *fmt, ...);
 void VM_vprintf(const char *fmt, va_list ap);
 void VM_putchar(int ch);
 void VM_flush(void);
+int VM_parsesize(const char *str, size_t *pSize);
 int VM_opendir(const char *path, VMDIR *dir);
 int VM_readdir(VMDIR *dir, VMDIRENT *entry);
 void VM_closedir(VMDIR *dir);
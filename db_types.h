@@ -1,129 +1,254 @@
-/* db_types.h - type definitions for a simple virtual machine
- *
- * Copyright (c) 2014 by David Michael Betz.  All rights reserved.
- *
- */
-
-#ifndef __DB_TYPES_H__
-#define __DB_TYPES_H__
-
-/**********/
-/* Common */
-/**********/
-
-#define VMTRUE      1
-#define VMFALSE     0
-
-/* system heap size (includes compiler heap and image buffer) */
-#define HEAPSIZE            5000
-
-/* size of image buffer (allocated from system heap) */
-#define IMAGESIZE           2500
-
-/* edit buffer size (separate from the system heap) */
-#define EDITBUFSIZE         1500
-
-/* minimum stack size in bytes */
-#define MIN_STACK_SIZE      128
-
-/*****************/
-/* MAC and LINUX */
-/*****************/
-
-#if defined(MAC) || defined(LINUX)
-
-#include <stdio.h>
-#include <stdint.h>
-#include <string.h>
-
-typedef int16_t VMWORD;
-typedef int32_t VMVALUE;
-typedef uint32_t VMUVALUE;
-
-#define ALIGN_MASK              3
-
-#define VMCODEBYTE(p)           *(uint8_t *)(p)
-#define VMINTRINSIC(i)          Intrinsics[i]
-
-#define ANSI_FILE_IO
-
-#endif  // MAC
-
-/*********/
-/* PIC32 */
-/*********/
-
-#if defined(PIC32)
-
-#include <stdio.h>
-#include <stdint.h>
-#include <string.h>
-
-typedef int16_t VMWORD;
-typedef int32_t VMVALUE;
-typedef uint32_t VMUVALUE;
-
-#define ALIGN_MASK              3
-
-#define VMCODEBYTE(p)           *(uint8_t *)(p)
-#define VMINTRINSIC(i)          Intrinsics[i]
-
-#define LINE_EDIT
-#define ECHO_INPUT
-
-#endif  // MAC
-
-/*****************/
-/* PROPELLER_GCC */
-/*****************/
-
-#ifdef PROPELLER_GCC
-
-#include <string.h>
-#include <stdint.h>
-
-typedef int16_t VMWORD;
-typedef int32_t VMVALUE;
-typedef uint32_t VMUVALUE;
-
-#define ALIGN_MASK              3
-
-#define VMCODEBYTE(p)           *(uint8_t *)(p)
-#define VMINTRINSIC(i)          Intrinsics[i]
-
-#define PROPELLER
-#define ANSI_FILE_IO
-
-#endif  // PROPELLER_GCC
-
-/****************/
-/* ANSI_FILE_IO */
-/****************/
-
-#ifdef ANSI_FILE_IO
-
-#if 0
-
-#include <stdio.h>
-#include <dirent.h>
-
-typedef FILE VMFILE;
-
-#define VM_fopen	fopen
-#define VM_fclose	fclose
-#define VM_fgets	fgets
-#define VM_fputs	fputs
-
-struct VMDIR {
-    DIR *dirp;
-};
-
-struct VMDIRENT {
-    char name[FILENAME_MAX];
-};
-
-#endif
-
-#endif // ANSI_FILE_IO
-
-#endif
+/* db_types.h - type definitions for a simple virtual machine
+ *
+ * Copyright (c) 2014 by David Michael Betz.  All rights reserved.
+ *
+ */
+
+#ifndef __DB_TYPES_H__
+#define __DB_TYPES_H__
+
+/**********/
+/* Common */
+/**********/
+
+#define VMTRUE      1
+#define VMFALSE     0
+
+#ifdef USE_THREADED_CODE
+
+/* threaded code cells are larger than the bytecode they are translated from */
+#define HEAPSIZE            20000
+#define IMAGESIZE           15000
+
+#elif defined(USE_TIERS)
+
+/* each function and main code block carries an execution profile and each
+   frame links one more slot */
+#define HEAPSIZE            7000
+#define IMAGESIZE           3500
+
+#else
+
+/* system heap size (includes compiler heap and image buffer) */
+#define HEAPSIZE            5000
+
+/* size of image buffer (allocated from system heap) */
+#define IMAGESIZE           2500
+
+#endif
+
+/* edit buffer size (separate from the system heap) */
+#define EDITBUFSIZE         1500
+
+/* minimum stack size in bytes */
+#define MIN_STACK_SIZE      128
+
+/* initial number of slots in a hash index of names */
+#define MIN_INDEX_SIZE      64
+
+/* size of the executable region for native code (separate from the system heap) */
+#define JITSIZE             (64 * 1024)
+
+/* default number of calls or loop iterations before code is promoted to the next tier */
+#define TIER_THRESHOLD      1000
+
+/*****************/
+/* MAC and LINUX */
+/*****************/
+
+#if defined(MAC) || defined(LINUX)
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+
+typedef int16_t VMWORD;
+typedef int32_t VMVALUE;
+typedef uint32_t VMUVALUE;
+
+#define ALIGN_MASK              3
+
+#define VMCODEBYTE(p)           *(uint8_t *)(p)
+#define VMINTRINSIC(i)          Intrinsics[i]
+
+/* word and long operands are stored in native byte order aligned to their size */
+#ifndef NO_NATIVE_OPERANDS
+#define NATIVE_OPERANDS
+#endif
+
+#define ANSI_FILE_IO
+
+#ifndef NO_SUPERINSTRUCTIONS
+#define USE_SUPERINSTRUCTIONS
+#endif
+
+#ifndef NO_STACK_DEPTH
+#define USE_STACK_DEPTH
+#endif
+
+/* VM addresses are offsets from the image header (the stack is allocated
+   after the image) so they fit in a VMVALUE when host pointers are 64 bits */
+#define VMADDR(base, p)         ((VMVALUE)((uint8_t *)(p) - (uint8_t *)(base)))
+#define VMPTR(base, v)          ((void *)((uint8_t *)(base) + (VMUVALUE)(v)))
+
+/* images can be saved to files and loaded again (only the host pointers in
+   an image need to be relocated since VM addresses are already offsets) */
+#define USE_IMAGE_FILES
+
+/* the notc program maps source files and scans them in place */
+#define USE_SOURCE_FILES
+
+/* the notc program can compile statements on one thread while it runs the
+   statements before them on another (-q) */
+#define USE_PIPELINE
+
+/* global symbols and string constants are found through hash indexes in
+   the image as well as by walking their lists so compiling large programs
+   stays linear */
+#define USE_NAME_INDEX
+
+/* the notc program reserves address space for a heap and an image this
+   large and memory is only committed as it is first touched so they grow
+   as they fill up and small programs stay small (the -h and -i options
+   give other sizes) */
+#define RESERVED_HEAPSIZE       (64 * 1024 * 1024)
+#define RESERVED_IMAGESIZE      (32 * 1024 * 1024)
+
+/* largest stack an interpreter gets when it is given the rest of the free
+   space (native code under the JIT recurses on the host stack too) */
+#define MAX_STACK_SIZE          (1024 * 1024)
+
+#endif  // MAC
+
+/*********/
+/* PIC32 */
+/*********/
+
+#if defined(PIC32)
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+
+typedef int16_t VMWORD;
+typedef int32_t VMVALUE;
+typedef uint32_t VMUVALUE;
+
+#define ALIGN_MASK              3
+
+#define VMCODEBYTE(p)           *(uint8_t *)(p)
+#define VMINTRINSIC(i)          Intrinsics[i]
+
+#define LINE_EDIT
+#define ECHO_INPUT
+
+#ifndef NO_SUPERINSTRUCTIONS
+#define USE_SUPERINSTRUCTIONS
+#endif
+
+#ifndef NO_STACK_DEPTH
+#define USE_STACK_DEPTH
+#endif
+
+/* VM addresses are host addresses */
+#define VMADDR(base, p)         ((VMVALUE)(p))
+#define VMPTR(base, v)          ((void *)(v))
+
+#endif  // MAC
+
+/*****************/
+/* PROPELLER_GCC */
+/*****************/
+
+#ifdef PROPELLER_GCC
+
+#include <string.h>
+#include <stdint.h>
+
+typedef int16_t VMWORD;
+typedef int32_t VMVALUE;
+typedef uint32_t VMUVALUE;
+
+#define ALIGN_MASK              3
+
+#define VMCODEBYTE(p)           *(uint8_t *)(p)
+#define VMINTRINSIC(i)          Intrinsics[i]
+
+#define PROPELLER
+#define ANSI_FILE_IO
+
+/* VM addresses are host addresses (hardware registers are addressed directly) */
+#define VMADDR(base, p)         ((VMVALUE)(p))
+#define VMPTR(base, v)          ((void *)(v))
+
+#endif  // PROPELLER_GCC
+
+/********************/
+/* Operand encoding */
+/********************/
+
+/* VMOPERAND(p, n) - where an n byte operand starting at or after p is stored
+   VMCODEWORD(p), VMCODELONG(p) - fetch a word or long operand
+   VMSETCODEWORD(p, v), VMSETCODELONG(p, v) - store a word or long operand */
+
+#ifdef NATIVE_OPERANDS
+
+#define VMOPERAND(p, n)         ((uint8_t *)(((uintptr_t)(p) + (n) - 1) & ~(uintptr_t)((n) - 1)))
+#define VMCODEWORD(p)           (*(VMWORD *)(p))
+#define VMCODELONG(p)           (*(VMVALUE *)(p))
+#define VMSETCODEWORD(p, v)     (*(VMWORD *)(p) = (v))
+#define VMSETCODELONG(p, v)     (*(VMVALUE *)(p) = (v))
+
+#else
+
+/* operands are stored big-endian with no alignment */
+#define VMOPERAND(p, n)         ((uint8_t *)(p))
+#define VMCODEWORD(p)           ((VMWORD)((VMCODEBYTE(p) << 8) | VMCODEBYTE((p) + 1)))
+#define VMCODELONG(p)           ((VMVALUE)(((VMUVALUE)VMCODEBYTE(p) << 24)          \
+                                         | ((VMUVALUE)VMCODEBYTE((p) + 1) << 16)    \
+                                         | ((VMUVALUE)VMCODEBYTE((p) + 2) << 8)     \
+                                         | VMCODEBYTE((p) + 3)))
+#define VMSETCODEWORD(p, v)     do {                                \
+                                    (p)[0] = (uint8_t)((v) >> 8);   \
+                                    (p)[1] = (uint8_t)(v);          \
+                                } while (0)
+#define VMSETCODELONG(p, v)     do {                                \
+                                    (p)[0] = (uint8_t)((v) >> 24);  \
+                                    (p)[1] = (uint8_t)((v) >> 16);  \
+                                    (p)[2] = (uint8_t)((v) >> 8);   \
+                                    (p)[3] = (uint8_t)(v);          \
+                                } while (0)
+
+#endif
+
+/****************/
+/* ANSI_FILE_IO */
+/****************/
+
+#ifdef ANSI_FILE_IO
+
+#if 0
+
+#include <stdio.h>
+#include <dirent.h>
+
+typedef FILE VMFILE;
+
+#define VM_fopen	fopen
+#define VM_fclose	fclose
+#define VM_fgets	fgets
+#define VM_fputs	fputs
+
+struct VMDIR {
+    DIR *dirp;
+};
+
+struct VMDIRENT {
+    char name[FILENAME_MAX];
+};
+
+#endif
+
+#endif // ANSI_FILE_IO
+
+#endif
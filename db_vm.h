@@ -1,16 +1,104 @@
-/* db_vm.h - definitions for a simple virtual machine
- *
- * Copyright (c) 2014 by David Michael Betz.  All rights reserved.
- *
- */
-
-#ifndef __DB_VM_H__
-#define __DB_VM_H__
-
-#include "db_system.h"
-#include "db_image.h"
-
-/* prototypes from db_vmint.c */
-int Execute(System *sys, ImageHdr *image, VMVALUE main);
-
-#endif
+/* db_vm.h - definitions for a simple virtual machine
+ *
+ * Copyright (c) 2014 by David Michael Betz.  All rights reserved.
+ *
+ */
+
+#ifndef __DB_VM_H__
+#define __DB_VM_H__
+
+#include "db_system.h"
+#include "db_image.h"
+
+/* threaded code cell */
+typedef union VMCELL VMCELL;
+union VMCELL {
+    void *handler;      /* opcode handler address */
+    VMVALUE value;      /* pre-decoded operand */
+    VMCELL *target;     /* pre-resolved branch target */
+};
+
+/* threaded code pointer handler (called by FindCodePointers) */
+typedef void CodePointerHandler(void *cookie, VMCELL *cell, int type);
+
+/* the interpreter either runs bytecode or threaded code translated from it */
+#ifdef USE_THREADED_CODE
+typedef VMCELL VMCODE;
+#else
+typedef uint8_t VMCODE;
+#endif
+
+/* interpreter status codes */
+#define VMSTS_ERROR     0       /* aborted with an error */
+#define VMSTS_HALT      1       /* ran to completion */
+#define VMSTS_YIELD     2       /* ran out of fuel and can be resumed */
+
+/* interpreter state structure */
+typedef struct Interpreter Interpreter;
+struct Interpreter {
+    System *sys;
+    ImageHdr *image;
+    uint8_t *globals;           /* global segment (the image's own or a private copy) */
+    VMVALUE *stack;
+    VMVALUE *stackTop;
+    VMCODE *pc;
+    VMVALUE *fp;
+    VMVALUE *sp;
+    VMVALUE tos;
+    VMVALUE fuel;               /* backward branches and calls left before yielding */
+    int status;                 /* status of the last run */
+    Interpreter *next;          /* next interpreter in the scheduler ring */
+    VMCODE callReturn[2];       /* argument count and HALT for functions called from outside bytecode */
+};
+
+/* round robin scheduler state structure */
+typedef struct {
+    Interpreter *head;          /* next interpreter to run */
+    Interpreter *tail;          /* last interpreter to run */
+    VMVALUE quantum;            /* fuel given to each interpreter per turn */
+} Scheduler;
+
+/* prototypes from db_vmint.c */
+int Execute(System *sys, ImageHdr *image, VMVALUE main);
+Interpreter *NewInterpreter(System *sys, ImageHdr *image, VMVALUE main, size_t stackSize);
+int Run(Interpreter *i, VMVALUE fuel);
+Interpreter *NewCall(System *sys, ImageHdr *image, uint8_t *globals, Symbol *function, int argc, const VMVALUE *argv);
+int Call(System *sys, ImageHdr *image, uint8_t *globals, Symbol *function, int argc, const VMVALUE *argv, VMVALUE *pValue);
+#ifdef USE_THREADED_CODE
+VMVALUE ThreadCode(ImageHdr *image, const uint8_t *code, size_t size, int *map);
+#ifdef USE_IMAGE_FILES
+void **ThreadedHandlers(void);
+int FindCodePointers(VMCELL *cells, CodePointerHandler *handler, void *cookie);
+#endif
+#endif
+#ifdef USE_JIT
+void CallBytecode(Interpreter *i, int argc);
+void CallTrap(Interpreter *i, int op);
+void CallStackOverflow(Interpreter *i);
+#endif
+#ifdef USE_TIERS
+void DumpProfile(ImageHdr *image);
+#endif
+
+/* prototypes from db_sched.c */
+void InitScheduler(Scheduler *s, VMVALUE quantum);
+void AddInterpreter(Scheduler *s, Interpreter *i);
+int Schedule(Scheduler *s);
+
+/* prototypes from db_jit.c */
+#ifdef USE_JIT
+VMVALUE JitTranslate(System *sys, ImageHdr *image, const uint8_t *code, size_t size, int loop, VMVALUE *pEntry);
+#ifndef USE_TIERS
+VMVALUE JitCompile(System *sys, ImageHdr *image, const uint8_t *code, size_t size);
+#ifdef USE_IMAGE_FILES
+void JitRelink(System *sys, ImageHdr *image);
+#endif
+#endif
+void JitEnter(Interpreter *i, VMVALUE entry);
+void FreeJit(System *sys);
+#ifdef USE_TIERS
+void JitResume(Interpreter *i, VMVALUE entry);
+#endif
+#endif
+
+#endif
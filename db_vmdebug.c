@@ -1,141 +1,244 @@
-/* db_vmdebug.c - debug routines
- *
- * Copyright (c) 2014 by David Michael Betz.  All rights reserved.
- *
- */
-
-#include <stdio.h>
-#include <string.h>
-#include "db_vmdebug.h"
-#include "db_image.h"
-
-OTDEF OpcodeTable[] = {
-{ OP_HALT,      "HALT",     FMT_NONE    },
-{ OP_BRT,       "BRT",      FMT_BR      },
-{ OP_BRTSC,     "BRTSC",    FMT_BR      },
-{ OP_BRF,       "BRF",      FMT_BR      },
-{ OP_BRFSC,     "BRFSC",    FMT_BR      },
-{ OP_BR,        "BR",       FMT_BR      },
-{ OP_NOT,       "NOT",      FMT_NONE    },
-{ OP_NEG,       "NEG",      FMT_NONE    },
-{ OP_ADD,       "ADD",      FMT_NONE    },
-{ OP_SUB,       "SUB",      FMT_NONE    },
-{ OP_MUL,       "MUL",      FMT_NONE    },
-{ OP_DIV,       "DIV",      FMT_NONE    },
-{ OP_REM,       "REM",      FMT_NONE    },
-{ OP_BNOT,      "BNOT",     FMT_NONE    },
-{ OP_BAND,      "BAND",     FMT_NONE    },
-{ OP_BOR,       "BOR",      FMT_NONE    },
-{ OP_BXOR,      "BXOR",     FMT_NONE    },
-{ OP_SHL,       "SHL",      FMT_NONE    },
-{ OP_SHR,       "SHR",      FMT_NONE    },
-{ OP_LT,        "LT",       FMT_NONE    },
-{ OP_LE,        "LE",       FMT_NONE    },
-{ OP_EQ,        "EQ",       FMT_NONE    },
-{ OP_NE,        "NE",       FMT_NONE    },
-{ OP_GE,        "GE",       FMT_NONE    },
-{ OP_GT,        "GT",       FMT_NONE    },
-{ OP_LIT,       "LIT",      FMT_LONG    },
-{ OP_SLIT,      "SLIT",     FMT_SBYTE   },
-{ OP_LOAD,      "LOAD",     FMT_NONE    },
-{ OP_LOADB,     "LOADB",    FMT_NONE    },
-{ OP_STORE,     "STORE",    FMT_NONE    },
-{ OP_STOREB,    "STOREB",   FMT_NONE    },
-{ OP_LADDR,     "LADDR",    FMT_SBYTE   },
-{ OP_INDEX,     "INDEX",    FMT_NONE    },
-{ OP_CALL,      "CALL",     FMT_BYTE    },
-{ OP_FRAME,     "FRAME",    FMT_BYTE    },
-{ OP_RETURN,    "RETURN",   FMT_NONE    },
-{ OP_DROP,      "DROP",     FMT_NONE    },
-{ OP_DUP,       "DUP",      FMT_NONE    },
-{ OP_TUCK,      "TUCK",     FMT_NONE    },
-{ OP_NATIVE,    "NATIVE",   FMT_LONG    },
-{ OP_TRAP,      "TRAP",     FMT_BYTE    },
-{ 0,            NULL,       0           }
-};
-
-/* DecodeFunction - decode the instructions in a function code object */
-void DecodeFunction(const uint8_t *code, int len)
-{
-    const uint8_t *lc = code;
-    const uint8_t *end = code + len;
-    while (lc < end)
-        lc += DecodeInstruction(code, lc);
-}
-
-/* DecodeInstruction - decode a single bytecode instruction */
-int DecodeInstruction(const uint8_t *code, const uint8_t *lc)
-{
-    uint8_t opcode, bytes[sizeof(VMVALUE)];
-    const OTDEF *op;
-    VMWORD offset;
-    int8_t sbyte;
-    int n, i;
-
-    /* get the opcode */
-    opcode = VMCODEBYTE(lc);
-
-    /* show the address */
-    VM_printf("%08x %02x ", (int)lc, opcode);
-    n = 1;
-
-    /* display the operands */
-    for (op = OpcodeTable; op->name; ++op)
-        if (opcode == op->code) {
-            switch (op->fmt) {
-            case FMT_NONE:
-                for (i = 0; i < sizeof(VMVALUE); ++i)
-                    VM_printf("   ");
-                VM_printf("%s\n", op->name);
-                break;
-            case FMT_BYTE:
-                bytes[0] = VMCODEBYTE(lc + 1);
-                VM_printf("%02x ", bytes[0]);
-                for (i = 1; i < sizeof(VMVALUE); ++i)
-                    VM_printf("   ");
-                VM_printf("%s %02x\n", op->name, bytes[0]);
-                n += 1;
-                break;
-            case FMT_SBYTE:
-                sbyte = (int8_t)VMCODEBYTE(lc + 1);
-                VM_printf("%02x ", (uint8_t)sbyte);
-                for (i = 1; i < sizeof(VMVALUE); ++i)
-                    VM_printf("   ");
-                VM_printf("%s %d\n", op->name, sbyte);
-                n += 1;
-                break;
-            case FMT_LONG:
-                for (i = 0; i < sizeof(VMVALUE); ++i) {
-                    bytes[i] = VMCODEBYTE(lc + i + 1);
-                    VM_printf("%02x ", bytes[i]);
-                }
-                VM_printf("%s ", op->name);
-                for (i = 0; i < sizeof(VMVALUE); ++i)
-                    VM_printf("%02x", bytes[i]);
-                VM_printf("\n");
-                n += sizeof(VMVALUE);
-                break;
-            case FMT_BR:
-                offset = 0;
-                for (i = 0; i < sizeof(VMWORD); ++i) {
-                    bytes[i] = VMCODEBYTE(lc + i + 1);
-                    offset = (offset << 8) | bytes[i];
-                    VM_printf("%02x ", bytes[i]);
-                }
-                for (i = sizeof(VMWORD); i < sizeof(VMVALUE); ++i)
-                    VM_printf("   ");
-                VM_printf("%s ", op->name);
-                for (i = 0; i < sizeof(VMWORD); ++i)
-                    VM_printf("%02x", bytes[i]);
-                VM_printf(" # %08x\n", (int)lc + 1 + sizeof(VMWORD) + offset);
-                n += sizeof(VMWORD);
-                break;
-            }
-            return n;
-        }
-            
-    /* unknown opcode */
-    VM_printf("      <UNKNOWN>\n");
-    return 1;
-}
-
+/* db_vmdebug.c - debug routines
+ *
+ * Copyright (c) 2014 by David Michael Betz.  All rights reserved.
+ *
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include "db_vmdebug.h"
+#include "db_image.h"
+
+OTDEF OpcodeTable[] = {
+{ OP_HALT,      "HALT",     FMT_NONE    },
+{ OP_BRT,       "BRT",      FMT_BR      },
+{ OP_BRTSC,     "BRTSC",    FMT_BR      },
+{ OP_BRF,       "BRF",      FMT_BR      },
+{ OP_BRFSC,     "BRFSC",    FMT_BR      },
+{ OP_BR,        "BR",       FMT_BR      },
+{ OP_NOT,       "NOT",      FMT_NONE    },
+{ OP_NEG,       "NEG",      FMT_NONE    },
+{ OP_ADD,       "ADD",      FMT_NONE    },
+{ OP_SUB,       "SUB",      FMT_NONE    },
+{ OP_MUL,       "MUL",      FMT_NONE    },
+{ OP_DIV,       "DIV",      FMT_NONE    },
+{ OP_REM,       "REM",      FMT_NONE    },
+{ OP_BNOT,      "BNOT",     FMT_NONE    },
+{ OP_BAND,      "BAND",     FMT_NONE    },
+{ OP_BOR,       "BOR",      FMT_NONE    },
+{ OP_BXOR,      "BXOR",     FMT_NONE    },
+{ OP_SHL,       "SHL",      FMT_NONE    },
+{ OP_SHR,       "SHR",      FMT_NONE    },
+{ OP_LT,        "LT",       FMT_NONE    },
+{ OP_LE,        "LE",       FMT_NONE    },
+{ OP_EQ,        "EQ",       FMT_NONE    },
+{ OP_NE,        "NE",       FMT_NONE    },
+{ OP_GE,        "GE",       FMT_NONE    },
+{ OP_GT,        "GT",       FMT_NONE    },
+{ OP_LIT,       "LIT",      FMT_LONG    },
+{ OP_SLIT,      "SLIT",     FMT_SBYTE   },
+{ OP_LOAD,      "LOAD",     FMT_NONE    },
+{ OP_LOADB,     "LOADB",    FMT_NONE    },
+{ OP_STORE,     "STORE",    FMT_NONE    },
+{ OP_STOREB,    "STOREB",   FMT_NONE    },
+{ OP_LADDR,     "LADDR",    FMT_SBYTE   },
+{ OP_INDEX,     "INDEX",    FMT_NONE    },
+{ OP_CALL,      "CALL",     FMT_BYTE    },
+#ifdef USE_STACK_DEPTH
+{ OP_FRAME,     "FRAME",    FMT_FRAME   },
+#else
+{ OP_FRAME,     "FRAME",    FMT_BYTE    },
+#endif
+{ OP_RETURN,    "RETURN",   FMT_NONE    },
+{ OP_DROP,      "DROP",     FMT_NONE    },
+{ OP_DUP,       "DUP",      FMT_NONE    },
+{ OP_TUCK,      "TUCK",     FMT_NONE    },
+{ OP_NATIVE,    "NATIVE",   FMT_LONG    },
+{ OP_TRAP,      "TRAP",     FMT_BYTE    },
+{ OP_GADDR,     "GADDR",    FMT_LONG    },
+{ OP_LLOAD,     "LLOAD",    FMT_SBYTE   },
+{ OP_LSTORE,    "LSTORE",   FMT_SBYTE   },
+{ OP_GLOAD,     "GLOAD",    FMT_LONG    },
+{ OP_ADDI,      "ADDI",     FMT_SBYTE   },
+{ OP_BRLT,      "BRLT",     FMT_BR      },
+{ OP_BRLE,      "BRLE",     FMT_BR      },
+{ OP_BREQ,      "BREQ",     FMT_BR      },
+{ OP_BRNE,      "BRNE",     FMT_BR      },
+{ OP_BRGE,      "BRGE",     FMT_BR      },
+{ OP_BRGT,      "BRGT",     FMT_BR      },
+{ OP_GSTORE,    "GSTORE",   FMT_LONG    },
+#ifdef USE_REGISTER_CODE
+{ OP_RNOT,      "RNOT",     FMT_REG2    },
+{ OP_RNEG,      "RNEG",     FMT_REG2    },
+{ OP_RADD,      "RADD",     FMT_REG3    },
+{ OP_RSUB,      "RSUB",     FMT_REG3    },
+{ OP_RMUL,      "RMUL",     FMT_REG3    },
+{ OP_RDIV,      "RDIV",     FMT_REG3    },
+{ OP_RREM,      "RREM",     FMT_REG3    },
+{ OP_RBNOT,     "RBNOT",    FMT_REG2    },
+{ OP_RBAND,     "RBAND",    FMT_REG3    },
+{ OP_RBOR,      "RBOR",     FMT_REG3    },
+{ OP_RBXOR,     "RBXOR",    FMT_REG3    },
+{ OP_RSHL,      "RSHL",     FMT_REG3    },
+{ OP_RSHR,      "RSHR",     FMT_REG3    },
+{ OP_RLT,       "RLT",      FMT_REG3    },
+{ OP_RLE,       "RLE",      FMT_REG3    },
+{ OP_REQ,       "REQ",      FMT_REG3    },
+{ OP_RNE,       "RNE",      FMT_REG3    },
+{ OP_RGE,       "RGE",      FMT_REG3    },
+{ OP_RGT,       "RGT",      FMT_REG3    },
+{ OP_RBRLT,     "RBRLT",    FMT_REG2BR  },
+{ OP_RBRLE,     "RBRLE",    FMT_REG2BR  },
+{ OP_RBREQ,     "RBREQ",    FMT_REG2BR  },
+{ OP_RBRNE,     "RBRNE",    FMT_REG2BR  },
+{ OP_RBRGE,     "RBRGE",    FMT_REG2BR  },
+{ OP_RBRGT,     "RBRGT",    FMT_REG2BR  },
+{ OP_RBRT,      "RBRT",     FMT_REGBR   },
+{ OP_RBRF,      "RBRF",     FMT_REGBR   },
+{ OP_RMOV,      "RMOV",     FMT_REG2    },
+{ OP_RLIT,      "RLIT",     FMT_REGLONG },
+{ OP_RGLOAD,    "RGLOAD",   FMT_REGLONG },
+{ OP_RGSTORE,   "RGSTORE",  FMT_REGLONG },
+{ OP_RLOAD,     "RLOAD",    FMT_REG2    },
+{ OP_RSTORE,    "RSTORE",   FMT_REG2    },
+{ OP_RINDEX,    "RINDEX",   FMT_REG3    },
+{ OP_RADDI,     "RADDI",    FMT_REG3    },
+{ OP_RPUSH,     "RPUSH",    FMT_SBYTE   },
+{ OP_RPOP,      "RPOP",     FMT_SBYTE   },
+{ OP_RSLIT,     "RSLIT",    FMT_REG2    },
+#endif
+{ 0,            NULL,       0           }
+};
+
+/* DecodeFunction - decode the instructions in a function code object */
+void DecodeFunction(const uint8_t *code, int len)
+{
+    const uint8_t *lc = code;
+    const uint8_t *end = code + len;
+    while (lc < end)
+        lc += DecodeInstruction(code, lc);
+}
+
+/* DecodeInstruction - decode a single bytecode instruction (showing addresses relative to code) */
+int DecodeInstruction(const uint8_t *code, const uint8_t *lc)
+{
+    uint8_t opcode, bytes[sizeof(VMVALUE)];
+    const uint8_t *operand;
+    const OTDEF *op;
+    VMWORD offset;
+    int8_t sbyte;
+    int n, nregs, i;
+
+    /* get the opcode */
+    opcode = VMCODEBYTE(lc);
+
+    /* show the address */
+    VM_printf("%08x %02x ", (int)(lc - code), opcode);
+    n = 1;
+
+    /* display the operands */
+    for (op = OpcodeTable; op->name; ++op)
+        if (opcode == op->code) {
+            switch (op->fmt) {
+            case FMT_NONE:
+                for (i = 0; i < sizeof(VMVALUE); ++i)
+                    VM_printf("   ");
+                VM_printf("%s\n", op->name);
+                break;
+            case FMT_BYTE:
+                bytes[0] = VMCODEBYTE(lc + 1);
+                VM_printf("%02x ", bytes[0]);
+                for (i = 1; i < sizeof(VMVALUE); ++i)
+                    VM_printf("   ");
+                VM_printf("%s %02x\n", op->name, bytes[0]);
+                n += 1;
+                break;
+            case FMT_FRAME:
+                bytes[0] = VMCODEBYTE(lc + 1);
+                bytes[1] = VMCODEBYTE(lc + 2);
+                VM_printf("%02x %02x ", bytes[0], bytes[1]);
+                for (i = 2; i < sizeof(VMVALUE); ++i)
+                    VM_printf("   ");
+                VM_printf("%s %02x %02x\n", op->name, bytes[0], bytes[1]);
+                n += 2;
+                break;
+            case FMT_SBYTE:
+                sbyte = (int8_t)VMCODEBYTE(lc + 1);
+                VM_printf("%02x ", (uint8_t)sbyte);
+                for (i = 1; i < sizeof(VMVALUE); ++i)
+                    VM_printf("   ");
+                VM_printf("%s %d\n", op->name, sbyte);
+                n += 1;
+                break;
+            case FMT_LONG:
+                operand = VMOPERAND(lc + 1, sizeof(VMVALUE));
+                for (i = 0; i < sizeof(VMVALUE); ++i) {
+                    bytes[i] = VMCODEBYTE(operand + i);
+                    VM_printf("%02x ", bytes[i]);
+                }
+                VM_printf("%s %08x\n", op->name, VMCODELONG(operand));
+                n = operand + sizeof(VMVALUE) - lc;
+                break;
+            case FMT_BR:
+                operand = VMOPERAND(lc + 1, sizeof(VMWORD));
+                offset = VMCODEWORD(operand);
+                for (i = 0; i < sizeof(VMWORD); ++i) {
+                    bytes[i] = VMCODEBYTE(operand + i);
+                    VM_printf("%02x ", bytes[i]);
+                }
+                for (i = sizeof(VMWORD); i < sizeof(VMVALUE); ++i)
+                    VM_printf("   ");
+                VM_printf("%s %04x", op->name, (uint16_t)offset);
+                VM_printf(" # %08x\n", (int)(operand + sizeof(VMWORD) + offset - code));
+                n = operand + sizeof(VMWORD) - lc;
+                break;
+            case FMT_REG2:
+            case FMT_REG3:
+            case FMT_REGLONG:
+            case FMT_REGBR:
+            case FMT_REG2BR:
+                switch (op->fmt) {
+                case FMT_REG3:
+                    nregs = 3;
+                    break;
+                case FMT_REG2:
+                case FMT_REG2BR:
+                    nregs = 2;
+                    break;
+                default:
+                    nregs = 1;
+                    break;
+                }
+                for (i = 0; i < nregs; ++i) {
+                    bytes[i] = VMCODEBYTE(lc + 1 + i);
+                    VM_printf("%02x ", bytes[i]);
+                }
+                for (; i < sizeof(VMVALUE); ++i)
+                    VM_printf("   ");
+                VM_printf("%s", op->name);
+                for (i = 0; i < nregs; ++i)
+                    VM_printf(" %d", (int8_t)bytes[i]);
+                n += nregs;
+                if (op->fmt == FMT_REGLONG) {
+                    operand = VMOPERAND(lc + n, sizeof(VMVALUE));
+                    VM_printf(" %08x", VMCODELONG(operand));
+                    n = operand + sizeof(VMVALUE) - lc;
+                }
+                else if (op->fmt == FMT_REGBR || op->fmt == FMT_REG2BR) {
+                    operand = VMOPERAND(lc + n, sizeof(VMWORD));
+                    offset = VMCODEWORD(operand);
+                    VM_printf(" %04x", (uint16_t)offset);
+                    VM_printf(" # %08x", (int)(operand + sizeof(VMWORD) + offset - code));
+                    n = operand + sizeof(VMWORD) - lc;
+                }
+                VM_printf("\n");
+                break;
+            }
+            return n;
+        }
+            
+    /* unknown opcode */
+    VM_printf("      <UNKNOWN>\n");
+    return 1;
+}
+
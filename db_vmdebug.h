@@ -1,30 +1,36 @@
-/* db_vmdebug.h - debug definitions
- *
- * Copyright (c) 2014 by David Michael Betz.  All rights reserved.
- *
- */
-
-#ifndef __DB_VMDEBUG_H__
-#define __DB_VMDEBUG_H__
-
-#include "db_types.h"
-
-/* instruction output formats */
-#define FMT_NONE        0
-#define FMT_BYTE        1
-#define FMT_SBYTE       2
-#define FMT_LONG        3
-#define FMT_BR          4
-
-typedef struct {
-    int code;
-    char *name;
-    int fmt;
-} OTDEF;
-
-extern OTDEF OpcodeTable[];
-
-void DecodeFunction(const uint8_t *code, int len);
-int DecodeInstruction(const uint8_t *code, const uint8_t *lc);
-
-#endif
+/* db_vmdebug.h - debug definitions
+ *
+ * Copyright (c) 2014 by David Michael Betz.  All rights reserved.
+ *
+ */
+
+#ifndef __DB_VMDEBUG_H__
+#define __DB_VMDEBUG_H__
+
+#include "db_types.h"
+
+/* instruction output formats */
+#define FMT_NONE        0
+#define FMT_BYTE        1
+#define FMT_SBYTE       2
+#define FMT_LONG        3
+#define FMT_BR          4
+#define FMT_FRAME       5
+#define FMT_REG2        6   /* two register operands */
+#define FMT_REG3        7   /* three register operands (or two and an immediate) */
+#define FMT_REGLONG     8   /* a register and a long */
+#define FMT_REGBR       9   /* a register and a branch offset */
+#define FMT_REG2BR      10  /* two registers and a branch offset */
+
+typedef struct {
+    int code;
+    char *name;
+    int fmt;
+} OTDEF;
+
+extern OTDEF OpcodeTable[];
+
+void DecodeFunction(const uint8_t *code, int len);
+int DecodeInstruction(const uint8_t *code, const uint8_t *lc);
+
+#endif
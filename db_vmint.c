@@ -1,334 +1,1638 @@
-/* db_vmint.c - bytecode interpreter for a simple virtual machine
- *
- * Copyright (c) 2014 by David Michael Betz.  All rights reserved.
- *
- */
-
-#include <stdio.h>
-#include <stdlib.h>
-#include <stdarg.h>
-#include <string.h>
-#include <ctype.h>
-#include "db_vm.h"
-#include "db_vmdebug.h"
-
-//#define DEBUG
-
-/* interpreter state structure */
-typedef struct {
-    System *sys;
-    ImageHdr *image;
-    VMVALUE *stack;
-    VMVALUE *stackTop;
-    uint8_t *pc;
-    VMVALUE *fp;
-    VMVALUE *sp;
-    VMVALUE tos;
-} Interpreter;
-
-/* stack manipulation macros */
-#define Reserve(i, n)   do {                                    \
-                            if ((i)->sp - (n) < (i)->stack)     \
-                                StackOverflow(i);               \
-                            else                                \
-                                (i)->sp -= (n);                 \
-                        } while (0)
-#define CPush(i, v)     do {                                    \
-                            if ((i)->sp <= (i)->stack)          \
-                                StackOverflow(i);               \
-                            else                                \
-                                Push(i, v);                     \
-                        } while (0)
-#define Push(i, v)      (*--(i)->sp = (v))
-#define Pop(i)          (*(i)->sp++)
-#define Top(i)          (*(i)->sp)
-#define Drop(i, n)      ((i)->sp += (n))
-
-/* prototypes for local functions */
-static void DoTrap(Interpreter *i, int op);
-static void StackOverflow(Interpreter *i);
-#ifdef DEBUG
-static void ShowStack(Interpreter *i);
-#endif
-
-/* Execute - execute the main code */
-int Execute(System *sys, ImageHdr *image, VMVALUE main)
-{
-    size_t stackSize;
-    Interpreter *i;
-    VMVALUE tmp;
-    VMWORD tmpw;
-    int8_t tmpb;
-    int cnt;
-
-    /* allocate the interpreter state */
-    if (!(i = (Interpreter *)AllocateFreeSpace(sys, sizeof(Interpreter))))
-        return VMFALSE;
-
-    /* make sure there is space left for the stack */
-    if ((stackSize = sys->freeTop - sys->freeNext) < MIN_STACK_SIZE)
-        return VMFALSE;
-
-	/* setup the new image */
-    i->sys = sys;
-	i->image = image;
-    i->stack = (VMVALUE *)((uint8_t *)i + sizeof(Interpreter));
-    i->stackTop = (VMVALUE *)((uint8_t *)i->stack + stackSize);
-
-    /* initialize */    
-    i->pc = (uint8_t *)main;
-    i->sp = i->fp = i->stackTop;
-
-    if (setjmp(i->sys->errorTarget))
-        return VMFALSE;
-
-    for (;;) {
-#ifdef DEBUG
-        ShowStack(i);
-        DecodeInstruction(i->pc, i->pc);
-#endif
-        switch (VMCODEBYTE(i->pc++)) {
-        case OP_HALT:
-            return VMTRUE;
-        case OP_BRT:
-            for (tmpw = 0, cnt = sizeof(VMWORD); --cnt >= 0; )
-                tmpw = (tmpw << 8) | VMCODEBYTE(i->pc++);
-            if (i->tos)
-                i->pc += tmpw;
-            i->tos = Pop(i);
-            break;
-        case OP_BRTSC:
-            for (tmpw = 0, cnt = sizeof(VMWORD); --cnt >= 0; )
-                tmpw = (tmpw << 8) | VMCODEBYTE(i->pc++);
-            if (i->tos)
-                i->pc += tmpw;
-            else
-                i->tos = Pop(i);
-            break;
-        case OP_BRF:
-            for (tmpw = 0, cnt = sizeof(VMWORD); --cnt >= 0; )
-                tmpw = (tmpw << 8) | VMCODEBYTE(i->pc++);
-            if (!i->tos)
-                i->pc += tmpw;
-            i->tos = Pop(i);
-            break;
-        case OP_BRFSC:
-            for (tmpw = 0, cnt = sizeof(VMWORD); --cnt >= 0; )
-                tmpw = (tmpw << 8) | VMCODEBYTE(i->pc++);
-            if (!i->tos)
-                i->pc += tmpw;
-            else
-                i->tos = Pop(i);
-            break;
-        case OP_BR:
-            for (tmpw = 0, cnt = sizeof(VMWORD); --cnt >= 0; )
-                tmpw = (tmpw << 8) | VMCODEBYTE(i->pc++);
-            i->pc += tmpw;
-            break;
-        case OP_NOT:
-            i->tos = (i->tos ? VMFALSE : VMTRUE);
-            break;
-        case OP_NEG:
-            i->tos = -i->tos;
-            break;
-        case OP_ADD:
-            tmp = Pop(i);
-            i->tos = tmp + i->tos;
-            break;
-        case OP_SUB:
-            tmp = Pop(i);
-            i->tos = tmp - i->tos;
-            break;
-        case OP_MUL:
-            tmp = Pop(i);
-            i->tos = tmp * i->tos;
-            break;
-        case OP_DIV:
-            tmp = Pop(i);
-            i->tos = (i->tos == 0 ? 0 : tmp / i->tos);
-            break;
-        case OP_REM:
-            tmp = Pop(i);
-            i->tos = (i->tos == 0 ? 0 : tmp % i->tos);
-            break;
-        case OP_BNOT:
-            i->tos = ~i->tos;
-            break;
-        case OP_BAND:
-            tmp = Pop(i);
-            i->tos = tmp & i->tos;
-            break;
-        case OP_BOR:
-            tmp = Pop(i);
-            i->tos = tmp | i->tos;
-            break;
-        case OP_BXOR:
-            tmp = Pop(i);
-            i->tos = tmp ^ i->tos;
-            break;
-        case OP_SHL:
-            tmp = Pop(i);
-            i->tos = tmp << i->tos;
-            break;
-        case OP_SHR:
-            tmp = Pop(i);
-            i->tos = tmp >> i->tos;
-            break;
-        case OP_LT:
-            tmp = Pop(i);
-            i->tos = (tmp < i->tos ? VMTRUE : VMFALSE);
-            break;
-        case OP_LE:
-            tmp = Pop(i);
-            i->tos = (tmp <= i->tos ? VMTRUE : VMFALSE);
-            break;
-        case OP_EQ:
-            tmp = Pop(i);
-            i->tos = (tmp == i->tos ? VMTRUE : VMFALSE);
-            break;
-        case OP_NE:
-            tmp = Pop(i);
-            i->tos = (tmp != i->tos ? VMTRUE : VMFALSE);
-            break;
-        case OP_GE:
-            tmp = Pop(i);
-            i->tos = (tmp >= i->tos ? VMTRUE : VMFALSE);
-            break;
-        case OP_GT:
-            tmp = Pop(i);
-            i->tos = (tmp > i->tos ? VMTRUE : VMFALSE);
-            break;
-        case OP_LIT:
-            for (tmp = 0, cnt = sizeof(VMVALUE); --cnt >= 0; )
-                tmp = (tmp << 8) | VMCODEBYTE(i->pc++);
-            CPush(i, i->tos);
-            i->tos = tmp;
-            break;
-        case OP_SLIT:
-            tmpb = (int8_t)VMCODEBYTE(i->pc++);
-            CPush(i, i->tos);
-            i->tos = tmpb;
-            break;
-        case OP_LOAD:
-            i->tos = *(VMVALUE *)i->tos;
-            break;
-        case OP_LOADB:
-            i->tos = *(uint8_t *)i->tos;
-            break;
-        case OP_STORE:
-            tmp = Pop(i);
-            *(VMVALUE *)tmp = i->tos;
-            break;
-        case OP_STOREB:
-            tmp = Pop(i);
-            *(uint8_t *)tmp = i->tos;
-            break;
-        case OP_LADDR:
-            tmpb = (int8_t)VMCODEBYTE(i->pc++);
-            CPush(i, i->tos);
-            i->tos = (VMVALUE)&i->fp[(int)tmpb];
-            break;
-        case OP_INDEX:
-            tmp = Pop(i);
-            i->tos = tmp + i->tos * sizeof (VMVALUE);
-            break;
-        case OP_CALL:
-            ++i->pc; // skip over the argument count
-            tmp = i->tos;
-            i->tos = (VMVALUE)i->pc;
-            i->pc = (uint8_t *)tmp;
-            break;
-        case OP_FRAME:
-            cnt = VMCODEBYTE(i->pc++);
-            tmp = (VMVALUE)i->fp;
-            i->fp = i->sp;
-            Reserve(i, cnt);
-            i->sp[0] = i->tos;
-            i->sp[1] = tmp;
-            break;
-        case OP_RETURN:
-            i->pc = (uint8_t *)Top(i);
-            i->sp = i->fp;
-            Drop(i, i->pc[-1]);
-            i->fp = (VMVALUE *)i->fp[-1];
-            break;
-        case OP_DROP:
-            i->tos = Pop(i);
-            break;
-        case OP_DUP:
-            CPush(i, i->tos);
-            break;
-        case OP_TUCK:
-            CPush(i, i->tos);
-            tmp = i->sp[0];
-            i->sp[0] = i->sp[1];
-            i->sp[1] = tmp;
-            break;
-        case OP_NATIVE:
-            for (tmp = 0, cnt = sizeof(VMUVALUE); --cnt >= 0; )
-                tmp = (tmp << 8) | VMCODEBYTE(i->pc++);
-            break;
-        case OP_TRAP:
-            DoTrap(i, VMCODEBYTE(i->pc++));
-            break;
-        default:
-            Abort(i->sys, "undefined opcode 0x%02x", VMCODEBYTE(i->pc - 1));
-            break;
-        }
-    }
-}
-
-static void DoTrap(Interpreter *i, int op)
-{
-    switch (op) {
-    case TRAP_GetChar:
-        Push(i, i->tos);
-        i->tos = VM_getchar();
-        break;
-    case TRAP_PutChar:
-        VM_putchar(i->tos);
-        i->tos = Pop(i);
-        break;
-    case TRAP_PrintStr:
-        VM_printf("%s", (char *)i->tos);
-        i->tos = *i->sp++;
-        break;
-    case TRAP_PrintInt:
-        VM_printf("%d", i->tos);
-        i->tos = *i->sp++;
-        break;
-    case TRAP_PrintTab:
-        VM_putchar('\t');
-        break;
-    case TRAP_PrintNL:
-        VM_putchar('\n');
-        break;
-    case TRAP_PrintFlush:
-        VM_flush();
-        break;
-    default:
-        Abort(i->sys, "undefined trap %d", op);
-        break;
-    }
-}
-
-static void StackOverflow(Interpreter *i)
-{
-    Abort(i->sys, "stack overflow");
-}
-
-#ifdef DEBUG
-static void ShowStack(Interpreter *i)
-{
-    VMVALUE *p;
-    if (i->sp < i->stackTop) {
-        VM_printf(" %d", i->tos);
-        for (p = i->sp; p < i->stackTop - 1; ++p) {
-            if (p == i->fp)
-                VM_printf(" <fp>");
-            VM_printf(" %d", *p);
-        }
-        VM_printf("\n");
-    }
-}
-#endif
+/* db_vmint.c - bytecode interpreter for a simple virtual machine
+ *
+ * Copyright (c) 2014 by David Michael Betz.  All rights reserved.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <ctype.h>
+#include "db_vm.h"
+#include "db_vmdebug.h"
+
+//#define DEBUG
+
+/* use threaded dispatch through a table of label addresses when the compiler
+   supports gcc's labels-as-values extension, otherwise fall back to a switch */
+#if defined(__GNUC__) && !defined(NO_COMPUTED_GOTO)
+#define USE_COMPUTED_GOTO
+#endif
+
+#if defined(USE_THREADED_CODE) && !defined(USE_COMPUTED_GOTO)
+#error USE_THREADED_CODE requires computed goto support
+#endif
+
+/* USE_STACK_CACHE caches a second stack value in a register using separate
+   dispatch tables for the states with one and two cached values */
+#ifdef USE_STACK_CACHE
+#if !defined(USE_COMPUTED_GOTO) || defined(USE_THREADED_CODE)
+#error USE_STACK_CACHE requires the bytecode interpreter with computed goto
+#endif
+#ifdef DEBUG
+#error USE_STACK_CACHE requires a build without DEBUG
+#endif
+#endif
+
+#ifdef USE_TIERS
+#ifdef USE_THREADED_CODE
+#error USE_TIERS requires the bytecode interpreter
+#endif
+#ifndef USE_STACK_DEPTH
+#error USE_TIERS requires USE_STACK_DEPTH
+#endif
+#endif
+
+/* fuel given to the interpreter by each Run call in Execute */
+#define EXECUTE_FUEL    0x7fffffff
+
+/* stack manipulation macros (the interpreter registers are cached in locals)
+
+   When the compiler records the maximum stack depth of each function in its
+   FRAME instruction the stack is checked once on entry and pushes are not. */
+#ifdef USE_STACK_DEPTH
+#define CheckStack(i, n) do {                                   \
+                            if (sp - (n) < (i)->stack)          \
+                                StackOverflow(i);               \
+                        } while (0)
+#define Reserve(i, n)   (sp -= (n))
+#define CPush(i, v)     Push(v)
+#else
+#define Reserve(i, n)   do {                                    \
+                            if (sp - (n) < (i)->stack)          \
+                                StackOverflow(i);               \
+                            else                                \
+                                sp -= (n);                      \
+                        } while (0)
+#define CPush(i, v)     do {                                    \
+                            if (sp <= (i)->stack)               \
+                                StackOverflow(i);               \
+                            else                                \
+                                Push(v);                        \
+                        } while (0)
+#endif
+#define Push(v)         (*--sp = (v))
+#define Pop()           (*sp++)
+#define Top()           (*sp)
+#define Drop(n)         (sp += (n))
+
+/* move the cached interpreter registers to and from the state structure */
+#define SaveState(i)    ((i)->pc = pc, (i)->sp = sp, (i)->fp = fp, (i)->tos = tos)
+#define RestoreState(i) (pc = (i)->pc, sp = (i)->sp, fp = (i)->fp, tos = (i)->tos)
+
+/* instruction trace hook */
+#ifdef DEBUG
+#ifdef USE_THREADED_CODE
+#define TRACE(i)        do {                                    \
+                            SaveState(i);                       \
+                            ShowStack(i);                       \
+                            ShowCell(dispatch, pc);             \
+                        } while (0)
+#else
+#define TRACE(i)        do {                                    \
+                            SaveState(i);                       \
+                            ShowStack(i);                       \
+                            DecodeInstruction((uint8_t *)i->image, pc); \
+                        } while (0)
+#endif
+#else
+#define TRACE(i)
+#endif
+
+/* opcode pair profiling hook (build with -DPAIR_STATS to choose superinstructions) */
+#ifdef PAIR_STATS
+#ifdef USE_THREADED_CODE
+#error PAIR_STATS requires the bytecode interpreter
+#endif
+static uint32_t pairCounts[256][256];
+static int lastOpcode;
+#define PROFILE()       do {                                    \
+                            ++pairCounts[lastOpcode][VMCODEBYTE(pc)]; \
+                            lastOpcode = VMCODEBYTE(pc);        \
+                        } while (0)
+#else
+#define PROFILE()
+#endif
+
+/* operand fetch and branch macros */
+#ifdef USE_THREADED_CODE
+#define GetByte(v)      ((v) = (pc++)->value)
+#define GetSByte(v)     ((v) = (pc++)->value)
+#define GetLong(v)      ((v) = (pc++)->value)
+#define Branch()        do {                                    \
+                            if (pc->target < pc) {              \
+                                pc = pc->target;                \
+                                BackwardBranch(i);              \
+                            }                                   \
+                            else                                \
+                                pc = pc->target;                \
+                        } while (0)
+#define SkipBranch()    (++pc)
+#define ArgCount(pc)    ((pc)[-1].value)
+#else
+#define GetByte(v)      ((v) = VMCODEBYTE(pc++))
+#define GetSByte(v)     ((v) = (int8_t)VMCODEBYTE(pc++))
+#define GetLong(v)      do {                                    \
+                            pc = VMOPERAND(pc, sizeof(VMVALUE)); \
+                            (v) = VMCODELONG(pc);               \
+                            pc += sizeof(VMVALUE);              \
+                        } while (0)
+#define Branch()        do {                                    \
+                            pc = VMOPERAND(pc, sizeof(VMWORD)); \
+                            offset = VMCODEWORD(pc);            \
+                            pc += sizeof(VMWORD) + offset;      \
+                            if (offset < 0)                     \
+                                BackwardBranch(i);              \
+                        } while (0)
+#define SkipBranch()    (pc = VMOPERAND(pc, sizeof(VMWORD)) + sizeof(VMWORD))
+#define ArgCount(pc)    ((pc)[-1])
+#endif
+
+/* pop both operands of a compare-and-branch instruction before branching so
+   that the stack is already in its final state at a backward branch */
+#define CompareBranch(cond) do {                                \
+                            tmp = Pop();                        \
+                            cnt = (cond);                       \
+                            tos = Pop();                        \
+                            if (cnt)                            \
+                                Branch();                       \
+                            else                                \
+                                SkipBranch();                   \
+                        } while (0)
+
+/* the same with the operands in nos and tos (leaving the one register state) */
+#define CompareBranch2(cond) do {                               \
+                            cnt = (cond);                       \
+                            tos = Pop();                        \
+                            if (cnt)                            \
+                                Branch();                       \
+                            else                                \
+                                SkipBranch();                   \
+                        } while (0)
+
+/* fuel macros
+
+   Fuel is charged after a backward branch has been taken and after a frame
+   has been built so the state saved on a yield is always between two
+   instructions with nothing left in nos. */
+#define Charge(i)       do {                                    \
+                            if (--(i)->fuel <= 0) {             \
+                                SaveState(i);                   \
+                                (i)->status = VMSTS_YIELD;      \
+                                return NULL;                    \
+                            }                                   \
+                        } while (0)
+#ifdef USE_TIERS
+#define BackwardBranch(i) do {                                  \
+                            CountLoop(i);                       \
+                            Charge(i);                          \
+                        } while (0)
+#else
+#define BackwardBranch(i) Charge(i)
+#endif
+
+/* tiered execution macros (the profile of the running code is kept in its frame) */
+#ifdef USE_TIERS
+#define CountLoop(i)    do {                                    \
+                            profile = (Profile *)VMPTR(base, fp[-3]); \
+                            if (++profile->loops == (i)->sys->tierThreshold) { \
+                                SaveState(i);                   \
+                                PromoteLoop(i, profile);        \
+                                RestoreState(i);                \
+                            }                                   \
+                        } while (0)
+#endif
+
+/* register operand macros (registers are frame slots addressed by signed offsets from fp) */
+#ifdef USE_REGISTER_CODE
+#define GetReg(r)       GetSByte(r)
+#define Reg(r)          fp[r]
+#define RegOp2(expr)    do {                                    \
+                            GetReg(rd);                         \
+                            GetReg(ra);                         \
+                            Reg(rd) = (expr);                   \
+                        } while (0)
+#define RegOp3(expr)    do {                                    \
+                            GetReg(rd);                         \
+                            GetReg(ra);                         \
+                            GetReg(rb);                         \
+                            Reg(rd) = (expr);                   \
+                        } while (0)
+#define RegBranch2(cond) do {                                   \
+                            GetReg(ra);                         \
+                            GetReg(rb);                         \
+                            if (cond)                           \
+                                Branch();                       \
+                            else                                \
+                                SkipBranch();                   \
+                        } while (0)
+#endif
+
+/* opcode dispatch macros */
+#ifdef USE_COMPUTED_GOTO
+#define OPCODE(op)      L_##op
+#define UNDEFINED       L_UNDEFINED
+#ifdef USE_THREADED_CODE
+#define DISPATCH(i)     do {                                    \
+                            TRACE(i);                           \
+                            goto *(pc++)->handler;              \
+                        } while (0)
+#else
+#define DISPATCH(i)     do {                                    \
+                            TRACE(i);                           \
+                            PROFILE();                          \
+                            goto *dispatch[VMCODEBYTE(pc++)];   \
+                        } while (0)
+#endif
+#define NEXT(i)         DISPATCH(i)
+#ifdef USE_STACK_CACHE
+#define OPCODE2(op)     L2_##op
+#define NEXT2(i)        do {                                    \
+                            PROFILE();                          \
+                            goto *dispatch2[VMCODEBYTE(pc++)];  \
+                        } while (0)
+#endif
+#else
+#define OPCODE(op)      case op
+#define UNDEFINED       default
+#define NEXT(i)         break
+#endif
+
+/* stack cache macros
+
+   In the one register state the top of the stack is in tos.  Pushing a value
+   moves tos into nos and continues in the two register state where only the
+   OPCODE2 handlers run.  Any other instruction first moves nos back onto the
+   stack.  Without the cache NEXT2 continues like NEXT. */
+#ifdef USE_STACK_CACHE
+#define CachePush(i, v) (nos = tos, tos = (v))
+#else
+#define CachePush(i, v) do {                                    \
+                            CPush(i, tos);                      \
+                            tos = (v);                          \
+                        } while (0)
+#define NEXT2(i)        NEXT(i)
+#endif
+
+/* prototypes for local functions */
+static void **Interpret(Interpreter *i);
+#ifdef USE_THREADED_CODE
+static const OTDEF *FindOpcode(int code);
+#endif
+static void DoTrap(Interpreter *i, int op);
+static void StackOverflow(Interpreter *i);
+#ifdef USE_TIERS
+static VMVALUE Promote(Interpreter *i, Profile *profile, int loop);
+static void PromoteLoop(Interpreter *i, Profile *profile);
+#endif
+#ifdef PAIR_STATS
+static void ShowPairStats(void);
+#endif
+#ifdef DEBUG
+static void ShowStack(Interpreter *i);
+#ifdef USE_THREADED_CODE
+static void ShowCell(void **dispatch, VMCELL *pc);
+#endif
+#endif
+
+/* Execute - execute the main code */
+int Execute(System *sys, ImageHdr *image, VMVALUE main)
+{
+    Interpreter *i;
+    int status;
+
+    /* use the rest of the free space for the stack */
+    if (!(i = NewInterpreter(sys, image, main, 0)))
+        return VMFALSE;
+
+    /* run to completion */
+    while ((status = Run(i, EXECUTE_FUEL)) == VMSTS_YIELD)
+        ;
+
+    return status == VMSTS_HALT;
+}
+
+/* NewInterpreter - create an interpreter to run the main code
+
+   The interpreter and its stack are allocated from free space.  A stack size
+   of zero uses the rest of the free space for the stack up to MAX_STACK_SIZE
+   when there is a limit. */
+Interpreter *NewInterpreter(System *sys, ImageHdr *image, VMVALUE main, size_t stackSize)
+{
+    Interpreter *i;
+
+    /* allocate the interpreter state */
+    if (!(i = (Interpreter *)AllocateFreeSpace(sys, sizeof(Interpreter))))
+        return NULL;
+
+    /* make sure there is space left for the stack */
+    if (stackSize == 0) {
+        if ((stackSize = sys->freeTop - sys->freeNext) < MIN_STACK_SIZE)
+            return NULL;
+#ifdef MAX_STACK_SIZE
+        if (stackSize > MAX_STACK_SIZE)
+            stackSize = MAX_STACK_SIZE;
+#endif
+    }
+    else if (stackSize < MIN_STACK_SIZE || !AllocateFreeSpace(sys, stackSize))
+        return NULL;
+
+	/* setup the new image */
+    i->sys = sys;
+	i->image = image;
+    i->globals = image->data;
+    i->stack = (VMVALUE *)((uint8_t *)i + sizeof(Interpreter));
+    i->stackTop = (VMVALUE *)((uint8_t *)i->stack + stackSize);
+
+    /* initialize */    
+    i->pc = (VMCODE *)VMPTR(image, main);
+    i->sp = i->fp = i->stackTop;
+    i->tos = 0;
+    i->fuel = 0;
+    i->status = VMSTS_YIELD;
+    i->next = NULL;
+#ifdef USE_THREADED_CODE
+    i->callReturn[1].handler = Interpret(NULL)[OP_HALT];
+#else
+    i->callReturn[1] = OP_HALT;
+#endif
+
+    return i;
+}
+
+/* NewCall - create an interpreter to call a function with arguments
+
+   The interpreter is set up as if a CALL instruction had just been executed
+   with a return address pointing at a HALT instruction so it halts with the
+   return value in tos.  The function uses the global segment of the image
+   unless it is given a copy of its own.  Returns NULL if the function
+   doesn't take argc arguments or there isn't room for the interpreter. */
+Interpreter *NewCall(System *sys, ImageHdr *image, uint8_t *globals, Symbol *function, int argc, const VMVALUE *argv)
+{
+    Interpreter *i;
+    VMVALUE code;
+    int n;
+
+    /* make sure the function is defined and takes these arguments */
+    if (function->storageClass != SC_FUNCTION || argc != function->argumentCount)
+        return NULL;
+    if (!globals)
+        globals = image->data;
+    code = *GlobalCell(globals, function);
+
+    /* use the rest of the free space for the stack */
+    if (!(i = NewInterpreter(sys, image, code, 0)))
+        return NULL;
+    i->globals = globals;
+
+    /* push the arguments */
+    if (argc > 255 || i->sp - argc < i->stack)
+        return NULL;
+    for (n = 0; n < argc; ++n)
+        *--i->sp = argv[n];
+
+    /* return to the HALT instruction */
+#ifdef USE_THREADED_CODE
+    i->callReturn[0].value = argc;
+#else
+    i->callReturn[0] = argc;
+#endif
+    i->tos = VMADDR(image, &i->callReturn[1]);
+
+    return i;
+}
+
+/* Call - call a function with arguments and get its return value
+
+   Returns VMFALSE without running anything if the function doesn't take
+   argc arguments. */
+int Call(System *sys, ImageHdr *image, uint8_t *globals, Symbol *function, int argc, const VMVALUE *argv, VMVALUE *pValue)
+{
+    Interpreter *i;
+    int status;
+
+    if (!(i = NewCall(sys, image, globals, function, argc, argv)))
+        return VMFALSE;
+
+    /* run to completion */
+    while ((status = Run(i, EXECUTE_FUEL)) == VMSTS_YIELD)
+        ;
+    if (status != VMSTS_HALT)
+        return VMFALSE;
+
+    *pValue = i->tos;
+    return VMTRUE;
+}
+
+/* Run - run or resume an interpreter until it halts or uses up its fuel
+
+   Each backward branch and each function call uses one unit of fuel.  When
+   the fuel runs out the interpreter stops at the next instruction and
+   returns VMSTS_YIELD so that it can be resumed by calling Run again.  Code
+   running in native code is not metered. */
+int Run(Interpreter *i, VMVALUE fuel)
+{
+    /* only an interpreter that yielded can be resumed */
+    if (i->status != VMSTS_YIELD)
+        return i->status;
+
+    i->fuel = fuel;
+    i->status = VMSTS_ERROR;
+
+    if (setjmp(i->sys->errorTarget))
+        return VMSTS_ERROR;
+
+#ifdef PAIR_STATS
+    {
+        static int registered = VMFALSE;
+        if (!registered) {
+            atexit(ShowPairStats);
+            registered = VMTRUE;
+        }
+    }
+#endif
+
+    Interpret(i);
+
+    return i->status;
+}
+
+/* Interpret - run the interpreter loop until a HALT instruction
+
+   When called with a NULL interpreter this just returns the opcode dispatch
+   table so that ThreadCode can look up the handler addresses. */
+static void **Interpret(Interpreter *i)
+{
+    VMCODE *pc;
+    VMVALUE *sp, *fp, tos;
+    uint8_t *base, *globals;
+    VMVALUE tmp;
+    int8_t tmpb;
+    int cnt;
+#ifdef USE_STACK_CACHE
+    VMVALUE nos = 0;
+#endif
+#ifdef USE_REGISTER_CODE
+    int rd, ra, rb;
+#endif
+#ifndef USE_THREADED_CODE
+    int offset;
+#endif
+#ifdef USE_TIERS
+    Profile *profile;
+#endif
+#ifdef USE_COMPUTED_GOTO
+    static void *dispatch[256] = {
+        [0 ... 255] = &&UNDEFINED,
+        [OP_HALT]   = &&OPCODE(OP_HALT),
+        [OP_BRT]    = &&OPCODE(OP_BRT),
+        [OP_BRTSC]  = &&OPCODE(OP_BRTSC),
+        [OP_BRF]    = &&OPCODE(OP_BRF),
+        [OP_BRFSC]  = &&OPCODE(OP_BRFSC),
+        [OP_BR]     = &&OPCODE(OP_BR),
+        [OP_NOT]    = &&OPCODE(OP_NOT),
+        [OP_NEG]    = &&OPCODE(OP_NEG),
+        [OP_ADD]    = &&OPCODE(OP_ADD),
+        [OP_SUB]    = &&OPCODE(OP_SUB),
+        [OP_MUL]    = &&OPCODE(OP_MUL),
+        [OP_DIV]    = &&OPCODE(OP_DIV),
+        [OP_REM]    = &&OPCODE(OP_REM),
+        [OP_BNOT]   = &&OPCODE(OP_BNOT),
+        [OP_BAND]   = &&OPCODE(OP_BAND),
+        [OP_BOR]    = &&OPCODE(OP_BOR),
+        [OP_BXOR]   = &&OPCODE(OP_BXOR),
+        [OP_SHL]    = &&OPCODE(OP_SHL),
+        [OP_SHR]    = &&OPCODE(OP_SHR),
+        [OP_LT]     = &&OPCODE(OP_LT),
+        [OP_LE]     = &&OPCODE(OP_LE),
+        [OP_EQ]     = &&OPCODE(OP_EQ),
+        [OP_NE]     = &&OPCODE(OP_NE),
+        [OP_GE]     = &&OPCODE(OP_GE),
+        [OP_GT]     = &&OPCODE(OP_GT),
+        [OP_LIT]    = &&OPCODE(OP_LIT),
+        [OP_SLIT]   = &&OPCODE(OP_SLIT),
+        [OP_LOAD]   = &&OPCODE(OP_LOAD),
+        [OP_LOADB]  = &&OPCODE(OP_LOADB),
+        [OP_STORE]  = &&OPCODE(OP_STORE),
+        [OP_STOREB] = &&OPCODE(OP_STOREB),
+        [OP_LADDR]  = &&OPCODE(OP_LADDR),
+        [OP_INDEX]  = &&OPCODE(OP_INDEX),
+        [OP_CALL]   = &&OPCODE(OP_CALL),
+        [OP_FRAME]  = &&OPCODE(OP_FRAME),
+        [OP_RETURN] = &&OPCODE(OP_RETURN),
+        [OP_DROP]   = &&OPCODE(OP_DROP),
+        [OP_DUP]    = &&OPCODE(OP_DUP),
+        [OP_TUCK]   = &&OPCODE(OP_TUCK),
+        [OP_NATIVE] = &&OPCODE(OP_NATIVE),
+        [OP_TRAP]   = &&OPCODE(OP_TRAP),
+        [OP_GADDR]  = &&OPCODE(OP_GADDR),
+        [OP_LLOAD]  = &&OPCODE(OP_LLOAD),
+        [OP_LSTORE] = &&OPCODE(OP_LSTORE),
+        [OP_GLOAD]  = &&OPCODE(OP_GLOAD),
+        [OP_ADDI]   = &&OPCODE(OP_ADDI),
+        [OP_BRLT]   = &&OPCODE(OP_BRLT),
+        [OP_BRLE]   = &&OPCODE(OP_BRLE),
+        [OP_BREQ]   = &&OPCODE(OP_BREQ),
+        [OP_BRNE]   = &&OPCODE(OP_BRNE),
+        [OP_BRGE]   = &&OPCODE(OP_BRGE),
+        [OP_BRGT]   = &&OPCODE(OP_BRGT),
+        [OP_GSTORE] = &&OPCODE(OP_GSTORE),
+#ifdef USE_REGISTER_CODE
+        [OP_RNOT]   = &&OPCODE(OP_RNOT),
+        [OP_RNEG]   = &&OPCODE(OP_RNEG),
+        [OP_RADD]   = &&OPCODE(OP_RADD),
+        [OP_RSUB]   = &&OPCODE(OP_RSUB),
+        [OP_RMUL]   = &&OPCODE(OP_RMUL),
+        [OP_RDIV]   = &&OPCODE(OP_RDIV),
+        [OP_RREM]   = &&OPCODE(OP_RREM),
+        [OP_RBNOT]  = &&OPCODE(OP_RBNOT),
+        [OP_RBAND]  = &&OPCODE(OP_RBAND),
+        [OP_RBOR]   = &&OPCODE(OP_RBOR),
+        [OP_RBXOR]  = &&OPCODE(OP_RBXOR),
+        [OP_RSHL]   = &&OPCODE(OP_RSHL),
+        [OP_RSHR]   = &&OPCODE(OP_RSHR),
+        [OP_RLT]    = &&OPCODE(OP_RLT),
+        [OP_RLE]    = &&OPCODE(OP_RLE),
+        [OP_REQ]    = &&OPCODE(OP_REQ),
+        [OP_RNE]    = &&OPCODE(OP_RNE),
+        [OP_RGE]    = &&OPCODE(OP_RGE),
+        [OP_RGT]    = &&OPCODE(OP_RGT),
+        [OP_RBRLT]  = &&OPCODE(OP_RBRLT),
+        [OP_RBRLE]  = &&OPCODE(OP_RBRLE),
+        [OP_RBREQ]  = &&OPCODE(OP_RBREQ),
+        [OP_RBRNE]  = &&OPCODE(OP_RBRNE),
+        [OP_RBRGE]  = &&OPCODE(OP_RBRGE),
+        [OP_RBRGT]  = &&OPCODE(OP_RBRGT),
+        [OP_RBRT]   = &&OPCODE(OP_RBRT),
+        [OP_RBRF]   = &&OPCODE(OP_RBRF),
+        [OP_RMOV]   = &&OPCODE(OP_RMOV),
+        [OP_RLIT]   = &&OPCODE(OP_RLIT),
+        [OP_RGLOAD] = &&OPCODE(OP_RGLOAD),
+        [OP_RGSTORE] = &&OPCODE(OP_RGSTORE),
+        [OP_RLOAD]  = &&OPCODE(OP_RLOAD),
+        [OP_RSTORE] = &&OPCODE(OP_RSTORE),
+        [OP_RINDEX] = &&OPCODE(OP_RINDEX),
+        [OP_RADDI]  = &&OPCODE(OP_RADDI),
+        [OP_RPUSH]  = &&OPCODE(OP_RPUSH),
+        [OP_RPOP]   = &&OPCODE(OP_RPOP),
+        [OP_RSLIT]  = &&OPCODE(OP_RSLIT),
+#endif
+    };
+#ifdef USE_STACK_CACHE
+    static void *dispatch2[256] = {
+        [0 ... 255] = &&SPILL,
+        [OP_BRT]    = &&OPCODE2(OP_BRT),
+        [OP_BR]     = &&OPCODE2(OP_BR),
+        [OP_BRF]    = &&OPCODE2(OP_BRF),
+        [OP_NOT]    = &&OPCODE2(OP_NOT),
+        [OP_NEG]    = &&OPCODE2(OP_NEG),
+        [OP_ADD]    = &&OPCODE2(OP_ADD),
+        [OP_SUB]    = &&OPCODE2(OP_SUB),
+        [OP_MUL]    = &&OPCODE2(OP_MUL),
+        [OP_DIV]    = &&OPCODE2(OP_DIV),
+        [OP_REM]    = &&OPCODE2(OP_REM),
+        [OP_BNOT]   = &&OPCODE2(OP_BNOT),
+        [OP_BAND]   = &&OPCODE2(OP_BAND),
+        [OP_BOR]    = &&OPCODE2(OP_BOR),
+        [OP_BXOR]   = &&OPCODE2(OP_BXOR),
+        [OP_SHL]    = &&OPCODE2(OP_SHL),
+        [OP_SHR]    = &&OPCODE2(OP_SHR),
+        [OP_LT]     = &&OPCODE2(OP_LT),
+        [OP_LE]     = &&OPCODE2(OP_LE),
+        [OP_EQ]     = &&OPCODE2(OP_EQ),
+        [OP_NE]     = &&OPCODE2(OP_NE),
+        [OP_GE]     = &&OPCODE2(OP_GE),
+        [OP_GT]     = &&OPCODE2(OP_GT),
+        [OP_LIT]    = &&OPCODE2(OP_LIT),
+        [OP_GADDR]  = &&OPCODE2(OP_GADDR),
+        [OP_SLIT]   = &&OPCODE2(OP_SLIT),
+        [OP_LOAD]   = &&OPCODE2(OP_LOAD),
+        [OP_LOADB]  = &&OPCODE2(OP_LOADB),
+        [OP_STORE]  = &&OPCODE2(OP_STORE),
+        [OP_STOREB] = &&OPCODE2(OP_STOREB),
+        [OP_LADDR]  = &&OPCODE2(OP_LADDR),
+        [OP_INDEX]  = &&OPCODE2(OP_INDEX),
+        [OP_CALL]   = &&OPCODE2(OP_CALL),
+        [OP_RETURN] = &&OPCODE2(OP_RETURN),
+        [OP_DROP]   = &&OPCODE2(OP_DROP),
+        [OP_DUP]    = &&OPCODE2(OP_DUP),
+        [OP_TUCK]   = &&OPCODE2(OP_TUCK),
+        [OP_LLOAD]  = &&OPCODE2(OP_LLOAD),
+        [OP_LSTORE] = &&OPCODE2(OP_LSTORE),
+        [OP_GLOAD]  = &&OPCODE2(OP_GLOAD),
+        [OP_ADDI]   = &&OPCODE2(OP_ADDI),
+        [OP_BRLT]   = &&OPCODE2(OP_BRLT),
+        [OP_BRLE]   = &&OPCODE2(OP_BRLE),
+        [OP_BREQ]   = &&OPCODE2(OP_BREQ),
+        [OP_BRNE]   = &&OPCODE2(OP_BRNE),
+        [OP_BRGE]   = &&OPCODE2(OP_BRGE),
+        [OP_BRGT]   = &&OPCODE2(OP_BRGT),
+        [OP_GSTORE] = &&OPCODE2(OP_GSTORE),
+    };
+#endif
+
+    /* the threaded code translator only needs the handler addresses */
+    if (!i)
+        return dispatch;
+#endif
+
+    RestoreState(i);
+    base = (uint8_t *)i->image;
+    globals = i->globals;
+
+#ifdef USE_COMPUTED_GOTO
+    DISPATCH(i);
+#else
+    for (;;) {
+        TRACE(i);
+        PROFILE();
+        switch (VMCODEBYTE(pc++)) {
+#endif
+        OPCODE(OP_HALT):
+            SaveState(i);
+            i->status = VMSTS_HALT;
+            return NULL;
+        OPCODE(OP_BRT):
+            tmp = tos;
+            tos = Pop();
+            if (tmp)
+                Branch();
+            else
+                SkipBranch();
+            NEXT(i);
+        OPCODE(OP_BRTSC):
+            if (tos)
+                Branch();
+            else {
+                SkipBranch();
+                tos = Pop();
+            }
+            NEXT(i);
+        OPCODE(OP_BRF):
+            tmp = tos;
+            tos = Pop();
+            if (!tmp)
+                Branch();
+            else
+                SkipBranch();
+            NEXT(i);
+        OPCODE(OP_BRFSC):
+            if (!tos)
+                Branch();
+            else {
+                SkipBranch();
+                tos = Pop();
+            }
+            NEXT(i);
+        OPCODE(OP_BR):
+            Branch();
+            NEXT(i);
+        OPCODE(OP_NOT):
+            tos = (tos ? VMFALSE : VMTRUE);
+            NEXT(i);
+        OPCODE(OP_NEG):
+            tos = -tos;
+            NEXT(i);
+        OPCODE(OP_ADD):
+            tmp = Pop();
+            tos = tmp + tos;
+            NEXT(i);
+        OPCODE(OP_SUB):
+            tmp = Pop();
+            tos = tmp - tos;
+            NEXT(i);
+        OPCODE(OP_MUL):
+            tmp = Pop();
+            tos = tmp * tos;
+            NEXT(i);
+        OPCODE(OP_DIV):
+            tmp = Pop();
+            tos = (tos == 0 ? 0 : tmp / tos);
+            NEXT(i);
+        OPCODE(OP_REM):
+            tmp = Pop();
+            tos = (tos == 0 ? 0 : tmp % tos);
+            NEXT(i);
+        OPCODE(OP_BNOT):
+            tos = ~tos;
+            NEXT(i);
+        OPCODE(OP_BAND):
+            tmp = Pop();
+            tos = tmp & tos;
+            NEXT(i);
+        OPCODE(OP_BOR):
+            tmp = Pop();
+            tos = tmp | tos;
+            NEXT(i);
+        OPCODE(OP_BXOR):
+            tmp = Pop();
+            tos = tmp ^ tos;
+            NEXT(i);
+        OPCODE(OP_SHL):
+            tmp = Pop();
+            tos = tmp << tos;
+            NEXT(i);
+        OPCODE(OP_SHR):
+            tmp = Pop();
+            tos = tmp >> tos;
+            NEXT(i);
+        OPCODE(OP_LT):
+            tmp = Pop();
+            tos = (tmp < tos ? VMTRUE : VMFALSE);
+            NEXT(i);
+        OPCODE(OP_LE):
+            tmp = Pop();
+            tos = (tmp <= tos ? VMTRUE : VMFALSE);
+            NEXT(i);
+        OPCODE(OP_EQ):
+            tmp = Pop();
+            tos = (tmp == tos ? VMTRUE : VMFALSE);
+            NEXT(i);
+        OPCODE(OP_NE):
+            tmp = Pop();
+            tos = (tmp != tos ? VMTRUE : VMFALSE);
+            NEXT(i);
+        OPCODE(OP_GE):
+            tmp = Pop();
+            tos = (tmp >= tos ? VMTRUE : VMFALSE);
+            NEXT(i);
+        OPCODE(OP_GT):
+            tmp = Pop();
+            tos = (tmp > tos ? VMTRUE : VMFALSE);
+            NEXT(i);
+        OPCODE(OP_LIT):
+            GetLong(tmp);
+            CachePush(i, tmp);
+            NEXT2(i);
+        OPCODE(OP_SLIT):
+            GetSByte(tmpb);
+            CachePush(i, tmpb);
+            NEXT2(i);
+        OPCODE(OP_GADDR):
+            GetLong(tmp);
+            CachePush(i, VMADDR(base, VMPTR(globals, tmp)));
+            NEXT2(i);
+        OPCODE(OP_LOAD):
+            tos = *(VMVALUE *)VMPTR(base, tos);
+            NEXT(i);
+        OPCODE(OP_LOADB):
+            tos = *(uint8_t *)VMPTR(base, tos);
+            NEXT(i);
+        OPCODE(OP_STORE):
+            tmp = Pop();
+            *(VMVALUE *)VMPTR(base, tmp) = tos;
+            NEXT(i);
+        OPCODE(OP_STOREB):
+            tmp = Pop();
+            *(uint8_t *)VMPTR(base, tmp) = tos;
+            NEXT(i);
+        OPCODE(OP_LADDR):
+            GetSByte(tmpb);
+            CachePush(i, VMADDR(base, &fp[(int)tmpb]));
+            NEXT2(i);
+        OPCODE(OP_INDEX):
+            tmp = Pop();
+            tos = tmp + tos * sizeof (VMVALUE);
+            NEXT(i);
+        OPCODE(OP_CALL):
+            ++pc; // skip over the argument count
+            tmp = tos;
+            tos = VMADDR(base, pc);
+            pc = (VMCODE *)VMPTR(base, tmp);
+            NEXT(i);
+        OPCODE(OP_FRAME):
+#ifdef USE_TIERS
+            /* count the call and run the native code once the function has been promoted */
+            profile = CodeProfile(pc - 1);
+            if (++profile->calls == i->sys->tierThreshold)
+                Promote(i, profile, -1);
+#ifdef USE_JIT
+            if (profile->tier > 0) {
+                pc = (VMCODE *)VMPTR(base, tos);
+                SaveState(i);
+                JitEnter(i, profile->tier);
+                RestoreState(i);
+                NEXT(i);
+            }
+#endif
+#endif
+            GetByte(cnt);
+#ifdef USE_STACK_DEPTH
+            GetByte(tmp);
+            CheckStack(i, cnt + tmp);
+#endif
+            tmp = VMADDR(base, fp);
+            fp = sp;
+            Reserve(i, cnt);
+            fp[-1] = tmp;
+            fp[-2] = tos;
+#ifdef USE_TIERS
+            fp[-3] = VMADDR(base, profile);
+#endif
+            Charge(i);
+            NEXT(i);
+        OPCODE(OP_RETURN):
+            pc = (VMCODE *)VMPTR(base, fp[-2]);
+            sp = fp;
+            Drop(ArgCount(pc));
+            fp = (VMVALUE *)VMPTR(base, fp[-1]);
+            NEXT(i);
+        OPCODE(OP_DROP):
+            tos = Pop();
+            NEXT(i);
+        OPCODE(OP_DUP):
+            CachePush(i, tos);
+            NEXT2(i);
+        OPCODE(OP_TUCK):
+            CPush(i, tos);
+            tmp = sp[0];
+            sp[0] = sp[1];
+            sp[1] = tmp;
+            NEXT(i);
+        OPCODE(OP_NATIVE):
+            GetLong(tmp);
+#ifdef USE_JIT
+            /* run the native translation of this function and return to the caller */
+            pc = (VMCODE *)VMPTR(base, tos);
+            SaveState(i);
+            JitEnter(i, tmp);
+            RestoreState(i);
+#endif
+            NEXT(i);
+        OPCODE(OP_TRAP):
+            GetByte(cnt);
+            SaveState(i);
+            DoTrap(i, cnt);
+            RestoreState(i);
+            NEXT(i);
+        OPCODE(OP_LLOAD):
+            GetSByte(tmpb);
+            CachePush(i, fp[(int)tmpb]);
+            NEXT2(i);
+        OPCODE(OP_LSTORE):
+            GetSByte(tmpb);
+            fp[(int)tmpb] = tos;
+            NEXT(i);
+        OPCODE(OP_GLOAD):
+            GetLong(tmp);
+            CachePush(i, *(VMVALUE *)VMPTR(globals, tmp));
+            NEXT2(i);
+        OPCODE(OP_GSTORE):
+            GetLong(tmp);
+            *(VMVALUE *)VMPTR(globals, tmp) = tos;
+            NEXT(i);
+        OPCODE(OP_ADDI):
+            GetSByte(tmpb);
+            tos += tmpb;
+            NEXT(i);
+        OPCODE(OP_BRLT):
+            CompareBranch(tmp < tos);
+            NEXT(i);
+        OPCODE(OP_BRLE):
+            CompareBranch(tmp <= tos);
+            NEXT(i);
+        OPCODE(OP_BREQ):
+            CompareBranch(tmp == tos);
+            NEXT(i);
+        OPCODE(OP_BRNE):
+            CompareBranch(tmp != tos);
+            NEXT(i);
+        OPCODE(OP_BRGE):
+            CompareBranch(tmp >= tos);
+            NEXT(i);
+        OPCODE(OP_BRGT):
+            CompareBranch(tmp > tos);
+            NEXT(i);
+#ifdef USE_REGISTER_CODE
+        OPCODE(OP_RNOT):
+            RegOp2(Reg(ra) ? VMFALSE : VMTRUE);
+            NEXT(i);
+        OPCODE(OP_RNEG):
+            RegOp2(-Reg(ra));
+            NEXT(i);
+        OPCODE(OP_RADD):
+            RegOp3(Reg(ra) + Reg(rb));
+            NEXT(i);
+        OPCODE(OP_RSUB):
+            RegOp3(Reg(ra) - Reg(rb));
+            NEXT(i);
+        OPCODE(OP_RMUL):
+            RegOp3(Reg(ra) * Reg(rb));
+            NEXT(i);
+        OPCODE(OP_RDIV):
+            RegOp3(Reg(rb) == 0 ? 0 : Reg(ra) / Reg(rb));
+            NEXT(i);
+        OPCODE(OP_RREM):
+            RegOp3(Reg(rb) == 0 ? 0 : Reg(ra) % Reg(rb));
+            NEXT(i);
+        OPCODE(OP_RBNOT):
+            RegOp2(~Reg(ra));
+            NEXT(i);
+        OPCODE(OP_RBAND):
+            RegOp3(Reg(ra) & Reg(rb));
+            NEXT(i);
+        OPCODE(OP_RBOR):
+            RegOp3(Reg(ra) | Reg(rb));
+            NEXT(i);
+        OPCODE(OP_RBXOR):
+            RegOp3(Reg(ra) ^ Reg(rb));
+            NEXT(i);
+        OPCODE(OP_RSHL):
+            RegOp3(Reg(ra) << Reg(rb));
+            NEXT(i);
+        OPCODE(OP_RSHR):
+            RegOp3(Reg(ra) >> Reg(rb));
+            NEXT(i);
+        OPCODE(OP_RLT):
+            RegOp3(Reg(ra) < Reg(rb) ? VMTRUE : VMFALSE);
+            NEXT(i);
+        OPCODE(OP_RLE):
+            RegOp3(Reg(ra) <= Reg(rb) ? VMTRUE : VMFALSE);
+            NEXT(i);
+        OPCODE(OP_REQ):
+            RegOp3(Reg(ra) == Reg(rb) ? VMTRUE : VMFALSE);
+            NEXT(i);
+        OPCODE(OP_RNE):
+            RegOp3(Reg(ra) != Reg(rb) ? VMTRUE : VMFALSE);
+            NEXT(i);
+        OPCODE(OP_RGE):
+            RegOp3(Reg(ra) >= Reg(rb) ? VMTRUE : VMFALSE);
+            NEXT(i);
+        OPCODE(OP_RGT):
+            RegOp3(Reg(ra) > Reg(rb) ? VMTRUE : VMFALSE);
+            NEXT(i);
+        OPCODE(OP_RBRLT):
+            RegBranch2(Reg(ra) < Reg(rb));
+            NEXT(i);
+        OPCODE(OP_RBRLE):
+            RegBranch2(Reg(ra) <= Reg(rb));
+            NEXT(i);
+        OPCODE(OP_RBREQ):
+            RegBranch2(Reg(ra) == Reg(rb));
+            NEXT(i);
+        OPCODE(OP_RBRNE):
+            RegBranch2(Reg(ra) != Reg(rb));
+            NEXT(i);
+        OPCODE(OP_RBRGE):
+            RegBranch2(Reg(ra) >= Reg(rb));
+            NEXT(i);
+        OPCODE(OP_RBRGT):
+            RegBranch2(Reg(ra) > Reg(rb));
+            NEXT(i);
+        OPCODE(OP_RBRT):
+            GetReg(ra);
+            if (Reg(ra))
+                Branch();
+            else
+                SkipBranch();
+            NEXT(i);
+        OPCODE(OP_RBRF):
+            GetReg(ra);
+            if (!Reg(ra))
+                Branch();
+            else
+                SkipBranch();
+            NEXT(i);
+        OPCODE(OP_RMOV):
+            RegOp2(Reg(ra));
+            NEXT(i);
+        OPCODE(OP_RLIT):
+            GetReg(rd);
+            GetLong(tmp);
+            Reg(rd) = tmp;
+            NEXT(i);
+        OPCODE(OP_RGLOAD):
+            GetReg(rd);
+            GetLong(tmp);
+            Reg(rd) = *(VMVALUE *)VMPTR(globals, tmp);
+            NEXT(i);
+        OPCODE(OP_RGSTORE):
+            GetReg(ra);
+            GetLong(tmp);
+            *(VMVALUE *)VMPTR(globals, tmp) = Reg(ra);
+            NEXT(i);
+        OPCODE(OP_RLOAD):
+            RegOp2(*(VMVALUE *)VMPTR(base, Reg(ra)));
+            NEXT(i);
+        OPCODE(OP_RSTORE):
+            GetReg(rd);
+            GetReg(ra);
+            *(VMVALUE *)VMPTR(base, Reg(rd)) = Reg(ra);
+            NEXT(i);
+        OPCODE(OP_RINDEX):
+            RegOp3(Reg(ra) + Reg(rb) * sizeof(VMVALUE));
+            NEXT(i);
+        OPCODE(OP_RADDI):
+            GetReg(rd);
+            GetReg(ra);
+            GetSByte(tmpb);
+            Reg(rd) = Reg(ra) + tmpb;
+            NEXT(i);
+        OPCODE(OP_RPUSH):
+            GetReg(ra);
+            CPush(i, tos);
+            tos = Reg(ra);
+            NEXT(i);
+        OPCODE(OP_RPOP):
+            GetReg(rd);
+            Reg(rd) = tos;
+            tos = Pop();
+            NEXT(i);
+        OPCODE(OP_RSLIT):
+            GetReg(rd);
+            GetSByte(tmpb);
+            Reg(rd) = tmpb;
+            NEXT(i);
+#endif
+#ifdef USE_STACK_CACHE
+        /* the two register state (nos holds the value under tos) */
+        SPILL:
+            CPush(i, nos);
+            goto *dispatch[VMCODEBYTE(pc - 1)];
+        OPCODE2(OP_BRT):
+            tmp = tos;
+            tos = nos;
+            if (tmp)
+                Branch();
+            else
+                SkipBranch();
+            NEXT(i);
+        OPCODE2(OP_BRF):
+            tmp = tos;
+            tos = nos;
+            if (!tmp)
+                Branch();
+            else
+                SkipBranch();
+            NEXT(i);
+        OPCODE2(OP_BR):
+            CPush(i, nos);
+            Branch();
+            NEXT(i);
+        OPCODE2(OP_NOT):
+            tos = (tos ? VMFALSE : VMTRUE);
+            NEXT2(i);
+        OPCODE2(OP_NEG):
+            tos = -tos;
+            NEXT2(i);
+        OPCODE2(OP_ADD):
+            tos = nos + tos;
+            NEXT(i);
+        OPCODE2(OP_SUB):
+            tos = nos - tos;
+            NEXT(i);
+        OPCODE2(OP_MUL):
+            tos = nos * tos;
+            NEXT(i);
+        OPCODE2(OP_DIV):
+            tos = (tos == 0 ? 0 : nos / tos);
+            NEXT(i);
+        OPCODE2(OP_REM):
+            tos = (tos == 0 ? 0 : nos % tos);
+            NEXT(i);
+        OPCODE2(OP_BNOT):
+            tos = ~tos;
+            NEXT2(i);
+        OPCODE2(OP_BAND):
+            tos = nos & tos;
+            NEXT(i);
+        OPCODE2(OP_BOR):
+            tos = nos | tos;
+            NEXT(i);
+        OPCODE2(OP_BXOR):
+            tos = nos ^ tos;
+            NEXT(i);
+        OPCODE2(OP_SHL):
+            tos = nos << tos;
+            NEXT(i);
+        OPCODE2(OP_SHR):
+            tos = nos >> tos;
+            NEXT(i);
+        OPCODE2(OP_LT):
+            tos = (nos < tos ? VMTRUE : VMFALSE);
+            NEXT(i);
+        OPCODE2(OP_LE):
+            tos = (nos <= tos ? VMTRUE : VMFALSE);
+            NEXT(i);
+        OPCODE2(OP_EQ):
+            tos = (nos == tos ? VMTRUE : VMFALSE);
+            NEXT(i);
+        OPCODE2(OP_NE):
+            tos = (nos != tos ? VMTRUE : VMFALSE);
+            NEXT(i);
+        OPCODE2(OP_GE):
+            tos = (nos >= tos ? VMTRUE : VMFALSE);
+            NEXT(i);
+        OPCODE2(OP_GT):
+            tos = (nos > tos ? VMTRUE : VMFALSE);
+            NEXT(i);
+        OPCODE2(OP_LIT):
+            GetLong(tmp);
+            CPush(i, nos);
+            CachePush(i, tmp);
+            NEXT2(i);
+        OPCODE2(OP_SLIT):
+            GetSByte(tmpb);
+            CPush(i, nos);
+            CachePush(i, tmpb);
+            NEXT2(i);
+        OPCODE2(OP_GADDR):
+            GetLong(tmp);
+            CPush(i, nos);
+            CachePush(i, VMADDR(base, VMPTR(globals, tmp)));
+            NEXT2(i);
+        OPCODE2(OP_LOAD):
+            tos = *(VMVALUE *)VMPTR(base, tos);
+            NEXT2(i);
+        OPCODE2(OP_LOADB):
+            tos = *(uint8_t *)VMPTR(base, tos);
+            NEXT2(i);
+        OPCODE2(OP_STORE):
+            *(VMVALUE *)VMPTR(base, nos) = tos;
+            NEXT(i);
+        OPCODE2(OP_STOREB):
+            *(uint8_t *)VMPTR(base, nos) = tos;
+            NEXT(i);
+        OPCODE2(OP_LADDR):
+            GetSByte(tmpb);
+            CPush(i, nos);
+            CachePush(i, VMADDR(base, &fp[(int)tmpb]));
+            NEXT2(i);
+        OPCODE2(OP_INDEX):
+            tos = nos + tos * sizeof (VMVALUE);
+            NEXT(i);
+        OPCODE2(OP_CALL):
+            CPush(i, nos);
+            ++pc; // skip over the argument count
+            tmp = tos;
+            tos = VMADDR(base, pc);
+            pc = (VMCODE *)VMPTR(base, tmp);
+            NEXT(i);
+        OPCODE2(OP_RETURN):
+            /* nos is part of the frame being dropped */
+            pc = (VMCODE *)VMPTR(base, fp[-2]);
+            sp = fp;
+            Drop(ArgCount(pc));
+            fp = (VMVALUE *)VMPTR(base, fp[-1]);
+            NEXT(i);
+        OPCODE2(OP_DROP):
+            tos = nos;
+            NEXT(i);
+        OPCODE2(OP_DUP):
+            CPush(i, nos);
+            CachePush(i, tos);
+            NEXT2(i);
+        OPCODE2(OP_TUCK):
+            CPush(i, tos);
+            NEXT2(i);
+        OPCODE2(OP_LLOAD):
+            GetSByte(tmpb);
+            CPush(i, nos);
+            CachePush(i, fp[(int)tmpb]);
+            NEXT2(i);
+        OPCODE2(OP_LSTORE):
+            GetSByte(tmpb);
+            fp[(int)tmpb] = tos;
+            NEXT2(i);
+        OPCODE2(OP_GLOAD):
+            GetLong(tmp);
+            CPush(i, nos);
+            CachePush(i, *(VMVALUE *)VMPTR(globals, tmp));
+            NEXT2(i);
+        OPCODE2(OP_GSTORE):
+            GetLong(tmp);
+            *(VMVALUE *)VMPTR(globals, tmp) = tos;
+            NEXT2(i);
+        OPCODE2(OP_ADDI):
+            GetSByte(tmpb);
+            tos += tmpb;
+            NEXT2(i);
+        OPCODE2(OP_BRLT):
+            CompareBranch2(nos < tos);
+            NEXT(i);
+        OPCODE2(OP_BRLE):
+            CompareBranch2(nos <= tos);
+            NEXT(i);
+        OPCODE2(OP_BREQ):
+            CompareBranch2(nos == tos);
+            NEXT(i);
+        OPCODE2(OP_BRNE):
+            CompareBranch2(nos != tos);
+            NEXT(i);
+        OPCODE2(OP_BRGE):
+            CompareBranch2(nos >= tos);
+            NEXT(i);
+        OPCODE2(OP_BRGT):
+            CompareBranch2(nos > tos);
+            NEXT(i);
+#endif
+        UNDEFINED:
+#ifdef USE_THREADED_CODE
+            Abort(i->sys, "undefined opcode");
+#else
+            Abort(i->sys, "undefined opcode 0x%02x", VMCODEBYTE(pc - 1));
+#endif
+            NEXT(i);
+#ifndef USE_COMPUTED_GOTO
+        }
+    }
+#endif
+}
+
+#ifdef USE_THREADED_CODE
+
+/* ThreadCode - translate a bytecode function to threaded code
+
+   The map must have room for size + 1 entries and is used to hold the cell
+   index corresponding to each bytecode offset while branches are resolved.
+   The number of cells is stored in the cell in front of the code so that
+   FindCodePointers can find its way through it. */
+VMVALUE ThreadCode(ImageHdr *image, const uint8_t *code, size_t size, int *map)
+{
+    void **dispatch = Interpret(NULL);
+    const uint8_t *lc, *target, *end = code + size;
+    VMCELL *cells, *cell;
+    const OTDEF *op;
+    int ncells;
+
+    /* find the cell index of each instruction */
+    memset(map, -1, (size + 1) * sizeof(int));
+    for (lc = code, ncells = 0; lc < end; ) {
+        map[lc - code] = ncells;
+        if (!(op = FindOpcode(*lc)))
+            return 0;
+        switch (op->fmt) {
+        case FMT_BYTE:
+        case FMT_SBYTE:
+            lc += 1 + 1;
+            ncells += 2;
+            break;
+        case FMT_FRAME:
+            lc += 1 + 2;
+            ncells += 3;
+            break;
+        case FMT_LONG:
+            lc = VMOPERAND(lc + 1, sizeof(VMVALUE)) + sizeof(VMVALUE);
+            ncells += 2;
+            break;
+        case FMT_BR:
+            lc = VMOPERAND(lc + 1, sizeof(VMWORD)) + sizeof(VMWORD);
+            ncells += 2;
+            break;
+        case FMT_REG2:
+            lc += 1 + 2;
+            ncells += 3;
+            break;
+        case FMT_REG3:
+            lc += 1 + 3;
+            ncells += 4;
+            break;
+        case FMT_REGLONG:
+            lc = VMOPERAND(lc + 2, sizeof(VMVALUE)) + sizeof(VMVALUE);
+            ncells += 3;
+            break;
+        case FMT_REGBR:
+            lc = VMOPERAND(lc + 2, sizeof(VMWORD)) + sizeof(VMWORD);
+            ncells += 3;
+            break;
+        case FMT_REG2BR:
+            lc = VMOPERAND(lc + 3, sizeof(VMWORD)) + sizeof(VMWORD);
+            ncells += 4;
+            break;
+        default:
+            lc += 1;
+            ncells += 1;
+            break;
+        }
+    }
+    map[size] = ncells;
+
+    /* allocate space for the threaded code and its size */
+    if (!(cells = (VMCELL *)AllocateImageSpace(image, (1 + ncells) * sizeof(VMCELL))))
+        return 0;
+    (cells++)->value = ncells;
+
+    /* translate each instruction and decode its operand (branches must land on an instruction) */
+    for (lc = code, cell = cells; lc < end; ) {
+        op = FindOpcode(*lc);
+        (cell++)->handler = dispatch[*lc++];
+        switch (op->fmt) {
+        case FMT_BYTE:
+            (cell++)->value = *lc++;
+            break;
+        case FMT_FRAME:
+            (cell++)->value = *lc++;
+            (cell++)->value = *lc++;
+            break;
+        case FMT_SBYTE:
+            (cell++)->value = (int8_t)*lc++;
+            break;
+        case FMT_LONG:
+            lc = VMOPERAND(lc, sizeof(VMVALUE));
+            (cell++)->value = VMCODELONG(lc);
+            lc += sizeof(VMVALUE);
+            break;
+        case FMT_REG3:
+            (cell++)->value = (int8_t)*lc++;
+            /* fall through */
+        case FMT_REG2:
+            (cell++)->value = (int8_t)*lc++;
+            (cell++)->value = (int8_t)*lc++;
+            break;
+        case FMT_REGLONG:
+            (cell++)->value = (int8_t)*lc++;
+            lc = VMOPERAND(lc, sizeof(VMVALUE));
+            (cell++)->value = VMCODELONG(lc);
+            lc += sizeof(VMVALUE);
+            break;
+        case FMT_REG2BR:
+            (cell++)->value = (int8_t)*lc++;
+            /* fall through */
+        case FMT_REGBR:
+            (cell++)->value = (int8_t)*lc++;
+            /* fall through */
+        case FMT_BR:
+            lc = VMOPERAND(lc, sizeof(VMWORD)) + sizeof(VMWORD);
+            target = lc + VMCODEWORD(lc - sizeof(VMWORD));
+            if (target < code || target > end || map[target - code] < 0)
+                return 0;
+            (cell++)->target = &cells[map[target - code]];
+            break;
+        }
+    }
+
+    /* return the threaded code address */
+    return VMADDR(image, cells);
+}
+
+#ifdef USE_IMAGE_FILES
+
+/* ThreadedHandlers - get the table of threaded code handlers indexed by opcode */
+void **ThreadedHandlers(void)
+{
+    return Interpret(NULL);
+}
+
+/* FindCodePointers - find the host pointers in threaded code
+
+   The handler is called for each cell holding an opcode handler with a type
+   of RELOC_HANDLER and for each cell holding a branch target with a type of
+   RELOC_POINTER.  Returns VMFALSE if the code contains an unknown handler. */
+int FindCodePointers(VMCELL *cells, CodePointerHandler *handler, void *cookie)
+{
+    void **dispatch = Interpret(NULL);
+    VMCELL *cell, *end = cells + cells[-1].value;
+    const OTDEF *op;
+
+    for (cell = cells; cell < end; ) {
+
+        /* find the opcode of the handler */
+        for (op = OpcodeTable; op->name; ++op)
+            if (dispatch[op->code] == cell->handler)
+                break;
+        if (!op->name)
+            return VMFALSE;
+        (*handler)(cookie, cell++, RELOC_HANDLER);
+
+        /* skip over the operands */
+        switch (op->fmt) {
+        case FMT_BYTE:
+        case FMT_SBYTE:
+        case FMT_LONG:
+            cell += 1;
+            break;
+        case FMT_FRAME:
+        case FMT_REG2:
+        case FMT_REGLONG:
+            cell += 2;
+            break;
+        case FMT_REG3:
+            cell += 3;
+            break;
+        case FMT_REG2BR:
+            ++cell;
+            /* fall through */
+        case FMT_REGBR:
+            ++cell;
+            /* fall through */
+        case FMT_BR:
+            (*handler)(cookie, cell++, RELOC_POINTER);
+            break;
+        }
+    }
+
+    return VMTRUE;
+}
+
+#endif
+
+/* FindOpcode - find the opcode table entry for an opcode */
+static const OTDEF *FindOpcode(int code)
+{
+    const OTDEF *op;
+    for (op = OpcodeTable; op->name; ++op)
+        if (op->code == code)
+            return op;
+    return NULL;
+}
+
+#endif
+
+#ifdef USE_JIT
+
+/* CallBytecode - call the bytecode function in tos from native code
+
+   The function returns to a HALT instruction preceded by the argument count
+   so the nested interpreter loop ends when the function returns.  The pc of
+   the interpreter that entered the native code is left as it was. */
+void CallBytecode(Interpreter *i, int argc)
+{
+    uint8_t savedArgc = i->callReturn[0];
+    VMCODE *savedPc = i->pc;
+    i->pc = (VMCODE *)VMPTR(i->image, i->tos);
+    i->tos = VMADDR(i->image, &i->callReturn[1]);
+    i->callReturn[0] = argc;
+    /* the function can't yield back to native code so resume it right away */
+    do {
+        Interpret(i);
+    } while (i->status == VMSTS_YIELD);
+    i->callReturn[0] = savedArgc;
+    i->pc = savedPc;
+}
+
+/* CallTrap - execute a trap from native code */
+void CallTrap(Interpreter *i, int op)
+{
+    DoTrap(i, op);
+}
+
+/* CallStackOverflow - report a stack overflow from native code */
+void CallStackOverflow(Interpreter *i)
+{
+    StackOverflow(i);
+}
+
+#endif
+
+#ifdef USE_TIERS
+
+/* Promote - move hot code up to native code when it can be translated
+
+   When loop isn't negative the native code offset for the bytecode at that
+   offset is returned so that a running loop can continue in native code. */
+static VMVALUE Promote(Interpreter *i, Profile *profile, int loop)
+{
+    VMVALUE entry = 0;
+    if (profile->tier == 0) {
+#ifdef USE_JIT
+        profile->tier = JitTranslate(i->sys, i->image, (uint8_t *)(profile + 1), profile->size, loop, &entry);
+        if (!profile->tier)
+            profile->tier = TIER_NONE;
+#else
+        /* the interpreter is the only tier without the JIT */
+        profile->tier = TIER_NONE;
+#endif
+    }
+    return entry;
+}
+
+/* PromoteLoop - promote the function running a hot loop and finish the call in native code */
+static void PromoteLoop(Interpreter *i, Profile *profile)
+{
+    VMVALUE entry;
+    if ((entry = Promote(i, profile, (int)((uint8_t *)i->pc - (uint8_t *)(profile + 1)))) != 0) {
+#ifdef USE_JIT
+        i->pc = (VMCODE *)VMPTR(i->image, i->fp[-2]);
+        JitResume(i, entry);
+#endif
+    }
+}
+
+/* DumpProfile - show the execution profile of each function */
+void DumpProfile(ImageHdr *image)
+{
+    Symbol *symbol;
+    fprintf(stderr, "function              calls      loops  tier\n");
+    for (symbol = image->globals.head; symbol != NULL; symbol = symbol->next) {
+        uint8_t *code;
+        if (symbol->storageClass != SC_FUNCTION)
+            continue;
+        code = (uint8_t *)VMPTR(image, *GlobalCell(image->data, symbol));
+        if (code >= image->heapFree && code < image->heapTop && *code == OP_FRAME) {
+            Profile *profile = CodeProfile(code);
+            fprintf(stderr, "%-16s %10d %10d  %s\n",
+                    symbol->name,
+                    profile->calls,
+                    profile->loops,
+                    profile->tier > 0 ? "native" : "bytecode");
+        }
+    }
+}
+
+#endif
+
+static void DoTrap(Interpreter *i, int op)
+{
+    switch (op) {
+    case TRAP_GetChar:
+        *--i->sp = i->tos;
+        i->tos = VM_getchar();
+        break;
+    case TRAP_PutChar:
+        PutChar(i->sys, i->tos);
+        i->tos = *i->sp++;
+        break;
+    case TRAP_PrintStr:
+        PutString(i->sys, (char *)VMPTR(i->image, i->tos), StringLength(VMPTR(i->image, i->tos)));
+        i->tos = *i->sp++;
+        break;
+    case TRAP_PrintInt:
+        Printf(i->sys, "%d", i->tos);
+        i->tos = *i->sp++;
+        break;
+    case TRAP_PrintTab:
+        PutChar(i->sys, '\t');
+        break;
+    case TRAP_PrintNL:
+        PutChar(i->sys, '\n');
+        break;
+    case TRAP_PrintFlush:
+        VM_flush();
+        break;
+    default:
+        Abort(i->sys, "undefined trap %d", op);
+        break;
+    }
+}
+
+static void StackOverflow(Interpreter *i)
+{
+    Abort(i->sys, "stack overflow");
+}
+
+#ifdef PAIR_STATS
+/* ShowPairStats - show the most frequently executed opcode pairs */
+static void ShowPairStats(void)
+{
+    const OTDEF *op1, *op2;
+    int first, second, n;
+    uint32_t total = 0;
+
+    for (first = 0; first < 256; ++first)
+        for (second = 0; second < 256; ++second)
+            total += pairCounts[first][second];
+    if (total == 0)
+        return;
+
+    fprintf(stderr, "opcode pairs (%u executed):\n", total);
+    for (n = 0; n < 30; ++n) {
+        int best1 = 0, best2 = 0;
+        for (first = 0; first < 256; ++first)
+            for (second = 0; second < 256; ++second)
+                if (pairCounts[first][second] > pairCounts[best1][best2]) {
+                    best1 = first;
+                    best2 = second;
+                }
+        if (pairCounts[best1][best2] == 0)
+            break;
+        for (op1 = OpcodeTable; op1->name && op1->code != best1; ++op1)
+            ;
+        for (op2 = OpcodeTable; op2->name && op2->code != best2; ++op2)
+            ;
+        fprintf(stderr, "%12u %5.1f%%  %s %s\n",
+                pairCounts[best1][best2],
+                pairCounts[best1][best2] * 100.0 / total,
+                op1->name ? op1->name : "?",
+                op2->name ? op2->name : "?");
+        pairCounts[best1][best2] = 0;
+    }
+}
+#endif
+
+#ifdef DEBUG
+static void ShowStack(Interpreter *i)
+{
+    VMVALUE *p;
+    if (i->sp < i->stackTop) {
+        VM_printf(" %d", i->tos);
+        for (p = i->sp; p < i->stackTop - 1; ++p) {
+            if (p == i->fp)
+                VM_printf(" <fp>");
+            VM_printf(" %d", *p);
+        }
+        VM_printf("\n");
+    }
+}
+#endif
+
+#if defined(DEBUG) && defined(USE_THREADED_CODE)
+static void ShowCell(void **dispatch, VMCELL *pc)
+{
+    const OTDEF *op;
+    for (op = OpcodeTable; op->name; ++op)
+        if (dispatch[op->code] == pc->handler)
+            break;
+    VM_printf("%p %s\n", (void *)pc, op->name ? op->name : "<unknown>");
+}
+#endif
@@ -0,0 +1,289 @@
+/* libnotc.c - interface for embedding notc in another program
+ *
+ * Copyright (c) 2014 by David Michael Betz.  All rights reserved.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "db_compiler.h"
+#include "db_image.h"
+#include "db_vm.h"
+#include "libnotc.h"
+
+/* context structure */
+struct NotcContext {
+    System *sys;                /* system in the arena */
+    ImageHdr *image;            /* image holding the compiled code */
+    uint8_t *globals;           /* global variables */
+    NotcContext *source;        /* context whose image is shared or NULL */
+    const char *next;           /* next character of the source being compiled */
+    const char *end;            /* end of the source being compiled */
+    VMVALUE lineNumber;         /* number of the last line read */
+    int eof;                    /* end of the source reached */
+};
+
+static int SourceGetLine(void *cookie, char *buf, int len, VMVALUE *pLineNumber);
+
+/* NotcCreate - create a context in an arena
+
+   The image gets the same share of the arena as it does of the heap of the
+   notc program and the rest is used by the compiler and the stack. */
+NotcContext *NotcCreate(void *arena, size_t size)
+{
+    NotcContext *ctx;
+    System *sys;
+
+    /* create the system and the context */
+    if (!(sys = InitSystem((uint8_t *)arena, size)))
+        return NULL;
+    if (!(ctx = (NotcContext *)AllocateFreeSpace(sys, sizeof(NotcContext))))
+        return NULL;
+    ctx->sys = sys;
+    ctx->source = NULL;
+    sys->getLine = SourceGetLine;
+    sys->getLineCookie = ctx;
+
+    /* allocate the image */
+    if (!(ctx->image = AllocateImage(sys, size * IMAGESIZE / HEAPSIZE)))
+        return NULL;
+    ctx->globals = ctx->image->data;
+
+    /* everything above this is reused for each compile and call */
+    sys->freeMark = sys->freeNext;
+
+    return ctx;
+}
+
+/* NotcShare - create a context that runs the code compiled in another context
+
+   The compiled code is used in place and only the global segment is copied
+   into the new arena.  VM addresses are offsets from the image so the arena
+   must lie above the arena of the source context and close enough for the
+   offsets to fit in a VMVALUE.  Profiles are updated as code runs under
+   tiered execution so an image can't be shared then. */
+NotcContext *NotcShare(NotcContext *source, void *arena, size_t size)
+{
+#ifdef USE_TIERS
+    return NULL;
+#else
+    uint8_t *image = (uint8_t *)source->image;
+    NotcContext *ctx;
+    System *sys;
+
+    /* make sure the arena can be addressed from the image */
+    if ((uint8_t *)arena < image || (uint8_t *)arena + size - image > INT32_MAX)
+        return NULL;
+
+    /* create the system and the context */
+    if (!(sys = InitSystem((uint8_t *)arena, size)))
+        return NULL;
+    if (!(ctx = (NotcContext *)AllocateFreeSpace(sys, sizeof(NotcContext))))
+        return NULL;
+    ctx->sys = sys;
+    ctx->image = source->image;
+    ctx->source = source;
+
+    /* borrow the native code of the source context */
+#ifdef USE_JIT
+    sys->jitBase = source->sys->jitBase;
+#endif
+
+    /* copy the global variables */
+    if (!(ctx->globals = CopyGlobals(sys, ctx->image)))
+        return NULL;
+
+    /* everything above this is reused for each call */
+    sys->freeMark = sys->freeNext;
+
+    return ctx;
+#endif
+}
+
+/* NotcDestroy - release the resources a context holds outside of its arena */
+void NotcDestroy(NotcContext *ctx)
+{
+#ifdef USE_JIT
+    if (!ctx->source)
+        FreeJit(ctx->sys);
+#endif
+}
+
+/* NotcSetOutput - send program output and error messages to a handler */
+void NotcSetOutput(NotcContext *ctx, NotcOutputHandler *handler, void *cookie)
+{
+    ctx->sys->putChar = handler;
+    ctx->sys->putCharCookie = cookie;
+}
+
+/* NotcCompile - compile source text into the context */
+int NotcCompile(NotcContext *ctx, const char *source, size_t size)
+{
+    System *sys = ctx->sys;
+    int ok = VMTRUE;
+    VMVALUE code;
+
+    /* the code of a shared image can't change while it is in use */
+    if (ctx->source)
+        return VMFALSE;
+
+    /* setup the source */
+    ctx->next = source;
+    ctx->end = source + size;
+    ctx->lineNumber = 0;
+    ctx->eof = VMFALSE;
+
+    /* compile and run each statement like the notc program does */
+    while (!ctx->eof) {
+        sys->freeNext = sys->freeMark;
+        if ((code = Compile(sys, ctx->image)) == 0)
+            ok = VMFALSE;
+        else {
+            sys->freeNext = sys->freeMark;
+            if (!Execute(sys, ctx->image, code))
+                ok = VMFALSE;
+        }
+    }
+
+    return ok;
+}
+
+/* NotcLookup - find a global function */
+NotcFunction *NotcLookup(NotcContext *ctx, const char *name)
+{
+    Symbol *symbol;
+    if (!(symbol = FindGlobal(ctx->image, name)) || symbol->storageClass != SC_FUNCTION)
+        return NULL;
+    return (NotcFunction *)symbol;
+}
+
+/* NotcCall - call a function with arguments and get its return value */
+int NotcCall(NotcContext *ctx, NotcFunction *function, int argc, const int32_t *argv, int32_t *pResult)
+{
+    System *sys = ctx->sys;
+    VMVALUE value;
+    sys->freeNext = sys->freeMark;
+    if (!Call(sys, ctx->image, ctx->globals, (Symbol *)function, argc, (const VMVALUE *)argv, &value))
+        return VMFALSE;
+    *pResult = value;
+    return VMTRUE;
+}
+
+/* NotcCreateScheduler - create a scheduler to run calls a slice at a time */
+NotcScheduler *NotcCreateScheduler(int32_t quantum)
+{
+    Scheduler *s;
+    if (quantum <= 0 || !(s = (Scheduler *)malloc(sizeof(Scheduler))))
+        return NULL;
+    InitScheduler(s, quantum);
+    return (NotcScheduler *)s;
+}
+
+/* NotcDestroyScheduler - destroy a scheduler and drop the calls left in it */
+void NotcDestroyScheduler(NotcScheduler *sched)
+{
+    free(sched);
+}
+
+/* NotcStart - start a call to be run by a scheduler */
+int NotcStart(NotcScheduler *sched, NotcContext *ctx, NotcFunction *function, int argc, const int32_t *argv)
+{
+    System *sys = ctx->sys;
+    Interpreter *i;
+    sys->freeNext = sys->freeMark;
+    if (!(i = NewCall(sys, ctx->image, ctx->globals, (Symbol *)function, argc, (const VMVALUE *)argv)))
+        return VMFALSE;
+    AddInterpreter((Scheduler *)sched, i);
+    return VMTRUE;
+}
+
+/* NotcSchedule - run the next call for one slice */
+int NotcSchedule(NotcScheduler *sched)
+{
+    return Schedule((Scheduler *)sched);
+}
+
+/* NotcCheckpoint - save a checkpoint of a context in a file */
+int NotcCheckpoint(NotcContext *ctx, const char *path)
+{
+    FILE *fp;
+    int ok;
+
+    /* the global variables of a shared context aren't in its image */
+    if (ctx->source)
+        return VMFALSE;
+
+    if (!(fp = fopen(path, "wb")))
+        return VMFALSE;
+    ok = SaveImage(ctx->image, NULL, 0, fp);
+    if (fclose(fp) != 0 || !ok) {
+        remove(path);
+        return VMFALSE;
+    }
+
+    return VMTRUE;
+}
+
+/* NotcRestore - restore a checkpoint or load an image into a new context */
+int NotcRestore(NotcContext *ctx, const char *path)
+{
+    System *sys = ctx->sys;
+    ImageHdr *image = ctx->image;
+    uint8_t *heapTop = image->heapTop;
+    int ok = VMTRUE, count, i;
+    VMVALUE *mains;
+    FILE *fp;
+
+    /* the image is replaced so it must not have anything in it yet */
+    if (ctx->source || image->globals.head || image->heapFree != image->heapTop)
+        return VMFALSE;
+
+    if (!(fp = fopen(path, "rb")))
+        return VMFALSE;
+    mains = LoadImage(sys, image, fp, &count);
+    fclose(fp);
+    if (!mains) {
+        image->heapTop = heapTop;
+        InitImage(image);
+        return VMFALSE;
+    }
+
+    /* run the top level statements of an image */
+    for (i = 0; i < count; ++i) {
+        sys->freeNext = sys->freeMark;
+        if (!Execute(sys, image, mains[i]))
+            ok = VMFALSE;
+    }
+    free(mains);
+
+    return ok;
+}
+
+/* NotcParseSize - parse an arena size with an optional k or m suffix */
+int NotcParseSize(const char *str, size_t *pSize)
+{
+    return VM_parsesize(str, pSize);
+}
+
+/* SourceGetLine - get the next line of the source being compiled */
+static int SourceGetLine(void *cookie, char *buf, int len, VMVALUE *pLineNumber)
+{
+    NotcContext *ctx = (NotcContext *)cookie;
+    int i = 0;
+
+    if (ctx->next >= ctx->end) {
+        ctx->eof = VMTRUE;
+        return VMFALSE;
+    }
+
+    /* copy the line including the newline like fgets does */
+    while (i < len - 1 && ctx->next < ctx->end) {
+        if ((buf[i++] = *ctx->next++) == '\n')
+            break;
+    }
+    buf[i] = '\0';
+
+    *pLineNumber = ++ctx->lineNumber;
+    return VMTRUE;
+}
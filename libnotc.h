@@ -0,0 +1,132 @@
+/* libnotc.h - interface for embedding notc in another program
+ *
+ * Copyright (c) 2014 by David Michael Betz.  All rights reserved.
+ *
+ */
+
+#ifndef __LIBNOTC_H__
+#define __LIBNOTC_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* A context holds everything needed to compile and run programs.  It lives
+   entirely in the arena supplied by the caller so the caller decides where
+   the memory comes from and any number of contexts can exist at once.  A
+   context must only be used by one thread at a time. */
+typedef struct NotcContext NotcContext;
+
+/* handle for a global function */
+typedef struct NotcFunction NotcFunction;
+
+/* A scheduler runs calls in any number of contexts on the thread that
+   drives it, giving each a slice of a number of backward branches and calls
+   in turn, so a call that loops forever can't keep the others from
+   running. */
+typedef struct NotcScheduler NotcScheduler;
+
+/* character output handler */
+typedef void NotcOutputHandler(void *cookie, int ch);
+
+/* NotcCreate - create a context in an arena (which must be suitably aligned)
+
+   Returns NULL if the arena is too small. */
+NotcContext *NotcCreate(void *arena, size_t size);
+
+/* NotcShare - create a context that shares the compiled code of another
+
+   The new context gets its own copy of the global variables of the source
+   context as they are now and shares everything else, so any number of
+   threads can call the same functions at once, each in its own shared
+   context.  Nothing can be compiled into a shared context and the source
+   context must not compile anything more or be destroyed while it has
+   shared contexts.  The arena must lie above the arena of the source
+   context and within 2GB of it.  Returns NULL if the arena is too small or
+   out of reach or if the code can't be shared in this build. */
+NotcContext *NotcShare(NotcContext *source, void *arena, size_t size);
+
+/* NotcDestroy - release the resources a context holds outside of its arena */
+void NotcDestroy(NotcContext *ctx);
+
+/* NotcSetOutput - send program output and error messages to a handler */
+void NotcSetOutput(NotcContext *ctx, NotcOutputHandler *handler, void *cookie);
+
+/* NotcCompile - compile source text into the context
+
+   Definitions are added to those already in the context and top level
+   statements are run as they are compiled just as they are by the notc
+   program.  Returns zero if there were any errors or the context is a
+   shared context. */
+int NotcCompile(NotcContext *ctx, const char *source, size_t size);
+
+/* NotcLookup - find a global function
+
+   Returns NULL if there is no function with that name.  The handle stays
+   valid for the life of the context and calls through it use the latest
+   definition of the function. */
+NotcFunction *NotcLookup(NotcContext *ctx, const char *name);
+
+/* NotcCall - call a function with arguments and get its return value
+
+   Returns zero if the function doesn't take argc arguments or aborted with
+   an error. */
+int NotcCall(NotcContext *ctx, NotcFunction *function, int argc, const int32_t *argv, int32_t *pResult);
+
+/* NotcCreateScheduler - create a scheduler to run calls a slice at a time
+
+   Each call runs until it has made quantum backward branches and calls and
+   then goes to the back of the line.  Native code isn't metered in builds
+   that translate functions to native code so a call only gives up its turn
+   while it is running bytecode.  Returns NULL if the quantum isn't positive
+   or there is no memory for the scheduler. */
+NotcScheduler *NotcCreateScheduler(int32_t quantum);
+
+/* NotcDestroyScheduler - destroy a scheduler and drop the calls left in it */
+void NotcDestroyScheduler(NotcScheduler *sched);
+
+/* NotcStart - start a call to be run by a scheduler
+
+   The value the function returns is dropped.  A context can have only one
+   call in a scheduler at a time and must not be used for anything else
+   until it finishes or the scheduler is destroyed.  Returns zero if the
+   function doesn't take argc arguments or the arena is too small. */
+int NotcStart(NotcScheduler *sched, NotcContext *ctx, NotcFunction *function, int argc, const int32_t *argv);
+
+/* NotcSchedule - run the next call for one slice
+
+   A call that returns or aborts with an error is removed from the
+   scheduler.  Returns zero once there are no calls left to run. */
+int NotcSchedule(NotcScheduler *sched);
+
+/* NotcCheckpoint - save a checkpoint of a context in a file
+
+   The checkpoint holds everything compiled into the context and the current
+   values of its global variables so that a context restored from it carries
+   on from this point without compiling and running the program again.
+   Returns zero if the file can't be written or the context is a shared
+   context. */
+int NotcCheckpoint(NotcContext *ctx, const char *path);
+
+/* NotcRestore - restore a checkpoint or load an image into a new context
+
+   The context must not have had anything compiled into it and its arena
+   must be at least as large as that of the context the checkpoint was made
+   from.  The top level statements of an image compiled by notc -c are run
+   after it is loaded.  Returns zero if the file isn't a checkpoint or image
+   made by a build with the same options. */
+int NotcRestore(NotcContext *ctx, const char *path);
+
+/* NotcParseSize - parse an arena size with an optional k or m suffix
+
+   Returns zero if the string isn't a number with an optional suffix. */
+int NotcParseSize(const char *str, size_t *pSize);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -1,51 +1,707 @@
-/* notc.c - a simple interpreter for a c-like language
- *
- * Copyright (c) 2014 by David Michael Betz.  All rights reserved.
- *
- */
-
-#include <stdio.h>
-#include "db_compiler.h"
-#include "db_image.h"
-#include "db_vm.h"
-
-static uint8_t space[HEAPSIZE];
-
-static int TermGetLine(void *cookie, char *buf, int len, VMVALUE *pLineNumber);
-
-int main(int argc, char *argv[])
-{
-    VMVALUE lineNumber = 0;
-    ImageHdr *image;
-    VMVALUE code;
-    System *sys;
-
-    VM_sysinit(argc, argv);
-
-    VM_printf("notc 0.001\n");
-
-    sys = InitSystem(space, sizeof(space));
-    sys->getLine = TermGetLine;
-    sys->getLineCookie = &lineNumber;
-
-    if (!(image = AllocateImage(sys, IMAGESIZE)))
-        return 1;
-        
-    sys->freeMark = sys->freeNext;
-    
-    for (;;) {
-        if ((code = Compile(sys, image)) != 0) {
-            sys->freeNext = sys->freeMark;
-            Execute(sys, image, code);
-        }
-    }
-
-    return 0;
-}
-
-static int TermGetLine(void *cookie, char *buf, int len, VMVALUE *pLineNumber)
-{
-    VMVALUE *pLine = (VMVALUE *)cookie;
-    *pLineNumber = ++(*pLine);
-    return VM_getline(buf, len) != NULL;
-}
+/* notc.c - a simple interpreter for a c-like language
+ *
+ * Copyright (c) 2014 by David Michael Betz.  All rights reserved.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "db_compiler.h"
+#include "db_image.h"
+#include "db_vm.h"
+
+#ifdef RESERVED_HEAPSIZE
+#include <sys/mman.h>
+static uint8_t *ReserveHeap(size_t size);
+#else
+static uint8_t space[HEAPSIZE];
+#endif
+
+static int TermGetLine(void *cookie, char *buf, int len, VMVALUE *pLineNumber);
+static int EndOfInput(void);
+#ifdef USE_SOURCE_FILES
+#include <sys/mman.h>
+static int wholeProgram = VMFALSE;
+static char *MapSource(char *name);
+static int SourceGetLine(void *cookie, char *buf, int len, VMVALUE *pLineNumber);
+#endif
+#ifdef USE_PIPELINE
+#include <pthread.h>
+#include <time.h>
+
+/* the interpreter takes statements from the queue in batches of up to this
+   many and waits at most this long for a batch to fill once it has one */
+#define PIPELINE_BATCH          64
+#define PIPELINE_DELAY          1000000     /* nanoseconds */
+
+/* statement compiled ahead of the one running */
+typedef struct Statement Statement;
+struct Statement {
+    Statement *next;            /* next statement in the queue */
+    VMVALUE code;               /* main code or zero if it didn't compile */
+    char *messages;             /* compiler messages to show before it runs */
+    size_t length;              /* length of the messages */
+};
+
+/* queue of statements between the compiler thread and the interpreter */
+typedef struct {
+    pthread_mutex_t lock;       /* protects the rest of the queue */
+    pthread_cond_t ready;       /* signaled when a statement is queued or the input ends */
+    pthread_cond_t idle;        /* signaled when a statement has run */
+    Statement *head;            /* next statement to run */
+    Statement *tail;            /* last statement queued */
+    int count;                  /* number of statements in the queue */
+    int running;                /* a statement is running */
+    int waiting;                /* the compiler is waiting for the queue to empty */
+    int done;                   /* the compiler reached the end of the input */
+    int failed;                 /* the compiler ran out of memory for the queue */
+    System *sys;                /* system the compiler uses */
+    ImageHdr *image;            /* image shared by the compiler and the interpreter */
+    char *messages;             /* messages of the statement being compiled */
+    size_t length;              /* length of those messages */
+    size_t size;                /* size of the message buffer */
+} Pipeline;
+
+static int pipelined = VMFALSE;
+static int inputDone = VMFALSE;
+static int RunPipeline(System *sys, ImageHdr *image);
+static void *CompileThread(void *cookie);
+static void QueueStatement(Pipeline *p, VMVALUE code);
+static void WaitForIdle(void *cookie);
+static void MessagePutChar(void *cookie, int ch);
+#endif
+#ifdef USE_TIERS
+static ImageHdr *profileImage;
+static void ShowProfile(void);
+#endif
+#ifdef USE_IMAGE_FILES
+static int saving = VMFALSE;
+static int endOfInput = VMFALSE;
+static int RunImage(System *sys, ImageHdr *image, char *name);
+static int CompileImage(System *sys, ImageHdr *image, char *name, int run);
+static int RunMappedImage(char *name, size_t freeSize);
+#endif
+
+int main(int argc, char *argv[])
+{
+    VMVALUE lineNumber = 0;
+    ImageHdr *image;
+    VMVALUE code;
+    System *sys;
+    int i;
+#ifdef RESERVED_HEAPSIZE
+    size_t heapSize = RESERVED_HEAPSIZE;
+    size_t imageSize = RESERVED_IMAGESIZE;
+    uint8_t *heap;
+#else
+    size_t heapSize = sizeof(space);
+    size_t imageSize = IMAGESIZE;
+    uint8_t *heap = space;
+#endif
+#ifdef USE_TIERS
+    int threshold = TIER_THRESHOLD;
+    int showProfile = VMFALSE;
+#endif
+#ifdef USE_IMAGE_FILES
+    char *saveName = NULL;
+    char *loadName = NULL;
+    int checkpoint = VMFALSE;
+    char *mapName = NULL;
+#endif
+#ifdef USE_SOURCE_FILES
+    char *sourceName = NULL;
+    char *source;
+#endif
+
+    VM_sysinit(argc, argv);
+
+    VM_printf("notc 0.001\n");
+
+    for (i = 1; i < argc; ++i) {
+#ifdef RESERVED_HEAPSIZE
+        /* -h size and -i size set the sizes of the heap and of the image
+           allocated from it (with an optional k or m suffix) */
+        if (strcmp(argv[i], "-h") == 0 && i + 1 < argc) {
+            if (!VM_parsesize(argv[++i], &heapSize)) {
+                VM_printf("error: bad heap size '%s'\n", argv[i]);
+                return 1;
+            }
+            continue;
+        }
+        if (strcmp(argv[i], "-i") == 0 && i + 1 < argc) {
+            if (!VM_parsesize(argv[++i], &imageSize)) {
+                VM_printf("error: bad image size '%s'\n", argv[i]);
+                return 1;
+            }
+            continue;
+        }
+#endif
+#ifdef USE_TIERS
+        /* -t n sets the promotion threshold and -p shows the execution profile at exit */
+        if (strcmp(argv[i], "-t") == 0 && i + 1 < argc) {
+            threshold = atoi(argv[++i]);
+            continue;
+        }
+        if (strcmp(argv[i], "-p") == 0) {
+            showProfile = VMTRUE;
+            continue;
+        }
+#endif
+#ifdef USE_IMAGE_FILES
+        /* -c file compiles the program into an image file instead of running
+           it, -s file runs the program and then saves a checkpoint of it in
+           an image file, -m file runs an image file in place without reading
+           a program and the name of an image file runs a saved image or
+           restores a checkpoint before reading the program */
+        if (strcmp(argv[i], "-c") == 0 && i + 1 < argc) {
+            saveName = argv[++i];
+            checkpoint = VMFALSE;
+            continue;
+        }
+        if (strcmp(argv[i], "-s") == 0 && i + 1 < argc) {
+            saveName = argv[++i];
+            checkpoint = VMTRUE;
+            continue;
+        }
+        if (strcmp(argv[i], "-m") == 0 && i + 1 < argc) {
+            mapName = argv[++i];
+            continue;
+        }
+        if (argv[i][0] != '-' && IsImageFile(argv[i])) {
+            loadName = argv[i];
+            continue;
+        }
+#endif
+#ifdef USE_PIPELINE
+        /* -q compiles the statements that follow on another thread while
+           each one runs (a program that reads its own input with getchar
+           sees the compiler reading ahead of it) */
+        if (strcmp(argv[i], "-q") == 0) {
+            pipelined = VMTRUE;
+            continue;
+        }
+#endif
+#ifdef USE_SOURCE_FILES
+        /* -f file compiles the whole program in a source file into a single
+           main code before running it once and any other file name is a
+           source file whose top level statements run as they are compiled */
+        if (strcmp(argv[i], "-f") == 0 && i + 1 < argc) {
+            sourceName = argv[++i];
+            wholeProgram = VMTRUE;
+            continue;
+        }
+        if (argv[i][0] != '-') {
+            sourceName = argv[i];
+            continue;
+        }
+#endif
+    }
+
+    /* VM addresses are offsets from the image that have to fit in a VMVALUE */
+    if (imageSize >= heapSize || heapSize > INT32_MAX) {
+        VM_printf("error: the image must be smaller than the heap and the heap under 2GB\n");
+        return 1;
+    }
+
+    /* the rest of the heap has to hold the compiler and an interpreter stack */
+    if (heapSize - imageSize < sizeof(System) + sizeof(ParseContext) + MIN_STACK_SIZE) {
+        VM_printf("error: the heap must be at least %lu bytes larger than the image\n",
+                  (unsigned long)(sizeof(System) + sizeof(ParseContext) + MIN_STACK_SIZE));
+        return 1;
+    }
+
+#ifdef USE_IMAGE_FILES
+    if (mapName)
+        return RunMappedImage(mapName, heapSize - imageSize) ? 0 : 1;
+#endif
+
+#ifdef RESERVED_HEAPSIZE
+    if (!(heap = ReserveHeap(heapSize))) {
+        VM_printf("error: can't reserve the heap\n");
+        return 1;
+    }
+#endif
+
+    sys = InitSystem(heap, heapSize);
+    sys->getLine = TermGetLine;
+    sys->getLineCookie = &lineNumber;
+#ifdef USE_TIERS
+    sys->tierThreshold = threshold;
+#endif
+
+#ifdef USE_SOURCE_FILES
+    /* scan a source file in place instead of reading the input a line at a time */
+    if (sourceName) {
+        if (!(source = MapSource(sourceName))) {
+            VM_printf("error: can't read '%s'\n", sourceName);
+            return 1;
+        }
+        SetSource(sys, source);
+        sys->getLine = SourceGetLine;
+    }
+#endif
+
+    if (!(image = AllocateImage(sys, imageSize))) {
+        VM_printf("error: insufficient memory for the image\n");
+        return 1;
+    }
+
+#ifdef USE_TIERS
+    if (showProfile) {
+        profileImage = image;
+        atexit(ShowProfile);
+    }
+#endif
+
+        
+    sys->freeMark = sys->freeNext;
+    
+#ifdef USE_IMAGE_FILES
+    if (loadName && !RunImage(sys, image, loadName))
+        return 1;
+    if (saveName)
+        return CompileImage(sys, image, saveName, checkpoint) ? 0 : 1;
+#endif
+
+#ifdef USE_SOURCE_FILES
+    if (wholeProgram) {
+        if ((code = CompileProgram(sys, image)) != 0) {
+            sys->freeNext = sys->freeMark;
+            code = Execute(sys, image, code);
+        }
+        VM_flush();
+        return code ? 0 : 1;
+    }
+#endif
+
+#ifdef USE_PIPELINE
+    if (pipelined)
+        return RunPipeline(sys, image) ? 0 : 1;
+#endif
+
+    for (;;) {
+        sys->freeNext = sys->freeMark;
+        if ((code = Compile(sys, image)) != 0) {
+            sys->freeNext = sys->freeMark;
+            Execute(sys, image, code);
+        }
+    }
+
+    return 0;
+}
+
+#ifdef USE_IMAGE_FILES
+
+/* RunImage - load an image file and run its top level statements */
+static int RunImage(System *sys, ImageHdr *image, char *name)
+{
+    VMVALUE *mains;
+    size_t size;
+    int count, i;
+    FILE *fp;
+
+    if (!(fp = fopen(name, "rb"))) {
+        VM_printf("error: can't open '%s'\n", name);
+        return VMFALSE;
+    }
+    if (!(size = ImageFileSize(fp))) {
+        VM_printf("error: '%s' isn't an image file for this build\n", name);
+        fclose(fp);
+        return VMFALSE;
+    }
+    if (size > (size_t)(image->heapTop - (uint8_t *)image)) {
+        VM_printf("error: image needs %lu bytes, use -i\n", (unsigned long)size);
+        fclose(fp);
+        return VMFALSE;
+    }
+    mains = LoadImage(sys, image, fp, &count);
+    fclose(fp);
+    if (!mains) {
+        VM_printf("error: '%s' is a damaged image file\n", name);
+        return VMFALSE;
+    }
+
+    for (i = 0; i < count; ++i) {
+        sys->freeNext = sys->freeMark;
+        Execute(sys, image, mains[i]);
+    }
+    free(mains);
+
+    return VMTRUE;
+}
+
+/* RunMappedImage - map an image file and run its top level statements in place
+
+   The image gets its own system with the free space the image would have
+   left in the heap. */
+static int RunMappedImage(char *name, size_t freeSize)
+{
+    uint8_t *freeSpace;
+    VMVALUE *mains;
+    ImageHdr *image;
+    int count, i;
+    System *sys;
+    FILE *fp;
+
+    if (!(fp = fopen(name, "rb"))) {
+        VM_printf("error: can't open '%s'\n", name);
+        return VMFALSE;
+    }
+    image = MapImage(fp, freeSize, &freeSpace, &mains, &count);
+    fclose(fp);
+    if (!image) {
+        VM_printf("error: can't run '%s' in place\n", name);
+        return VMFALSE;
+    }
+
+    sys = InitSystem(freeSpace, freeSize);
+    sys->freeMark = sys->freeNext;
+    for (i = 0; i < count; ++i) {
+        sys->freeNext = sys->freeMark;
+        Execute(sys, image, mains[i]);
+    }
+    free(mains);
+
+    VM_flush();
+    return VMTRUE;
+}
+
+/* CompileImage - compile the whole program and save it in an image file
+
+   The top level statements are compiled but not run so they can be run in
+   order when the image is loaded.  With run they are run as they are
+   compiled like they usually are and the image is saved as a checkpoint
+   with the values they leave in the global variables.  A whole program
+   compiled with -f has just one main code. */
+static int CompileImage(System *sys, ImageHdr *image, char *name, int run)
+{
+    VMVALUE *mains = NULL, *newMains, code;
+    int count = 0, ok = VMTRUE;
+    FILE *fp;
+
+    /* compile to the end of the input */
+    saving = VMTRUE;
+    while (!endOfInput) {
+        sys->freeNext = sys->freeMark;
+#ifdef USE_SOURCE_FILES
+        code = wholeProgram ? CompileProgram(sys, image) : Compile(sys, image);
+#else
+        code = Compile(sys, image);
+#endif
+        if (code == 0)
+            ok = VMFALSE;
+        else if (run) {
+            sys->freeNext = sys->freeMark;
+            if (!Execute(sys, image, code))
+                ok = VMFALSE;
+        }
+        else if (!(newMains = (VMVALUE *)realloc(mains, (count + 1) * sizeof(VMVALUE)))) {
+            VM_printf("error: insufficient memory\n");
+            ok = VMFALSE;
+            break;
+        }
+        else {
+            mains = newMains;
+            mains[count++] = code;
+        }
+    }
+
+    /* save the image if there were no errors */
+    if (ok) {
+        if (!(fp = fopen(name, "wb"))) {
+            VM_printf("error: can't create '%s'\n", name);
+            ok = VMFALSE;
+        }
+        else {
+            ok = SaveImage(image, mains, count, fp);
+            if (fclose(fp) != 0 || !ok) {
+                VM_printf("error: can't write '%s'\n", name);
+                remove(name);
+                ok = VMFALSE;
+            }
+        }
+    }
+
+    VM_flush();
+    free(mains);
+    return ok;
+}
+
+#endif
+
+#ifdef USE_PIPELINE
+
+/* RunPipeline - compile statements on another thread while running them here
+
+   Each statement still runs after the one before it has finished and the
+   compiler waits for the statements in the queue to finish before it
+   changes anything they can see like the value of a global variable or the
+   definition of a function.  Compiler messages are queued with the
+   statements so they come out in order with the output of the program.
+   The interpreter gets the top half of the free space for its stack. */
+static int RunPipeline(System *sys, ImageHdr *image)
+{
+    uint8_t *base = sys->freeTop - (sys->freeTop - sys->freeMark) / 2;
+    Statement *statement;
+    pthread_t compiler;
+    System *vmSys;
+    Pipeline p;
+
+    /* split the free space between the compiler and the interpreter */
+    base = (uint8_t *)((uintptr_t)base & ~(uintptr_t)15);
+    if (!(vmSys = InitSystem(base, sys->freeTop - base))) {
+        VM_printf("error: insufficient memory\n");
+        return VMFALSE;
+    }
+    vmSys->freeMark = vmSys->freeNext;
+    sys->freeTop = base;
+#ifdef USE_TIERS
+    vmSys->tierThreshold = sys->tierThreshold;
+#endif
+
+    /* start the compiler */
+    pthread_mutex_init(&p.lock, NULL);
+    pthread_cond_init(&p.ready, NULL);
+    pthread_cond_init(&p.idle, NULL);
+    p.head = p.tail = NULL;
+    p.count = 0;
+    p.running = p.waiting = VMFALSE;
+    p.done = p.failed = VMFALSE;
+    p.sys = sys;
+    p.image = image;
+    p.messages = NULL;
+    p.length = p.size = 0;
+    sys->putChar = MessagePutChar;
+    sys->putCharCookie = &p;
+    sys->update = WaitForIdle;
+    sys->updateCookie = &p;
+    if (pthread_create(&compiler, NULL, CompileThread, &p) != 0) {
+        VM_printf("error: can't start the compiler thread\n");
+        return VMFALSE;
+    }
+
+    /* run the statements in the queue a batch at a time so the threads
+       trade places less often than once a statement */
+    for (;;) {
+        pthread_mutex_lock(&p.lock);
+        while (!p.head && !p.done)
+            pthread_cond_wait(&p.ready, &p.lock);
+        if (p.head && !p.done && !p.waiting && p.count < PIPELINE_BATCH) {
+            struct timespec deadline;
+            clock_gettime(CLOCK_REALTIME, &deadline);
+            if ((deadline.tv_nsec += PIPELINE_DELAY) >= 1000000000) {
+                deadline.tv_nsec -= 1000000000;
+                ++deadline.tv_sec;
+            }
+            while (!p.done && !p.waiting && p.count < PIPELINE_BATCH)
+                if (pthread_cond_timedwait(&p.ready, &p.lock, &deadline) != 0)
+                    break;
+        }
+        if (!(statement = p.head)) {
+            pthread_mutex_unlock(&p.lock);
+            break;
+        }
+        p.head = p.tail = NULL;
+        p.count = 0;
+        p.running = VMTRUE;
+#if defined(USE_JIT) && !defined(USE_TIERS)
+        /* functions are translated by the compiler */
+        vmSys->jitBase = sys->jitBase;
+#endif
+        pthread_mutex_unlock(&p.lock);
+
+        while (statement) {
+            Statement *next = statement->next;
+            PutString(vmSys, statement->messages, statement->length);
+            if (statement->code) {
+                vmSys->freeNext = vmSys->freeMark;
+                Execute(vmSys, image, statement->code);
+            }
+            free(statement->messages);
+            free(statement);
+            statement = next;
+        }
+
+        pthread_mutex_lock(&p.lock);
+        p.running = VMFALSE;
+        pthread_cond_signal(&p.idle);
+        pthread_mutex_unlock(&p.lock);
+    }
+
+    pthread_join(compiler, NULL);
+    if (p.failed)
+        VM_printf("error: insufficient memory\n");
+    VM_flush();
+    return !p.failed;
+}
+
+/* CompileThread - compile statements until the end of the input */
+static void *CompileThread(void *cookie)
+{
+    Pipeline *p = (Pipeline *)cookie;
+    System *sys = p->sys;
+
+    while (!inputDone) {
+        sys->freeNext = sys->freeMark;
+        QueueStatement(p, Compile(sys, p->image));
+    }
+
+    pthread_mutex_lock(&p->lock);
+    p->done = VMTRUE;
+    pthread_cond_signal(&p->ready);
+    pthread_mutex_unlock(&p->lock);
+
+    return NULL;
+}
+
+/* QueueStatement - add a compiled statement and its messages to the queue */
+static void QueueStatement(Pipeline *p, VMVALUE code)
+{
+    Statement *statement;
+
+    /* stop compiling if the statement can't be queued */
+    if (!(statement = (Statement *)malloc(sizeof(Statement)))) {
+        p->failed = inputDone = VMTRUE;
+        return;
+    }
+    statement->next = NULL;
+    statement->code = code;
+    statement->messages = p->messages;
+    statement->length = p->length;
+    p->messages = NULL;
+    p->length = p->size = 0;
+
+    pthread_mutex_lock(&p->lock);
+    if (p->tail)
+        p->tail->next = statement;
+    else
+        p->head = statement;
+    p->tail = statement;
+    if (++p->count == 1 || p->count == PIPELINE_BATCH)
+        pthread_cond_signal(&p->ready);
+    pthread_mutex_unlock(&p->lock);
+}
+
+/* WaitForIdle - wait for all of the queued statements to finish */
+static void WaitForIdle(void *cookie)
+{
+    Pipeline *p = (Pipeline *)cookie;
+    pthread_mutex_lock(&p->lock);
+    p->waiting = VMTRUE;
+    pthread_cond_signal(&p->ready);
+    while (p->head || p->running)
+        pthread_cond_wait(&p->idle, &p->lock);
+    p->waiting = VMFALSE;
+    pthread_mutex_unlock(&p->lock);
+}
+
+/* MessagePutChar - add a character to the messages of the statement being compiled */
+static void MessagePutChar(void *cookie, int ch)
+{
+    Pipeline *p = (Pipeline *)cookie;
+    if (p->length >= p->size) {
+        size_t size = p->size ? p->size * 2 : 256;
+        char *messages;
+        if (!(messages = (char *)realloc(p->messages, size)))
+            return;
+        p->messages = messages;
+        p->size = size;
+    }
+    p->messages[p->length++] = ch;
+}
+
+#endif
+
+#ifdef RESERVED_HEAPSIZE
+
+/* ReserveHeap - reserve address space for the heap
+
+   The pages are only given memory when they are first touched so the heap
+   grows a page at a time as the image and the compiler use it. */
+static uint8_t *ReserveHeap(size_t size)
+{
+    void *heap = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANON | MAP_NORESERVE, -1, 0);
+    return heap == MAP_FAILED ? NULL : (uint8_t *)heap;
+}
+
+#endif
+
+#ifdef USE_TIERS
+static void ShowProfile(void)
+{
+    DumpProfile(profileImage);
+}
+#endif
+
+static int TermGetLine(void *cookie, char *buf, int len, VMVALUE *pLineNumber)
+{
+    VMVALUE *pLine = (VMVALUE *)cookie;
+    *pLineNumber = ++(*pLine);
+    if (!VM_getline(buf, len))
+        return EndOfInput();
+    return VMTRUE;
+}
+
+/* EndOfInput - handle the end of the program */
+static int EndOfInput(void)
+{
+#ifdef USE_IMAGE_FILES
+    /* finish the last statement before saving an image */
+    if (saving) {
+        endOfInput = VMTRUE;
+        return VMFALSE;
+    }
+#endif
+#ifdef USE_PIPELINE
+    /* the statements still in the queue have to run */
+    if (pipelined) {
+        inputDone = VMTRUE;
+        return VMFALSE;
+    }
+#endif
+#ifdef USE_SOURCE_FILES
+    /* the main code of a whole program still has to run */
+    if (wholeProgram)
+        return VMFALSE;
+#endif
+    /* end the session at the end of the input */
+    VM_flush();
+    exit(0);
+}
+
+#ifdef USE_SOURCE_FILES
+
+/* MapSource - map a source file to scan in place
+
+   The file is mapped over the start of a reservation one byte larger so it
+   is always followed by a zero byte even when it fills its last page. */
+static char *MapSource(char *name)
+{
+    char *base;
+    FILE *fp;
+    long size;
+
+    if (!(fp = fopen(name, "rb")))
+        return NULL;
+    if (fseek(fp, 0, SEEK_END) != 0 || (size = ftell(fp)) < 0) {
+        fclose(fp);
+        return NULL;
+    }
+    base = (char *)mmap(NULL, size + 1, PROT_READ, MAP_PRIVATE | MAP_ANON, -1, 0);
+    if (base != (char *)MAP_FAILED && size > 0
+    &&  mmap(base, size, PROT_READ, MAP_PRIVATE | MAP_FIXED, fileno(fp), 0) == MAP_FAILED) {
+        munmap(base, size + 1);
+        base = (char *)MAP_FAILED;
+    }
+    fclose(fp);
+    return base == (char *)MAP_FAILED ? NULL : base;
+}
+
+/* SourceGetLine - there are no more lines after a source file */
+static int SourceGetLine(void *cookie, char *buf, int len, VMVALUE *pLineNumber)
+{
+    return EndOfInput();
+}
+
+#endif
@@ -0,0 +1,343 @@
+/* notcpool.c - run independent notc programs concurrently on a pool of threads
+ *
+ * Copyright (c) 2014 by David Michael Betz.  All rights reserved.
+ *
+ */
+
+/* usage: notcpool [-j threads] [-n copies] [-m size] [-s] [-b] file...
+
+   Each copy of each file is compiled and run in its own context with its own
+   heap, image and native code region so the programs share nothing but the
+   code of the runtime.  The output of each program is collected and shown in
+   order once all of them have finished and any copy that failed is reported
+   on stderr.  Each context gets an arena of the size given with -m (with an
+   optional k or m suffix) or of DEFAULT_ARENA_SIZE bytes.
+
+   With -s each file is compiled just once and each copy calls its main
+   function in a context that shares the compiled code and has its own copy
+   of the global variables.
+
+   With -b the output is discarded and the whole set of programs is run once
+   for each thread count from 1 to the number of processors to show how the
+   throughput scales. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <pthread.h>
+#include "libnotc.h"
+
+/* default size of the arena of each context */
+#define DEFAULT_ARENA_SIZE      (1024 * 1024)
+
+/* program source */
+typedef struct {
+    char *name;                 /* file name */
+    char *text;                 /* file contents */
+    size_t size;                /* size of the file contents */
+    NotcContext *shared;        /* context holding the compiled code to share or NULL */
+    NotcFunction *main;         /* main function of the shared code */
+} Source;
+
+/* program output buffer (the cookie for the output handler) */
+typedef struct {
+    char *buf;                  /* output collected so far */
+    size_t len;                 /* length of the output */
+    size_t size;                /* size of the buffer */
+    int discard;                /* just count the output */
+} Output;
+
+/* one run of a program */
+typedef struct {
+    Source *source;             /* program to run */
+    Output output;              /* output of the program */
+    int failed;                 /* the program couldn't be compiled or run */
+} Job;
+
+/* worker pool state */
+typedef struct {
+    pthread_mutex_t lock;       /* protects next and nextHeap */
+    Job *jobs;                  /* jobs to run */
+    int jobCount;               /* number of jobs */
+    int next;                   /* index of the next job to start */
+    uint8_t *heaps;             /* one heap for each worker */
+    int nextHeap;               /* index of the heap for the next worker */
+    size_t heapSize;            /* size of each heap */
+} Pool;
+
+static int LoadSource(Source *source, char *name);
+static int ShareSource(Source *source, uint8_t *space, Pool *pool, int discard);
+static int ReportFailures(Pool *pool, int sourceCount);
+static void RunPool(Pool *pool, int threadCount);
+static void *Worker(void *cookie);
+static void RunJob(Job *job, uint8_t *space, size_t size);
+static void PoolPutChar(void *cookie, int ch);
+static double Now(void);
+
+int main(int argc, char *argv[])
+{
+    int threadCount = 1, copies = 1, share = 0, benchmark = 0;
+    int sourceCount = 0, status = 0, maxThreads, i, j;
+    size_t size = DEFAULT_ARENA_SIZE;
+    Source *sources;
+    uint8_t *space;
+    Pool pool;
+
+    /* get the options and load the programs */
+    if (!(sources = (Source *)malloc(argc * sizeof(Source))))
+        return 1;
+    for (i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "-j") == 0 && i + 1 < argc)
+            threadCount = atoi(argv[++i]);
+        else if (strcmp(argv[i], "-n") == 0 && i + 1 < argc)
+            copies = atoi(argv[++i]);
+        else if (strcmp(argv[i], "-m") == 0 && i + 1 < argc) {
+            if (!NotcParseSize(argv[++i], &size)) {
+                fprintf(stderr, "error: bad arena size '%s'\n", argv[i]);
+                return 1;
+            }
+        }
+        else if (strcmp(argv[i], "-s") == 0)
+            share = 1;
+        else if (strcmp(argv[i], "-b") == 0)
+            benchmark = 1;
+        else if (!LoadSource(&sources[sourceCount++], argv[i])) {
+            fprintf(stderr, "error: can't read '%s'\n", argv[i]);
+            return 1;
+        }
+    }
+    if (sourceCount == 0 || threadCount < 1 || copies < 1 || size == 0) {
+        fprintf(stderr, "usage: notcpool [-j threads] [-n copies] [-m size] [-s] [-b] file...\n");
+        return 1;
+    }
+
+    /* allocate the heaps of the shared contexts below those of the workers
+       since shared code can only reach memory above it (keeping each heap
+       aligned) */
+    pool.heapSize = (size + 15) & ~(size_t)15;
+    maxThreads = benchmark ? (int)sysconf(_SC_NPROCESSORS_ONLN) : threadCount;
+    if (!(space = (uint8_t *)malloc((sourceCount + maxThreads) * pool.heapSize))) {
+        fprintf(stderr, "error: insufficient memory\n");
+        return 1;
+    }
+    pool.heaps = space + sourceCount * pool.heapSize;
+
+    /* compile the shared code */
+    if (share) {
+        for (i = 0; i < sourceCount; ++i) {
+            if (!ShareSource(&sources[i], space + i * pool.heapSize, &pool, benchmark))
+                return 1;
+        }
+    }
+
+    /* make a job for each copy of each program */
+    pool.jobCount = sourceCount * copies;
+    if (!(pool.jobs = (Job *)calloc(pool.jobCount, sizeof(Job))))
+        return 1;
+    for (i = 0; i < pool.jobCount; ++i) {
+        pool.jobs[i].source = &sources[i % sourceCount];
+        pool.jobs[i].output.discard = benchmark;
+    }
+    pthread_mutex_init(&pool.lock, NULL);
+
+    /* run the jobs once for each thread count */
+    if (benchmark) {
+        double base = 0;
+        printf("threads   programs/sec  speedup\n");
+        for (i = 1; i <= maxThreads; ++i) {
+            double start = Now(), rate;
+            RunPool(&pool, i);
+            rate = pool.jobCount / (Now() - start);
+            if (i == 1)
+                base = rate;
+            printf("%7d %14.1f %8.2f\n", i, rate, rate / base);
+            if (ReportFailures(&pool, sourceCount))
+                status = 1;
+        }
+    }
+
+    /* or run them once and show the output of each in order */
+    else {
+        RunPool(&pool, threadCount);
+        for (j = 0; j < pool.jobCount; ++j) {
+            Output *output = &pool.jobs[j].output;
+            fwrite(output->buf, 1, output->len, stdout);
+        }
+        fflush(stdout);
+        if (ReportFailures(&pool, sourceCount))
+            status = 1;
+    }
+
+    return status;
+}
+
+/* LoadSource - read the contents of a source file */
+static int LoadSource(Source *source, char *name)
+{
+    FILE *fp;
+    long size;
+
+    if (!(fp = fopen(name, "rb")))
+        return 0;
+    fseek(fp, 0, SEEK_END);
+    size = ftell(fp);
+    fseek(fp, 0, SEEK_SET);
+    if (size < 0 || !(source->text = (char *)malloc(size + 1))
+    ||  fread(source->text, 1, size, fp) != (size_t)size) {
+        fclose(fp);
+        return 0;
+    }
+    fclose(fp);
+
+    source->name = name;
+    source->size = size;
+    source->shared = NULL;
+    return 1;
+}
+
+/* ShareSource - compile a program once to share among its copies */
+static int ShareSource(Source *source, uint8_t *space, Pool *pool, int discard)
+{
+    static Output discarded = { NULL, 0, 0, 1 };
+    NotcContext *ctx;
+
+    /* compile the program running its top level statements */
+    if (!(ctx = NotcCreate(space, pool->heapSize))) {
+        fprintf(stderr, "error: the arena is too small for '%s'\n", source->name);
+        return 0;
+    }
+    if (discard)
+        NotcSetOutput(ctx, PoolPutChar, &discarded);
+    if (!NotcCompile(ctx, source->text, source->size)) {
+        fprintf(stderr, "error: '%s' failed to compile or run\n", source->name);
+        return 0;
+    }
+
+    /* make sure the code can be shared */
+    if (!(source->main = NotcLookup(ctx, "main"))) {
+        fprintf(stderr, "error: '%s' has no main function\n", source->name);
+        return 0;
+    }
+    if (!NotcShare(ctx, pool->heaps, pool->heapSize)) {
+        fprintf(stderr, "error: can't share the code of '%s'\n", source->name);
+        return 0;
+    }
+
+    source->shared = ctx;
+    return 1;
+}
+
+/* RunPool - run all of the jobs on a pool of threads */
+static void RunPool(Pool *pool, int threadCount)
+{
+    pthread_t *threads;
+    int i;
+
+    if (!(threads = (pthread_t *)malloc(threadCount * sizeof(pthread_t))))
+        return;
+
+    /* start the workers and wait for them to run out of jobs */
+    pool->next = 0;
+    pool->nextHeap = 0;
+    for (i = 0; i < threadCount; ++i)
+        pthread_create(&threads[i], NULL, Worker, pool);
+    for (i = 0; i < threadCount; ++i)
+        pthread_join(threads[i], NULL);
+
+    free(threads);
+}
+
+/* Worker - run jobs until there are none left */
+static void *Worker(void *cookie)
+{
+    Pool *pool = (Pool *)cookie;
+    uint8_t *space;
+    int next;
+
+    /* each worker reuses one heap for all of its jobs */
+    pthread_mutex_lock(&pool->lock);
+    space = pool->heaps + pool->nextHeap++ * pool->heapSize;
+    pthread_mutex_unlock(&pool->lock);
+
+    for (;;) {
+        pthread_mutex_lock(&pool->lock);
+        next = pool->next++;
+        pthread_mutex_unlock(&pool->lock);
+        if (next >= pool->jobCount)
+            break;
+        RunJob(&pool->jobs[next], space, pool->heapSize);
+    }
+
+    return NULL;
+}
+
+/* RunJob - compile and run one program in a fresh context or call the main
+   function of shared code */
+static void RunJob(Job *job, uint8_t *space, size_t size)
+{
+    Source *source = job->source;
+    NotcContext *ctx;
+    int32_t value;
+
+    job->output.len = 0;
+    job->failed = 1;
+
+    if (source->shared) {
+        if (!(ctx = NotcShare(source->shared, space, size)))
+            return;
+        NotcSetOutput(ctx, PoolPutChar, &job->output);
+        job->failed = !NotcCall(ctx, source->main, 0, NULL, &value);
+    }
+    else {
+        if (!(ctx = NotcCreate(space, size)))
+            return;
+        NotcSetOutput(ctx, PoolPutChar, &job->output);
+        job->failed = !NotcCompile(ctx, source->text, source->size);
+    }
+    NotcDestroy(ctx);
+}
+
+/* ReportFailures - show which copies of which programs failed on stderr
+
+   Returns nonzero if any did. */
+static int ReportFailures(Pool *pool, int sourceCount)
+{
+    int failures = 0, i;
+    for (i = 0; i < pool->jobCount; ++i) {
+        Job *job = &pool->jobs[i];
+        if (job->failed) {
+            fprintf(stderr, "error: copy %d of '%s' failed\n", i / sourceCount + 1, job->source->name);
+            ++failures;
+        }
+    }
+    return failures;
+}
+
+/* PoolPutChar - add a character to the output of a program */
+static void PoolPutChar(void *cookie, int ch)
+{
+    Output *output = (Output *)cookie;
+    if (output->discard)
+        ++output->len;
+    else {
+        if (output->len >= output->size) {
+            size_t size = output->size ? output->size * 2 : 256;
+            char *buf;
+            if (!(buf = (char *)realloc(output->buf, size)))
+                return;
+            output->buf = buf;
+            output->size = size;
+        }
+        output->buf[output->len++] = ch;
+    }
+}
+
+/* Now - get the time in seconds */
+static double Now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
@@ -0,0 +1,198 @@
+/* scanbench.c - measure how fast the scanner turns source into tokens
+ *
+ * Copyright (c) 2014 by David Michael Betz.  All rights reserved.
+ *
+ */
+
+/* usage: scanbench [-n passes] [-l] file...
+
+   The files are joined and repeated until they make at least MIN_TEXT_SIZE
+   bytes of source so small files can be timed too.  Each pass gets every
+   token of the source with GetToken and the rate of the fastest pass is
+   shown.  The source is scanned in place as the notc program scans source
+   files unless -l is given to feed it to the scanner a line at a time as
+   the notc program reads its standard input. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "db_compiler.h"
+
+/* smallest source to scan in each pass */
+#define MIN_TEXT_SIZE   (1024 * 1024)
+
+/* free space for the system and the parse context */
+#define SPACE_SIZE      (64 * 1024)
+
+/* source being scanned */
+typedef struct {
+    char *text;                 /* the whole source */
+    size_t size;                /* size of the source */
+    char *next;                 /* start of the next line (with -l) */
+} Text;
+
+/* local function prototypes */
+static char *LoadFile(const char *name, size_t *pSize);
+static int TextGetLine(void *cookie, char *buf, int len, VMVALUE *pLineNumber);
+static int EndGetLine(void *cookie, char *buf, int len, VMVALUE *pLineNumber);
+static void ErrorPutChar(void *cookie, int ch);
+static double Now(void);
+
+int main(int argc, char *argv[])
+{
+    static uint8_t space[SPACE_SIZE];
+    int passes = 10, lines = 0, fileCount = 0, pass, i;
+    size_t size = 0, fileSize;
+    double best = 0.0, start, elapsed;
+    char *files = NULL, *file, *p;
+    long tokens = 0;
+    ParseContext *c;
+    System *sys;
+    Text text;
+
+    /* get the options and join the files */
+    for (i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "-n") == 0 && i + 1 < argc)
+            passes = atoi(argv[++i]);
+        else if (strcmp(argv[i], "-l") == 0)
+            lines = 1;
+        else {
+            if (!(file = LoadFile(argv[i], &fileSize))
+            ||  !(p = (char *)realloc(files, size + fileSize + 1))) {
+                fprintf(stderr, "error: can't read '%s'\n", argv[i]);
+                return 1;
+            }
+            files = p;
+            memcpy(files + size, file, fileSize);
+            size += fileSize;
+            free(file);
+            ++fileCount;
+        }
+    }
+    if (fileCount == 0 || size == 0 || passes < 1) {
+        fprintf(stderr, "usage: scanbench [-n passes] [-l] file...\n");
+        return 1;
+    }
+
+    /* repeat the files to make the source to scan */
+    text.size = size * ((MIN_TEXT_SIZE + size - 1) / size);
+    if (!(text.text = (char *)malloc(text.size + 1))) {
+        fprintf(stderr, "error: insufficient memory\n");
+        return 1;
+    }
+    for (p = text.text; p < text.text + text.size; p += size)
+        memcpy(p, files, size);
+    text.text[text.size] = '\0';
+    free(files);
+
+    /* set up a system and a parse context for the scanner */
+    if (!(sys = InitSystem(space, sizeof(space)))
+    ||  !(c = (ParseContext *)AllocateFreeSpace(sys, sizeof(ParseContext)))) {
+        fprintf(stderr, "error: insufficient memory\n");
+        return 1;
+    }
+    sys->getLineCookie = &text;
+    sys->putChar = ErrorPutChar;
+
+    for (pass = 0; pass < passes; ++pass) {
+        int tkn;
+
+        /* start scanning at the beginning of the source */
+        memset(c, 0, sizeof(ParseContext));
+        c->sys = sys;
+        sys->lineNumber = 0;
+        if (lines) {
+            text.next = text.text;
+            sys->getLine = TextGetLine;
+            sys->lineBuf[0] = '\0';
+            sys->linePtr = sys->lineBuf;
+            sys->source = NULL;
+        }
+        else {
+            sys->getLine = EndGetLine;
+            SetSource(sys, text.text);
+        }
+        if (setjmp(sys->errorTarget))
+            return 1;
+
+        /* get every token */
+        tokens = 0;
+        start = Now();
+        while ((tkn = GetToken(c)) != T_EOF)
+            ++tokens;
+        elapsed = Now() - start;
+        if (pass == 0 || elapsed < best)
+            best = elapsed;
+    }
+
+    printf("%ld tokens in %lu bytes, best of %d passes %.4f s, %.0f tokens/s\n",
+           tokens, (unsigned long)text.size, passes, best, tokens / best);
+
+    return 0;
+}
+
+/* LoadFile - read the contents of a file */
+static char *LoadFile(const char *name, size_t *pSize)
+{
+    char *buf;
+    FILE *fp;
+    long size;
+
+    if (!(fp = fopen(name, "rb")))
+        return NULL;
+    if (fseek(fp, 0, SEEK_END) != 0 || (size = ftell(fp)) < 0
+    ||  fseek(fp, 0, SEEK_SET) != 0
+    ||  !(buf = (char *)malloc(size + 1))) {
+        fclose(fp);
+        return NULL;
+    }
+    if (fread(buf, 1, size, fp) != (size_t)size) {
+        free(buf);
+        fclose(fp);
+        return NULL;
+    }
+    fclose(fp);
+
+    *pSize = size;
+    return buf;
+}
+
+/* TextGetLine - get the next line of the source (with -l) */
+static int TextGetLine(void *cookie, char *buf, int len, VMVALUE *pLineNumber)
+{
+    Text *text = (Text *)cookie;
+    char *end = text->text + text->size;
+    int i = 0;
+
+    if (text->next >= end)
+        return VMFALSE;
+    while (i < len - 1 && text->next < end) {
+        if ((buf[i++] = *text->next++) == '\n')
+            break;
+    }
+    buf[i] = '\0';
+    ++(*pLineNumber);
+
+    return VMTRUE;
+}
+
+/* EndGetLine - there are no more lines after a source scanned in place */
+static int EndGetLine(void *cookie, char *buf, int len, VMVALUE *pLineNumber)
+{
+    return VMFALSE;
+}
+
+/* ErrorPutChar - show scanner errors on stderr */
+static void ErrorPutChar(void *cookie, int ch)
+{
+    putc(ch, stderr);
+}
+
+/* Now - get the time in seconds */
+static double Now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
@@ -0,0 +1,28 @@
+#!/bin/bash
+# bench.sh - compare the stack and register code generators
+#
+# Each program in bench/ is timed under notc and notc-reg and run under
+# notc-stats and notc-reg-stats, which are built with -DPAIR_STATS, to count
+# the instructions it executes.  The time is the best of three runs.
+
+dir=`dirname $0`
+TIMEFORMAT=%R
+
+# bench backend notc stats program - show the counts and time of one run
+bench() {
+    count=`$3 < $4 2>&1 > /dev/null | sed -n 's/^opcode pairs (\([0-9]*\) executed):$/\1/p'`
+    best=
+    for run in 1 2 3; do
+        seconds=`{ time $2 < $4 > /dev/null; } 2>&1`
+        if [ -z "$best" ] || awk "BEGIN { exit !($seconds < $best) }"; then
+            best=$seconds
+        fi
+    done
+    printf "%-8s %-9s %14s %8ss\n" `basename $4 .nc` $1 $count $best
+}
+
+printf "%-8s %-9s %14s %9s\n" program backend instructions time
+for t in $dir/bench/*.nc; do
+    bench stack ./notc ./notc-stats $t
+    bench register ./notc-reg ./notc-reg-stats $t
+done
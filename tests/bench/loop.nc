@@ -0,0 +1,2 @@
+def loop(n) { var i, s; s = 0; for (i = 0; i < n; i++) { s = s + i * 3; if (s > 100000) s = s - 100000; } return s; }
+print loop(20000000);
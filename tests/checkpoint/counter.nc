@@ -0,0 +1,4 @@
+var n = 40;
+var log[3] = {7, 8, 9};
+def bump(k) { n += k; log[k] = n; return n; }
+print bump(1);
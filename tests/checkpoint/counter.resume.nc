@@ -0,0 +1,3 @@
+print bump(1), n, log[0] + log[1] + log[2];
+def bump(k) { n -= k; return n; }
+print bump(2);
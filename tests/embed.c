@@ -0,0 +1,224 @@
+/* embed.c - test the interface for embedding notc in another program
+ *
+ * Copyright (c) 2014 by David Michael Betz.  All rights reserved.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "libnotc.h"
+
+/* size of the arena of each context */
+#define ARENA_SIZE      (256 * 1024)
+
+/* number of arenas (a shared context's arena must lie above its source's) */
+#define ARENA_COUNT     3
+
+/* most slices to give the scheduler before giving up */
+#define MAX_SLICES      100000
+
+/* program output buffer (the cookie for the output handler) */
+typedef struct {
+    char buf[1024];             /* output collected so far */
+    size_t len;                 /* length of the output */
+} Output;
+
+static long arenas[ARENA_COUNT][ARENA_SIZE / sizeof(long)];
+static int failed = 0;
+
+/* local function prototypes */
+static void TestCalls(void);
+static void TestShare(void);
+static void TestCheckpoint(void);
+static void TestScheduler(void);
+static NotcContext *CreateContext(void *arena, Output *output, const char *source);
+static int Compile(NotcContext *ctx, const char *source);
+static int CallValue(NotcContext *ctx, const char *name, int argc, const int32_t *argv, int32_t *pResult);
+static void Check(const char *name, int ok);
+static void OutputPutChar(void *cookie, int ch);
+
+int main(void)
+{
+    TestCalls();
+    TestShare();
+    TestCheckpoint();
+    TestScheduler();
+    return failed;
+}
+
+/* TestCalls - call functions with arguments and recompile them */
+static void TestCalls(void)
+{
+    int32_t argv[2] = { 3, 4 }, n[1] = { 20 }, value;
+    NotcFunction *add;
+    NotcContext *ctx;
+    Output output;
+
+    ctx = CreateContext(arenas[0], &output,
+        "def add(a, b) { return a * 10 + b; }\n"
+        "def fib(n) { if (n < 2) return n; return fib(n - 1) + fib(n - 2); }\n"
+        "print \"loaded\";\n");
+    Check("compile", ctx != NULL && strcmp(output.buf, "loaded\n") == 0);
+    if (!ctx)
+        return;
+    Check("lookup", (add = NotcLookup(ctx, "add")) != NULL && !NotcLookup(ctx, "nothing"));
+    Check("call with arguments", NotcCall(ctx, add, 2, argv, &value) && value == 34);
+    Check("recursive call", CallValue(ctx, "fib", 1, n, &value) && value == 6765);
+    Check("argc mismatch", !NotcCall(ctx, add, 1, argv, &value) && !NotcCall(ctx, add, 3, argv, &value));
+
+    /* calls through an old handle use the new definition */
+    Check("recompile", Compile(ctx, "def add(a, b) { return a - b; }\n"));
+    Check("call recompiled function", NotcCall(ctx, add, 2, argv, &value) && value == -1);
+    Check("recompile with other arguments", Compile(ctx, "def add(a) { return a + 1; }\n"));
+    Check("argc follows recompile", !NotcCall(ctx, add, 2, argv, &value) && NotcCall(ctx, add, 1, argv, &value) && value == 4);
+
+    NotcDestroy(ctx);
+}
+
+/* TestShare - run shared code with private copies of the global variables */
+static void TestShare(void)
+{
+    int32_t n[4] = { 5, 7, 1, 0 }, value;
+    NotcContext *source, *copy1, *copy2;
+    Output output;
+
+    source = CreateContext(arenas[0], &output,
+        "var total = 100;\n"
+        "def add(n) { total += n; return total; }\n");
+    Check("compile shared code", source != NULL);
+    if (!source)
+        return;
+    copy1 = NotcShare(source, arenas[1], ARENA_SIZE);
+    copy2 = NotcShare(source, arenas[2], ARENA_SIZE);
+    Check("share", copy1 != NULL && copy2 != NULL);
+    if (copy1 && copy2) {
+        Check("call shared code", CallValue(copy1, "add", 1, &n[0], &value) && value == 105);
+        Check("private globals", CallValue(copy2, "add", 1, &n[1], &value) && value == 107);
+        Check("globals kept between calls", CallValue(copy1, "add", 1, &n[2], &value) && value == 106);
+        Check("source globals untouched", CallValue(source, "add", 1, &n[3], &value) && value == 100);
+        Check("no compiling into shared context", !Compile(copy1, "def f() { return 1; }\n"));
+    }
+    if (copy1)
+        NotcDestroy(copy1);
+    if (copy2)
+        NotcDestroy(copy2);
+    NotcDestroy(source);
+}
+
+/* TestCheckpoint - save a checkpoint and restore it into a new context */
+static void TestCheckpoint(void)
+{
+    const char *tmp = getenv("TMPDIR");
+    NotcContext *ctx, *restored;
+    Output output;
+    char path[256];
+    int32_t value;
+
+    snprintf(path, sizeof(path), "%s/notc-embed%d.nbc", tmp ? tmp : "/tmp", (int)getpid());
+
+    ctx = CreateContext(arenas[0], &output,
+        "var count = 0;\n"
+        "def next() { return ++count; }\n"
+        "next(); next();\n");
+    Check("compile checkpointed program", ctx != NULL);
+    if (!ctx)
+        return;
+    Check("checkpoint", NotcCheckpoint(ctx, path));
+    NotcDestroy(ctx);
+
+    /* the restored context picks up where the checkpoint left off */
+    restored = NotcCreate(arenas[1], ARENA_SIZE);
+    Check("restore", restored != NULL && NotcRestore(restored, path));
+    if (restored) {
+        Check("call restored function", CallValue(restored, "next", 0, NULL, &value) && value == 3);
+        Check("compile into restored context", Compile(restored, "def twice() { return next() * 2; }\n"));
+        Check("call new function", CallValue(restored, "twice", 0, NULL, &value) && value == 8);
+        Check("restore needs an empty context", !NotcRestore(restored, path));
+        NotcDestroy(restored);
+    }
+    remove(path);
+}
+
+/* TestScheduler - run a call beside one that never returns */
+static void TestScheduler(void)
+{
+    Output spinOutput, countOutput;
+    NotcContext *spin, *count;
+    NotcScheduler *sched;
+    int32_t argv[1];
+    int slices;
+
+    spin = CreateContext(arenas[0], &spinOutput, "def spin() { while (1); }\n");
+    count = CreateContext(arenas[1], &countOutput,
+        "def count(n) { var i; for (i = 0; i < n; ++i) print i; print \"done\"; }\n");
+    Check("compile scheduled programs", spin && count);
+    Check("create scheduler", (sched = NotcCreateScheduler(10)) != NULL);
+    if (spin && count && sched) {
+        argv[0] = 50;
+        Check("start runaway call", NotcStart(sched, spin, NotcLookup(spin, "spin"), 0, NULL));
+        Check("start argc mismatch", !NotcStart(sched, count, NotcLookup(count, "count"), 0, NULL));
+        Check("start call", NotcStart(sched, count, NotcLookup(count, "count"), 1, argv));
+        for (slices = 0; slices < MAX_SLICES && !strstr(countOutput.buf, "done"); ++slices)
+            NotcSchedule(sched);
+        Check("call runs beside runaway call", strstr(countOutput.buf, "49\ndone\n") != NULL);
+        Check("call takes several slices", slices > 10);
+        Check("runaway call is preempted", NotcSchedule(sched));
+    }
+    if (sched)
+        NotcDestroyScheduler(sched);
+    if (spin)
+        NotcDestroy(spin);
+    if (count)
+        NotcDestroy(count);
+}
+
+/* CreateContext - create a context and compile a program into it */
+static NotcContext *CreateContext(void *arena, Output *output, const char *source)
+{
+    NotcContext *ctx;
+    output->len = 0;
+    output->buf[0] = '\0';
+    if (!(ctx = NotcCreate(arena, ARENA_SIZE)))
+        return NULL;
+    NotcSetOutput(ctx, OutputPutChar, output);
+    if (!Compile(ctx, source)) {
+        NotcDestroy(ctx);
+        return NULL;
+    }
+    return ctx;
+}
+
+/* Compile - compile source text into a context */
+static int Compile(NotcContext *ctx, const char *source)
+{
+    return NotcCompile(ctx, source, strlen(source));
+}
+
+/* CallValue - call a function by name */
+static int CallValue(NotcContext *ctx, const char *name, int argc, const int32_t *argv, int32_t *pResult)
+{
+    NotcFunction *function;
+    if (!(function = NotcLookup(ctx, name)))
+        return 0;
+    return NotcCall(ctx, function, argc, argv, pResult);
+}
+
+/* Check - show the result of a check */
+static void Check(const char *name, int ok)
+{
+    printf("%s: %s\n", name, ok ? "ok" : "FAILED");
+    if (!ok)
+        failed = 1;
+}
+
+/* OutputPutChar - collect program output */
+static void OutputPutChar(void *cookie, int ch)
+{
+    Output *output = (Output *)cookie;
+    if (output->len < sizeof(output->buf) - 1) {
+        output->buf[output->len++] = ch;
+        output->buf[output->len] = '\0';
+    }
+}
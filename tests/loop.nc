@@ -0,0 +1,3 @@
+def loop(n) { var i, s; s = 0; for (i = 0; i < n; i++) { s = s + i * 3; if (s > 100000) s = s - 100000; } return s; }
+def poly(n) { var i, s, x; s = 0; for (i = 0; i < n; i++) { x = i & 1023; s = (s + x * x * 3 - x * 7 + (x ^ 5) - (s >> 3)) & 65535; } return s; }
+print loop(300000), poly(300000);
@@ -0,0 +1,69 @@
+#!/bin/sh
+# run.sh notc - run each test program and compare its output with the expected output
+#
+# Each program is run a statement at a time as it is read from standard
+# input and again with -q compiling each statement while the one before it
+# runs, which must not change the output.  It is also compiled as a whole
+# with -f, where a runtime error ends the whole program, so a program with
+# one has its output for -f in name.f.expected.  The programs in whole/
+# only work with -f since they use functions before they are defined.
+#
+# Each program is also saved as an image with -c, which must give the same
+# output when it is loaded and when it is mapped in place with -m (in the
+# builds that can map images).  Each program in checkpoint/ is run and
+# saved as a checkpoint with -s and the checkpoint is restored before
+# running name.resume.nc.
+
+notc=${1:-./notc}
+dir=`dirname $0`
+image=${TMPDIR:-/tmp}/notc-test$$.nbc
+failed=0
+
+trap 'rm -f $image' 0
+
+# check label expected command... - run a command and compare its output
+check() {
+    label=$1
+    output=$2
+    shift 2
+    if "$@" 2>&1 | cmp -s - $output; then
+        echo "$label: ok"
+    else
+        echo "$label: FAILED"
+        failed=1
+    fi
+}
+
+for t in $dir/*.nc; do
+    name=`basename $t .nc`
+    check "$name" $dir/$name.expected $notc < $t
+    check "$name -q" $dir/$name.expected $notc -q < $t
+    expected=$dir/$name.expected
+    if [ -f $dir/$name.f.expected ]; then
+        expected=$dir/$name.f.expected
+    fi
+    check "$name -f" $expected $notc -f $t < /dev/null
+    rm -f $image
+    $notc -c $image < $t > /dev/null 2>&1
+    check "$name -c" $dir/$name.expected $notc $image < /dev/null
+    if $notc -m $image < /dev/null 2>&1 | grep -q "in place"; then
+        echo "$name -m: skipped"
+    else
+        check "$name -m" $dir/$name.expected $notc -m $image < /dev/null
+    fi
+done
+
+for t in $dir/whole/*.nc; do
+    name=`basename $t .nc`
+    check "$name -f" $dir/whole/$name.expected $notc -f $t < /dev/null
+done
+
+for t in $dir/checkpoint/*.resume.nc; do
+    base=${t%.resume.nc}
+    name=`basename $base`
+    rm -f $image
+    check "$name -s" $base.expected $notc -s $image < $base.nc
+    check "$name restore" $base.resume.expected $notc $image < $t
+done
+
+exit $failed
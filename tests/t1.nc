@@ -0,0 +1,22 @@
+def fib(n) { if (n < 2) return n; return fib(n-1) + fib(n-2); }
+var a[5] = {1,2,3,4,5};
+def sum(n) { var i, s; s = 0; for (i = 0; i < n; ++i) s += a[i]; return s; }
+print "fib ", fib(20), " sum ", sum(5);
+x = 3; y = x * 7 - 2; print x, y, y / 4, y % 4, -y, ~y, !y, y << 2, y >> 1, y & 6, y | 8, y ^ 5;
+print x < y, x <= y, x == y, x != y, x >= y, x > y, x && y, x || 0, 0 || 0, 0 && x;
+i = 0; while (i < 3) { print i; i++; }
+i = 5; do { print i$; print " "$; i -= 2; } while (i > 0); print "";
+def loopy(n) { var i, j, t; t = 0; for (i = 0; i < n; i++) { if (i == 3) continue; if (i > 7) break; j = i; t += j * j; } return t; }
+print loopy(100);
+def g2(a, b, c) { return a * 100 + b * 10 + c; }
+print g2(1, 2, 3), g2(4, 5, 6);
+def nest(n) { var k; k = n; if (k > 0) { k = nest(k - 1) + k; } else k = 0; return k; }
+print nest(10);
+var arr[10]; def fill(n) { var i; for (i = 0; i < n; ++i) arr[i] = i * i; return arr[n-1]; }
+print fill(10), arr[3], arr[9];
+def cnt() { var i; i = 0; top: i++; if (i < 5) goto top; return i; }
+print cnt();
+z = 1000000; print z * 3, z + 123456, 0x7fff, 0b1011, 'A';
+def pr() { print "in pr"; }
+pr();
+print "done";
@@ -0,0 +1,13 @@
+def f(a, b) { var r; r = 0; if (a >= b) r = 1; else r = 2; if (a != b) r += 10; if (a == b) r += 100; if (a <= b) r += 1000; if (a > b) r += 10000; return r; }
+print f(1, 2), f(2, 2), f(3, 2);
+def g(x) { return (x + 127) + (1 + x) + (x - 128) + (x - -5) + (x + -128) + (x - 1000) + (x + 1000); }
+print g(7);
+def h(n) { var c; c = 0; do { c++; n--; } while (n != 0); return c; }
+print h(6);
+def k(n) { var i, s; s = 0; for (i = n; i >= 0; --i) s = s + i; i = 0; while (i <= 3) { s = s + 100; ++i; } return s; }
+print k(10);
+q = 5; q = q + 1; q += 2; print q, q + 1, q - 3;
+def p(n) { var x, y; x = y = n; x += 1; return x * 10 + y; }
+print p(4);
+if (q > 3) print "big"; else print "small";
+for (;;) { print "once"; break; }
@@ -0,0 +1,7 @@
+def r(n) { return 1 + r(n + 1); }
+print r(0);
+def s(a,b,c,d,e,f) { return a+(b+(c+(d+(e+f)))); }
+def deep(n) { if (n == 0) return 0; return s(1,2,3,4,5,s(1,2,3,4,5,deep(n-1))); }
+print deep(5);
+print deep(1000);
+print "after";
@@ -0,0 +1,24 @@
+def a1(x) { return x + (x = 5); }
+print a1(1);
+def a2(x) { var y; y = x++; return y * 100 + x; }
+print a2(7);
+def a3(x) { x = x++; return x; }
+print a3(4);
+def a4(x) { var y; y = ++x + x++; return y * 100 + x; }
+print a4(2);
+var v[4] = {10, 20, 30, 40};
+def a5(i) { var o; o = v[i]++; return o * 1000 + v[i] * 10 + (++v[i]); }
+print a5(1), v[1];
+def a6(i) { v[i] += 7; v[i] -= 2; v[i] *= 3; return v[i]; }
+print a6(2), v[2];
+g = 3;
+def a7() { var o; o = g++; return o * 100 + g * 10 + (--g); }
+print a7(), g;
+def a8(x) { g += x; g <<= 1; g |= 1; return g; }
+print a8(2), g;
+def a9(a, b) { var r; r = a && b; return r * 10 + (a || b); }
+print a9(0, 3), a9(2, 3), a9(2, 0), a9(0, 0);
+def b1(a, b, c) { if (!a) return 1; if (!(a < b)) return 2; if (a && b && c) return 3; if (a || b || c) return 4; return 5; }
+print b1(0,0,0), b1(5,1,0), b1(1,2,3), b1(1,2,0);
+def b2(n) { var s; s = 0; while (n) { s += n % 10; n /= 10; } return s; }
+print b2(98765);
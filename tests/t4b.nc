@@ -0,0 +1,24 @@
+def b3(x, y) { return x / y + x % y + (y == 0); }
+print b3(7, 0), b3(17, 5), b3(-17, 5);
+def b5(s) { print s; return 0; }
+b5(5);
+def b6(a, b) { var t; t = a; a = b; b = t; return a * 10 + b; }
+print b6(1, 2);
+def b7(x) { return -x + ~x + !x + (x < 0) + (x >= 3); }
+print b7(4), b7(-2), b7(0);
+def b8(n) { var i, j, s; s = 0; for (i = 0; i < n; ++i) for (j = 0; j < i; j++) s += i * j; return s; }
+print b8(6);
+def c1(a, b, c, d) { return (a + b) * (c - d) - (a * b + c * d) / (1 + a); }
+print c1(3, 4, 10, 2);
+def c2(n) { if (n <= 1) return 1; return n * c2(n - 1); }
+print c2(10);
+def c3(n) { return c2(n) + c2(n + 1) * c2(n - 1); }
+print c3(4);
+def c4(a) { var x; x = a; x += x += 2; return x; }
+print c4(3);
+def c5(a) { var x; x = 1; x = x + a * (x = 10); return x; }
+print c5(2);
+h1 = 0x12345678; print h1, h1 + 1, h1 - 300, 300 - h1;
+def c6(a) { var b, c; b = c = a * 2; return b + c; }
+print c6(21);
+print c6(1) + c2(3) * 2 - g;
@@ -0,0 +1,15 @@
+def ev(n) { if (n == 0) return 1; return od(n - 1); }
+def od(n) { if (n == 0) return 0; return ev(n - 1); }
+print ev(10), od(7), ev(7);
+def a3(x, y, z) { print x, y, z; return x * 100 + y * 10 + z; }
+def b1(q) { return a3(q, q + 1, q + 2) + 1; }
+def c0() { return b1(1) + b1(4); }
+print c0();
+def fib(n) { if (n < 2) return n; return fib(n - 1) + fib(n - 2); }
+def fa(n) { if (n < 2) return n; return fb(n - 1) + fb(n - 2); }
+def fb(n) { if (n < 2) return n; return fa(n - 1) + fa(n - 2); }
+print fib(15), fa(15), fb(16);
+def deep(n) { if (n == 0) return 0; return 1 + deep(n - 1); }
+print deep(20);
+print deep(100000);
+print fib(10);
@@ -0,0 +1,4 @@
+print quad(21);
+def quad(n) { return twice(twice(n)); }
+def twice(n) { return n * 2; }
+print quad(5);